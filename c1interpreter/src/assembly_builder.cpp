@@ -7,62 +7,50 @@ using namespace llvm;
 using namespace c1_recognizer::syntax_tree;
 
 namespace {
-    // a helper function to deal with constant and constexpr conversion
-    Constant *get_const(LLVMContext &context, bool is_result_int, bool is_node_int, 
-                        int int_const_result = 0, double float_const_result = .0) {
-        Constant *constant;
-        if (is_result_int) {
-            constant = is_node_int ? ConstantInt::get(Type::getInt32Ty(context), int_const_result)
-                                   : ConstantFP::get(Type::getDoubleTy(context), int_const_result);
-        } else {
-            constant = is_node_int ? ConstantInt::get(Type::getInt32Ty(context), float_const_result)
-                                   : ConstantFP::get(Type::getDoubleTy(context), float_const_result);
+    Type *get_type(LLVMContext &context, value_type type) {
+        return type == value_type::int_type ? Type::getInt32Ty(context) : Type::getDoubleTy(context);
+    }
+
+    // the value of a constant expression of type `type`
+    Constant *get_const(LLVMContext &context, value_type type, double value) {
+        if (type == value_type::int_type) {
+            return ConstantInt::get(Type::getInt32Ty(context), static_cast<int32_t>(value));
+        }
+        return ConstantFP::get(Type::getDoubleTy(context), value);
+    }
+
+    // an array of `length` elements initialized by packed literals, converted as by get_const, and the rest with 0
+    Constant *get_const_array(LLVMContext &context, const literal_list &literals, bool is_node_int, size_t length) {
+        if (is_node_int) {
+            std::vector<uint32_t> values(length, 0);
+            for (size_t i = 0; i < literals.size(); i++) {
+                values[i] = literals.is_int ? literals.ints[i] : static_cast<uint64_t>(literals.floats[i]);
+            }
+            return ConstantDataArray::get(context, ArrayRef<uint32_t>(values));
+        }
+        std::vector<double> values(length, 0);
+        for (size_t i = 0; i < literals.size(); i++) {
+            values[i] = literals.is_int ? literals.ints[i] : literals.floats[i];
         }
-        return constant;
+        return ConstantDataArray::get(context, ArrayRef<double>(values));
     }
 
-    // convert type from -> to. From_type is int if `from` == true, same applied to `to`
-    Value *auto_conversion(IRBuilder<> &builder, LLVMContext &context, Value *v, bool from, bool to) {
+    // convert v from type `from` to type `to`; conversions of constants are folded
+    Value *auto_conversion(IRBuilder<> &builder, LLVMContext &context, Value *v, value_type from, value_type to) {
         if (from == to) {
             return v;
         }
-        if (from) { // int -> float
+        if (from == value_type::int_type) { // int -> float
             return builder.CreateSIToFP(v, Type::getDoubleTy(context));
         } else { // float -> int
             return builder.CreateFPToSI(v, Type::getInt32Ty(context));
         }
     }
 
-    int calc_expr(binop op, int lhs, int rhs) {
-        switch (op) {
-            case binop::plus:
-                return lhs + rhs;
-            case binop::minus:  
-                return lhs - rhs;
-            case binop::multiply:
-                return lhs * rhs;
-            case binop::divide:
-                return lhs / rhs;
-            case binop::modulo:
-                return lhs % rhs;
-            default:
-                return 0;
-        }
-    }
-
-    double calc_expr(binop op, double lhs, double rhs) {
-        switch (op) {
-            case binop::plus:
-                return lhs + rhs;
-            case binop::minus:  
-                return lhs - rhs;
-            case binop::multiply:
-                return lhs * rhs;
-            case binop::divide:
-                return lhs / rhs;
-            default:
-                return .0;
-        }
+    // the value of the constant expression `node` converted to `to`
+    Constant *get_const(IRBuilder<> &builder, LLVMContext &context, expr_syntax &node, value_type to) {
+        auto constant = get_const(context, node.type, node.constant);
+        return cast<Constant>(auto_conversion(builder, context, constant, node.type, to));
     }
 
     Value *calc_expr(IRBuilder<> &builder, binop op, Value *lhs, Value *rhs, bool is_int) {
@@ -97,24 +85,6 @@ namespace {
         }
     }
 
-    int calc_expr(unaryop op, int rhs) {
-        switch (op) {
-            case unaryop::plus:
-                return rhs;
-            case unaryop::minus:
-                return -rhs;
-        }
-    }
-
-    double calc_expr(unaryop op ,double rhs) {
-        switch (op) {
-            case unaryop::plus:
-                return rhs;
-            case unaryop::minus:
-                return -rhs;
-        }
-    }
-
     Value *calc_expr(IRBuilder<> &builder, unaryop op, Value *rhs, bool is_int) {
         if (is_int) {
             switch (op) {
@@ -181,27 +151,26 @@ void assembly_builder::visit(assembly &node)
 
 void assembly_builder::visit(func_def_syntax &node)
 {
-    if (functions.count(node.name)) {
-        error_flag = true;
-        err.error(node.line, node.pos, "Function named '" + node.name + "' already exists");
+    if (!info.functions[node.slot].reachable) {
         return;
     }
-
     current_function = Function::Create(FunctionType::get(Type::getVoidTy(context), {}, false), 
                                         GlobalValue::LinkageTypes::ExternalLinkage, 
-                                        node.name, 
+                                        spelling(node.name), 
                                         module.get());
-    functions[node.name] = current_function; // declare function
+    functions[node.slot] = current_function; // declare function
+    computed.clear();
+    current_def.clear();
+    incomplete_phis.clear();
+    sealed.clear();
 
     bb_count = 0;
 
     auto entry = BasicBlock::Create(context, "BB" + std::to_string(bb_count++), current_function);
+    seal_block(entry);
     builder.SetInsertPoint(entry);
 
-    in_global = false;
-    // deal with scope after entering the block
     node.body->accept(*this); // definition body
-    in_global = true;
 
     builder.CreateRetVoid();
     builder.ClearInsertionPoint(); // To ensure that nothing more is appended to this function
@@ -209,315 +178,225 @@ void assembly_builder::visit(func_def_syntax &node)
 
 void assembly_builder::visit(cond_syntax &node)
 {
-    constexpr_expected = false;
-    lval_as_rval = true;
-
     node.lhs->accept(*this);
     auto lhs_result = value_result;
-    bool is_lhs_int = is_result_int;
 
     node.rhs->accept(*this);
     auto rhs_result = value_result;
-    bool is_rhs_int = is_result_int;
 
-    is_result_int = is_lhs_int && is_rhs_int; // if one of the operands is float, the result is float
-    // lhs, rhs : int/float -> int/float
-    lhs_result = auto_conversion(builder, context, lhs_result, is_lhs_int, is_result_int);
-    rhs_result = auto_conversion(builder, context, rhs_result, is_rhs_int, is_result_int);
-    value_result = calc_expr(builder, node.op, lhs_result, rhs_result, is_result_int);
+    // lhs, rhs : int/float -> the type they are compared as
+    lhs_result = auto_conversion(builder, context, lhs_result, node.lhs->type, node.operand_type);
+    rhs_result = auto_conversion(builder, context, rhs_result, node.rhs->type, node.operand_type);
+    value_result = calc_expr(builder, node.op, lhs_result, rhs_result, node.operand_type == value_type::int_type);
 }
 
 void assembly_builder::visit(binop_expr_syntax &node)
 {
-    if (constexpr_expected) {
-        node.lhs->accept(*this);
-        if (is_result_int) {
-            int lhs_result = int_const_result;
-            node.rhs->accept(*this);
-            
-            if (is_result_int) {
-                is_result_int = true;  // redundant assignment
-                int_const_result = calc_expr(node.op, lhs_result, int_const_result);
-            } else {
-                if (node.op == binop::modulo) {
-                    error_flag = true;
-                    err.error(node.line, node.pos, "Modulo operator not supported on float");
-                    return;
-                }
-                is_result_int = false;
-                int_const_result = calc_expr(node.op, (double)lhs_result, float_const_result);
-            }
-        } else {
-            double lhs_result = float_const_result;
-            node.rhs->accept(*this);
-
-            if (node.op == binop::modulo) {
-                error_flag = true;
-                err.error(node.line, node.pos, "Modulo operator not supported on float");
-                return;
-            }
-
-            if (is_result_int) {
-                is_result_int = false;
-                float_const_result = calc_expr(node.op, lhs_result, (double)int_const_result);
-            } else {
-                is_result_int = false;
-                float_const_result = calc_expr(node.op, lhs_result, float_const_result);
-            }
+    if (node.is_constant) {
+        value_result = get_const(context, node.type, node.constant);
+        return;
+    }
+    if (find_computed(node)) {
+        return;
+    }
+    // Evaluate the left operands iteratively, so that a long chain like `a + a + ... + a` doesn't recurse once per
+    // operator; each node then only evaluates its right operand. The chain stops at an operand that is constant or
+    // computed before.
+    std::vector<binop_expr_syntax *> chain{&node};
+    for (auto lhs = node.lhs; lhs->kind == node_kind::binop && !lhs->is_constant; lhs = chain.back()->lhs) {
+        if (reuse_shared && computed.count(lhs)) {
+            break;
         }
-    } else {
-        // lval_as_rval has been set by parents
-        node.lhs->accept(*this);
-        auto lhs_result = value_result;
-        bool is_lhs_int = is_result_int;
-
-        node.rhs->accept(*this);
-        auto rhs_result = value_result;
-        bool is_rhs_int = is_result_int;
-
-        is_result_int = is_lhs_int && is_rhs_int; // if one of the operands is float, the result is float
-        // lhs, rhs : int/float -> int/float
-        lhs_result = auto_conversion(builder, context, lhs_result, is_lhs_int, is_result_int);
-        rhs_result = auto_conversion(builder, context, rhs_result, is_rhs_int, is_result_int);
-        value_result = calc_expr(builder, node.op, lhs_result, rhs_result, is_result_int);
+        chain.push_back(static_cast<binop_expr_syntax *>(lhs));
+    }
+    chain.back()->lhs->accept(*this);
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        apply_binop(**it);
+        set_computed(**it);
     }
 }
 
-void assembly_builder::visit(unaryop_expr_syntax &node)
+void assembly_builder::apply_binop(binop_expr_syntax &node)
 {
-    if (constexpr_expected) {
-        node.rhs->accept(*this);
+    auto lhs_result = value_result;
 
-        // is_result_int has been set
-        if (is_result_int) {
-            int_const_result = calc_expr(node.op, int_const_result);
-        } else {
-            float_const_result = calc_expr(node.op, float_const_result);
-        }
-    } else {
-        node.rhs->accept(*this);
+    node.rhs->accept(*this);
+    auto rhs_result = value_result;
+
+    // lhs, rhs : int/float -> the type of the result
+    lhs_result = auto_conversion(builder, context, lhs_result, node.lhs->type, node.type);
+    rhs_result = auto_conversion(builder, context, rhs_result, node.rhs->type, node.type);
+    value_result = calc_expr(builder, node.op, lhs_result, rhs_result, node.type == value_type::int_type);
+}
 
-        // is_result_int has been set
-        value_result = calc_expr(builder, node.op, value_result, is_result_int);
+void assembly_builder::visit(unaryop_expr_syntax &node)
+{
+    if (node.is_constant) {
+        value_result = get_const(context, node.type, node.constant);
+        return;
+    }
+    if (find_computed(node)) {
+        return;
     }
+    node.rhs->accept(*this);
+    value_result = calc_expr(builder, node.op, value_result, node.type == value_type::int_type);
+    set_computed(node);
 }
 
 void assembly_builder::visit(lval_syntax &node)
 {
-    if (constexpr_expected) {
-        error_flag = true;
-        err.error(node.line, node.pos, "Expected a constexpr but found a left value");
+    if (node.is_constant) { // a constant, replaced with its value
+        value_result = get_const(context, node.type, node.constant);
         return;
     }
-
-    // make it work without c++2017 support
-#if __cplusplus >= 201703L
-    auto [var_ptr, is_const, is_array, is_int] = lookup_variable(node.name);
-#else
-    Value *var_ptr;
-    bool is_const, is_array, is_int;
-    std::tie(var_ptr, is_const, is_array, is_int) = lookup_variable(node.name);
-#endif
-
-    if (var_ptr == nullptr) {
-        error_flag = true;
-        err.error(node.line, node.pos, "Unable to access '" + node.name + "' in this context");
+    if (is_ssa(node.slot)) {
+        value_result = read_variable(node.slot, builder.GetInsertBlock());
         return;
     }
-
-    if (is_const && !lval_as_rval) {
-        error_flag = true;
-        err.error(node.line, node.pos, "const value can't be assigned");
+    if (find_computed(node)) {
         return;
     }
-    
-    if (is_array) {
-        if (node.array_index == nullptr) {
-            error_flag = true;
-            err.error(node.line, node.pos, "Expected index but not found");
-            return;
-        } else {
-            bool lval_as_rval_tmp = lval_as_rval;
-            lval_as_rval = true; // lval should be evaluated in index
-            constexpr_expected = false;
-            node.array_index->accept(*this);
-            lval_as_rval = lval_as_rval_tmp; // restore lval_as_rval
-
-            if (!is_result_int) {
-                error_flag = true;
-                err.error(node.line, node.pos, "Array index must be an integer");
-                return;
-            }
+    auto var_ptr = address_of(node);
+    value_result = builder.CreateLoad(var_ptr);
+    set_computed(node);
+}
 
+Value *assembly_builder::address_of(lval_syntax &node)
+{
+    auto var_ptr = variables[node.slot];
+    auto &variable = info.variables[node.slot];
+    if (variable.is_array) {
+        node.array_index->accept(*this);
+        // global arrays are pointed to as a whole, local ones by their first element
+        if (variable.is_global) {
+            var_ptr = builder.CreateGEP(var_ptr, {builder.getInt32(0), value_result});
+        } else {
             var_ptr = builder.CreateGEP(var_ptr, value_result);
         }
     }
-
-    if (lval_as_rval) {
-        value_result = builder.CreateLoad(var_ptr);
-    } else {
-        value_result = var_ptr;
-    }
-
-    is_result_int = is_int;
+    return var_ptr;
 }
 
 void assembly_builder::visit(literal_syntax &node)
 {
-    if (node.is_int) {
-        is_result_int = true;
-        if (constexpr_expected) {
-            int_const_result = node.intConst;
-        } else {
-            value_result = builder.getInt32(node.intConst);
-        }
-    } else {
-        is_result_int = false;
-        if (constexpr_expected) {
-            float_const_result = node.floatConst;
-        } else {
-            value_result = ConstantFP::get(Type::getDoubleTy(context), node.floatConst);
-        }
-    }
+    value_result = get_const(context, node.type, node.constant);
 }
 
 void assembly_builder::visit(var_def_stmt_syntax &node)
 {
+    auto &variable = info.variables[node.slot];
+    if (!variable.reachable) { // a global never used
+        return;
+    }
     auto ty = node.is_int ? Type::getInt32Ty(context) : Type::getDoubleTy(context);
     Value *var;
-    bool is_array;
-
-    if (node.array_length == nullptr) { // not an array
-        is_array = false;
-        if (in_global) { // x array, global
-            constexpr_expected = true;
-            
-            Constant *constant = nullptr;
-            if (!node.initializers.empty()) { // initialize
-                node.initializers[0]->accept(*this);
-                constant = get_const(context, is_result_int, node.is_int, int_const_result, float_const_result);
-            } else {
-                // initialized to zero if no explicit initializer
-                constant = get_const(context, node.is_int, node.is_int, 0, 0);
-            }
 
-            var = new GlobalVariable(*module, ty, node.is_constant, GlobalValue::ExternalLinkage, constant, node.name);
-        } else { // x array, x global
-            var = builder.CreateAlloca(ty, nullptr);
+    if (!variable.is_array) {
+        if (variable.is_global) { // x array, global
+            // initialized to zero if no explicit initializer
+            auto constant = node.initializers.empty()
+                                ? get_const(context, variable.type, 0)
+                                : get_const(builder, context, *node.initializers[0], variable.type);
+            var = new GlobalVariable(*module, ty, node.is_constant, GlobalValue::ExternalLinkage, constant, spelling(node.name));
+        } else if (variable.has_value) { // x array, x global, constant: all reads are replaced with its value
+            var = nullptr;
+        } else { // x array, x global: an SSA value, 0 until assigned like globals
+            var = nullptr;
+            Value *value = get_const(context, variable.type, 0);
 
             if (!node.initializers.empty()) {
-                constexpr_expected = false;
-                lval_as_rval = true; // evaluate lval
-                node.initializers[0]->accept(*this);
+                auto initializer = node.initializers[0];
+                initializer->accept(*this);
 
                 // do implicit conversion if needed
-                auto value_conv = auto_conversion(builder, context, value_result, is_result_int, node.is_int);
-                builder.CreateStore(value_conv, var);
+                value = auto_conversion(builder, context, value_result, initializer->type, variable.type);
             }
+            write_variable(node.slot, builder.GetInsertBlock(), value);
         }
     } else {
-        is_array = true;
-
-        constexpr_expected = true;  // array length need to be constexpr
-        node.array_length->accept(*this);
-
-        if (!is_result_int) {
-            error_flag = true;
-            err.error(node.line, node.pos, "Array length must be an integer");
-            return;
-        }
-
-        int length = int_const_result;
-        if (length < node.initializers.size()) {
-            error_flag = true;
-            err.error(node.line, node.pos, "Array length shorter than the initializer list");
-            return;
-        }
+        int length = variable.array_length;
         auto array_type = ArrayType::get(ty, length);
 
-        if (in_global) { // array, global
+        if (variable.is_global && !node.literal_initializers.empty()) { // array, global, initialized by literals only
+            auto constant = get_const_array(context, node.literal_initializers, node.is_int, length);
+            var = new GlobalVariable(*module, array_type, node.is_constant, GlobalValue::ExternalLinkage, constant, spelling(node.name));
+        } else if (variable.is_global) { // array, global
             std::vector<Constant *> elements;
 
-            constexpr_expected = true;
             for (auto &initializer : node.initializers) { // it's ok when initializers is empty
-                initializer->accept(*this);
-                elements.push_back(get_const(context, is_result_int, node.is_int, int_const_result, float_const_result));
+                elements.push_back(get_const(builder, context, *initializer, variable.type));
             }
 
             for (size_t i = node.initializers.size(); i < length; i++) {
-                elements.push_back(get_const(context, node.is_int, node.is_int, 0, 0)); // fill the rest with 0
+                elements.push_back(get_const(context, variable.type, 0)); // fill the rest with 0
             }
 
             Constant *constant = ConstantArray::get(array_type, elements);
-            var = new GlobalVariable(*module, array_type, node.is_constant, GlobalValue::ExternalLinkage, constant, node.name);
+            var = new GlobalVariable(*module, array_type, node.is_constant, GlobalValue::ExternalLinkage, constant, spelling(node.name));
         } else {
-            var = builder.CreateAlloca(ty, builder.getInt32(int_const_result));
+            // allocated once in the entry block, so that a definition in a loop doesn't grow the stack
+            auto &entry = current_function->getEntryBlock();
+            IRBuilder<> entry_builder(&entry, entry.begin());
+            var = entry_builder.CreateAlloca(ty, builder.getInt32(length));
 
-            constexpr_expected = false;
-            lval_as_rval = true;
+            auto &literals = node.literal_initializers;
+            auto literal_type = literals.is_int ? value_type::int_type : value_type::float_type;
+            for (size_t i = 0; i < literals.size(); i++) {
+                auto constant = literals.is_int ? get_const(context, literal_type, literals.ints[i])
+                                                : get_const(context, literal_type, literals.floats[i]);
+
+                auto elementptr = builder.CreateGEP(var, builder.getInt32(i));
+                auto value_conv = auto_conversion(builder, context, constant, literal_type, variable.type);
+                builder.CreateStore(value_conv, elementptr);
+            }
             for (size_t i = 0; i < node.initializers.size(); i++) {
-                node.initializers[i]->accept(*this);
+                auto initializer = node.initializers[i];
+                initializer->accept(*this);
 
                 auto elementptr = builder.CreateGEP(var, builder.getInt32(i));
-                auto value_conv = auto_conversion(builder, context, value_result, is_result_int, node.is_int);
+                auto value_conv = auto_conversion(builder, context, value_result, initializer->type, variable.type);
                 builder.CreateStore(value_conv, elementptr);
             }
 
-            if (!node.initializers.empty()) { // if initializer list is empty, no need to fill the array with zero
-                for (size_t i = node.initializers.size(); i < length; i++) {
+            if (node.initializers_count() > 0) { // if initializer list is empty, no need to fill the array with zero
+                for (size_t i = node.initializers_count(); i < length; i++) {
                     auto elementptr = builder.CreateGEP(var, builder.getInt32(i));
-                    builder.CreateStore(get_const(context, node.is_int, node.is_int, 0, 0), elementptr);
+                    builder.CreateStore(get_const(context, variable.type, 0), elementptr);
                 }
             }
         }
     }
 
-    if (!declare_variable(node.name, var, node.is_constant, is_array, node.is_int)) {
-        error_flag = true;
-        err.error(node.line, node.pos, "Variable named '" + node.name + "' already exists");
-        return;
-    }
+    variables[node.slot] = var;
 }
 
 void assembly_builder::visit(assign_stmt_syntax &node)
 {
-    constexpr_expected = false;
-
     // evaluate value first
-    lval_as_rval = true;
     node.value->accept(*this);
     auto value = value_result;
-    bool value_is_int = is_result_int;
 
-    lval_as_rval = false;
-    node.target->accept(*this);
-    value = auto_conversion(builder, context, value, value_is_int, is_result_int); // value int/float -> int/float
-    builder.CreateStore(value, value_result);
+    value = auto_conversion(builder, context, value, node.value->type, node.target->type); // value int/float -> int/float
+    if (is_ssa(node.target->slot)) {
+        write_variable(node.target->slot, builder.GetInsertBlock(), value);
+        return;
+    }
+    auto target = address_of(*node.target);
+    builder.CreateStore(value, target);
 }
 
 void assembly_builder::visit(func_call_stmt_syntax &node)
 {
-    auto iter = functions.find(node.name); // use find to avoid searching twice
-    if (iter != functions.end()) { // not found
-        builder.CreateCall(iter->second);
-    } else {
-        error_flag = true;
-        err.error(node.line, node.pos, "No function named '" + node.name + "'");
-    }
+    builder.CreateCall(functions[node.slot]);
 }
 
 void assembly_builder::visit(block_syntax &node)
 {
-    // block syntax is a scope, not a basic block
-    enter_scope();
-
+    // block syntax is a scope, not a basic block; names are resolved by semantic analysis already
     for (auto &stmt : node.body) {
         stmt->accept(*this);
     }
-
-    exit_scope();
 }
-
 void assembly_builder::visit(if_stmt_syntax &node)
 {
     auto then_body = BasicBlock::Create(context, "BB" + std::to_string(bb_count++), current_function);
@@ -527,17 +406,20 @@ void assembly_builder::visit(if_stmt_syntax &node)
 
     node.pred->accept(*this);
     builder.CreateCondBr(value_result, then_body, else_body ? else_body : next);
+    seal_block(then_body);
 
     builder.SetInsertPoint(then_body);
     node.then_body->accept(*this);
     builder.CreateBr(next);
 
     if (node.else_body) {
+        seal_block(else_body);
         builder.SetInsertPoint(else_body);
         node.else_body->accept(*this);
         builder.CreateBr(next);
     }
 
+    seal_block(next);
     builder.SetInsertPoint(next);
 }
 
@@ -549,13 +431,17 @@ void assembly_builder::visit(while_stmt_syntax &node)
 
     builder.CreateBr(pred);
 
+    // the condition is sealed once the loop body branches back to it
     builder.SetInsertPoint(pred);
     node.pred->accept(*this);
     builder.CreateCondBr(value_result, loop_body, next);
+    seal_block(loop_body);
+    seal_block(next);
 
     builder.SetInsertPoint(loop_body);
     node.body->accept(*this);
     builder.CreateBr(pred);
+    seal_block(pred);
 
     builder.SetInsertPoint(next);
 }
@@ -564,3 +450,97 @@ void assembly_builder::visit(empty_stmt_syntax &node)
 {
     // do nothing
 }
+
+Value *assembly_builder::read_variable(int32_t slot, BasicBlock *block)
+{
+    auto &defs = current_def[block];
+    auto found = defs.find(slot);
+    if (found != defs.end()) {
+        return found->second;
+    }
+    return read_variable_recursive(slot, block);
+}
+
+Value *assembly_builder::read_variable_recursive(int32_t slot, BasicBlock *block)
+{
+    Value *value;
+    if (!sealed.count(block)) { // operands are added when it is sealed
+        auto phi = create_phi(slot, block);
+        incomplete_phis[block][slot] = phi;
+        value = phi;
+    } else if (auto pred = block->getSinglePredecessor()) { // no phi needed
+        value = read_variable(slot, pred);
+    } else if (pred_empty(block)) { // read before any definition; can't happen past semantic analysis
+        value = UndefValue::get(get_type(context, info.variables[slot].type));
+    } else { // the phi is defined first, to break cycles through loops
+        auto phi = create_phi(slot, block);
+        write_variable(slot, block, phi);
+        value = add_phi_operands(slot, phi);
+    }
+    write_variable(slot, block, value);
+    return value;
+}
+
+PHINode *assembly_builder::create_phi(int32_t slot, BasicBlock *block)
+{
+    auto ty = get_type(context, info.variables[slot].type);
+    if (block->empty()) {
+        return PHINode::Create(ty, 0, "", block);
+    }
+    return PHINode::Create(ty, 0, "", &block->front());
+}
+
+Value *assembly_builder::add_phi_operands(int32_t slot, PHINode *phi)
+{
+    for (auto pred : predecessors(phi->getParent())) {
+        phi->addIncoming(read_variable(slot, pred), pred);
+    }
+    return try_remove_trivial_phi(phi);
+}
+
+Value *assembly_builder::try_remove_trivial_phi(PHINode *phi)
+{
+    Value *same = nullptr;
+    for (auto &operand : phi->incoming_values()) {
+        if (operand == same || operand == phi) {
+            continue;
+        }
+        if (same) { // merges at least two values
+            return phi;
+        }
+        same = operand;
+    }
+    if (!same) { // unreachable, or in the entry block
+        same = UndefValue::get(phi->getType());
+    }
+    WeakTrackingVH result(same); // may itself be found trivial below
+
+    // phis using it may become trivial in turn; handles, as they may be removed meanwhile
+    std::vector<WeakTrackingVH> users;
+    for (auto user : phi->users()) {
+        if (user != phi && isa<PHINode>(user)) {
+            users.emplace_back(user);
+        }
+    }
+    phi->replaceAllUsesWith(same);
+    phi->eraseFromParent();
+
+    for (auto &user : users) {
+        if (auto user_phi = dyn_cast_or_null<PHINode>(user)) {
+            try_remove_trivial_phi(user_phi);
+        }
+    }
+    return result;
+}
+
+void assembly_builder::seal_block(BasicBlock *block)
+{
+    auto found = incomplete_phis.find(block);
+    if (found != incomplete_phis.end()) {
+        for (auto &incomplete : found->second) {
+            add_phi_operands(incomplete.first, incomplete.second);
+        }
+        incomplete_phis.erase(found);
+    }
+    sealed.insert(block);
+}
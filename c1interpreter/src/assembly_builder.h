@@ -2,10 +2,11 @@
 #ifndef _C1_ASSEMBLY_BUILDER_H_
 #define _C1_ASSEMBLY_BUILDER_H_
 
-#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
@@ -15,9 +16,12 @@
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
+#include <llvm/IR/ValueHandle.h>
 #include <llvm/IR/Verifier.h>
 
 #include <c1recognizer/error_reporter.h>
+#include <c1recognizer/reachability.h>
+#include <c1recognizer/semantic_analysis.h>
 #include <c1recognizer/syntax_tree.h>
 
 #include "runtime.h"
@@ -45,55 +49,94 @@ class assembly_builder : public c1_recognizer::syntax_tree::syntax_tree_visitor
     std::unique_ptr<runtime_info> runtime;
 
     llvm::Value *value_result;
-    int int_const_result;
-    double float_const_result;
-    bool is_result_int;
 
     llvm::Function *current_function;
     int bb_count;
 
-    bool lval_as_rval;
-    bool in_global;
-    bool constexpr_expected;
-
     c1_recognizer::error_reporter &err;
     bool error_flag;
 
+    // With trees made a DAG by share_expressions(), shared expressions are computed once per function, and their
+    // values reused.
+    bool reuse_shared;
+    std::unordered_map<c1_recognizer::syntax_tree::expr_syntax *, llvm::WeakTrackingVH> computed;
+
+    // Types, constants and the variable or function each name refers to come from semantic analysis; the builder only
+    // lowers the annotated tree. Values of the variables and functions are indexed by their slots.
+    c1_recognizer::syntax_tree::semantic_info info;
+    std::vector<llvm::Value *> variables; // nullptr for local scalars, which are SSA values
+    std::vector<llvm::Function *> functions;
+
+    // Local scalars are built into SSA form directly, as by Braun et al., "Simple and Efficient Construction of Static
+    // Single Assignment Form": the value each block last assigned to a variable, by slot, and the phis of blocks not
+    // sealed yet, which may still gain predecessors. Values are tracked through phis found trivial and removed.
+    std::unordered_map<llvm::BasicBlock *, std::unordered_map<int32_t, llvm::WeakTrackingVH>> current_def;
+    std::unordered_map<llvm::BasicBlock *, std::unordered_map<int32_t, llvm::PHINode *>> incomplete_phis;
+    std::unordered_set<llvm::BasicBlock *> sealed;
+
+    bool eliminate_unreachable;
+    c1_recognizer::syntax_tree::reachability_statistics reachability;
+
   public:
-    assembly_builder(llvm::LLVMContext &ctx, c1_recognizer::error_reporter &error_stream)
-        : context(ctx), builder(ctx), err(error_stream) {}
+    assembly_builder(llvm::LLVMContext &ctx, c1_recognizer::error_reporter &error_stream,
+                     bool shared_expressions = false, bool keep_unreachable = false)
+        : context(ctx), builder(ctx), err(error_stream), reuse_shared(shared_expressions),
+          eliminate_unreachable(!keep_unreachable) {}
 
-    void build(std::string name, std::shared_ptr<c1_recognizer::syntax_tree::syntax_tree_node> tree)
+    void build(std::string name, const std::shared_ptr<c1_recognizer::syntax_tree::syntax_tree_node> &tree)
     {
         // Initialize environment.
         module = std::make_unique<llvm::Module>(name, context);
         runtime = std::make_unique<runtime_info>(module.get());
+        info = c1_recognizer::syntax_tree::semantic_info();
+        reachability = c1_recognizer::syntax_tree::reachability_statistics();
+        variables.clear();
+        functions.clear();
 
-        enter_scope();
         for (auto t : runtime->get_language_symbols())
         {
-            llvm::GlobalValue *val;
             std::string name;
             bool is_function;
             bool is_const;
             bool is_array;
             bool is_int;
-            std::tie(name, val, is_function, is_const, is_array, is_int) = t;
+            std::tie(name, is_function, is_const, is_array, is_int) = t;
+            auto symbol = c1_recognizer::syntax_tree::intern(name);
             if (is_function)
-                functions[name] = static_cast<llvm::Function *>(val);
+                info.predeclare_function(symbol);
             else
-                declare_variable(name, val, is_const, is_array, is_int);
+                info.predeclare_variable(symbol, is_int ? c1_recognizer::syntax_tree::value_type::int_type
+                                                        : c1_recognizer::syntax_tree::value_type::float_type,
+                                         is_const, is_array);
         }
 
-        lval_as_rval = true;
-        in_global = true;
-        constexpr_expected = false;
-        error_flag = false;
-        // Start building by starting iterate over the syntax tree.
-        tree->accept(*this);
+        // All errors are found by the analysis, and the tree is only lowered without any.
+        error_flag = !c1_recognizer::syntax_tree::analyze_semantics(
+            static_cast<c1_recognizer::syntax_tree::assembly &>(*tree), info, err);
+        if (!error_flag)
+        {
+            // Functions and globals not reachable from main are left out, runtime symbols included, which are only
+            // emitted when used.
+            if (eliminate_unreachable)
+            {
+                auto entry = c1_recognizer::syntax_tree::intern("main");
+                reachability = c1_recognizer::syntax_tree::find_reachable(info, entry);
+            }
+            variables.resize(info.variables.size());
+            functions.resize(info.functions.size());
+            for (size_t i = 0; i < info.variables.size(); ++i)
+                if (!info.variables[i].definition && info.variables[i].reachable)
+                    variables[i] =
+                        runtime->get_language_symbol(c1_recognizer::syntax_tree::spelling(info.variables[i].name));
+            for (size_t i = 0; i < info.functions.size(); ++i)
+                if (!info.functions[i].definition && info.functions[i].reachable)
+                    functions[i] = static_cast<llvm::Function *>(
+                        runtime->get_language_symbol(c1_recognizer::syntax_tree::spelling(info.functions[i].name)));
+            // Start building by starting iterate over the syntax tree.
+            tree->accept(*this);
+        }
         // Finish by clear IRBuilder's insertion point and moving away built module.
         builder.ClearInsertionPoint();
-        exit_scope();
         if (error_flag)
         {
             module.release();
@@ -104,30 +147,49 @@ class assembly_builder : public c1_recognizer::syntax_tree::syntax_tree_visitor
     std::unique_ptr<llvm::Module> get_module() { return std::move(module); }
     std::unique_ptr<runtime_info> get_runtime_info() { return std::move(runtime); }
 
+    // Of the last build, all zero if unreachable code was kept.
+    const c1_recognizer::syntax_tree::reachability_statistics &get_reachability() const { return reachability; }
+
   private:
-    void enter_scope() { variables.emplace_front(); }
+    // Evaluates the right operand of `node` and applies it to the result of the left one, already evaluated.
+    void apply_binop(c1_recognizer::syntax_tree::binop_expr_syntax &node);
 
-    void exit_scope() { variables.pop_front(); }
+    // Address of the global variable, or of the array element, `node` refers to.
+    llvm::Value *address_of(c1_recognizer::syntax_tree::lval_syntax &node);
 
-    std::tuple<llvm::Value *, bool, bool, bool> lookup_variable(std::string name)
+    bool is_ssa(int32_t slot) const
     {
-        for (auto m : variables)
-            if (m.count(name))
-                return m[name];
-        return std::make_tuple((llvm::Value *)nullptr, false, false, true);
+        return !info.variables[slot].is_global && !info.variables[slot].is_array;
     }
 
-    bool declare_variable(std::string name, llvm::Value *var_ptr, bool is_const, bool is_array, bool is_int)
+    void write_variable(int32_t slot, llvm::BasicBlock *block, llvm::Value *value) { current_def[block][slot] = value; }
+    // Value of the local scalar `slot` at the end of `block`, so far as it is built.
+    llvm::Value *read_variable(int32_t slot, llvm::BasicBlock *block);
+    llvm::Value *read_variable_recursive(int32_t slot, llvm::BasicBlock *block);
+    llvm::PHINode *create_phi(int32_t slot, llvm::BasicBlock *block);
+    llvm::Value *add_phi_operands(int32_t slot, llvm::PHINode *phi);
+    // Replaces `phi` with its only operand other than itself, if it has one, and so on for the phis using it.
+    llvm::Value *try_remove_trivial_phi(llvm::PHINode *phi);
+    // Completes the phis of `block` once all its predecessors branch to it.
+    void seal_block(llvm::BasicBlock *block);
+
+    // Takes the value of `node` as the result if it was computed before.
+    bool find_computed(c1_recognizer::syntax_tree::expr_syntax &node)
     {
-        if (variables.front().count(name))
+        if (!reuse_shared)
+            return false;
+        auto found = computed.find(&node);
+        if (found == computed.end())
             return false;
-        variables.front()[name] = std::make_tuple(var_ptr, is_const, is_array, is_int);
+        value_result = found->second;
         return true;
     }
 
-    std::deque<std::unordered_map<std::string, std::tuple<llvm::Value *, bool, bool, bool>>> variables;
-
-    std::unordered_map<std::string, llvm::Function *> functions;
+    void set_computed(c1_recognizer::syntax_tree::expr_syntax &node)
+    {
+        if (reuse_shared)
+            computed[&node] = value_result;
+    }
 };
 
 #endif
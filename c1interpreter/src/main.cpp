@@ -1,14 +1,26 @@
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
+#include <llvm/Config/llvm-config.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/StandardInstrumentations.h>
 #include <llvm/Support/DynamicLibrary.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
 
+#include <c1recognizer/ast_cache.h>
+#include <c1recognizer/expression_sharing.h>
 #include <c1recognizer/recognizer.h>
+#include <c1recognizer/syntax_tree_deserializer.h>
+#include <c1recognizer/parser_snapshot.h>
+#include <c1recognizer/large_stack.h>
 
 #include "assembly_builder.h"
 
@@ -18,16 +30,91 @@ using namespace c1_recognizer;
 using namespace syntax_tree;
 using namespace std::literals::string_literals;
 
+#if LLVM_VERSION_MAJOR >= 14
+using optimization_level = OptimizationLevel;
+#else
+using optimization_level = PassBuilder::OptimizationLevel;
+#endif
+
+// Runs the default pipeline of LLVM's pass manager for -O`level` on `module`, tuned for `machine`. Functions marked
+// optnone are left as they are.
+static void optimize(Module &module, TargetMachine *machine, int level)
+{
+    LoopAnalysisManager loop_analyses;
+    FunctionAnalysisManager function_analyses;
+    CGSCCAnalysisManager cgscc_analyses;
+    ModuleAnalysisManager module_analyses;
+    // The standard instrumentations are what make passes skip optnone functions.
+    PassInstrumentationCallbacks callbacks;
+    StandardInstrumentations instrumentations(false);
+    instrumentations.registerCallbacks(callbacks, &function_analyses);
+
+    PassBuilder passes(machine, PipelineTuningOptions(), None, &callbacks);
+    passes.registerModuleAnalyses(module_analyses);
+    passes.registerCGSCCAnalyses(cgscc_analyses);
+    passes.registerFunctionAnalyses(function_analyses);
+    passes.registerLoopAnalyses(loop_analyses);
+    passes.crossRegisterProxies(loop_analyses, function_analyses, cgscc_analyses, module_analyses);
+
+    const optimization_level levels[] = {optimization_level::O0, optimization_level::O1, optimization_level::O2,
+                                         optimization_level::O3};
+    auto pipeline = level == 0 ? passes.buildO0DefaultPipeline(levels[0])
+                               : passes.buildPerModuleDefaultPipeline(levels[level]);
+    pipeline.run(module, module_analyses);
+}
+
+static double milliseconds_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
 int main(int argc, char **argv)
 {
     char *in_file = nullptr;
     bool emit_llvm = false;
+    bool share = false, share_stats = false;
+    bool cache_stats = false, from_json = false;
+    bool ir_stats = false, keep_unreachable = false, time_phases = false;
+    int opt_level = -1; // No IR passes, and the JIT's default code generation, without -O
+    vector<string> unoptimized;
+    string parser_snapshot, cache_directory;
     for (int i = 1; i < argc; ++i)
         if ("-emit-llvm"s == argv[i])
             emit_llvm = true;
+        else if ("-share-expressions"s == argv[i])
+            share = true;
+        else if ("-share-stats"s == argv[i])
+            share = share_stats = true;
+        else if (string(argv[i]).compare(0, 17, "-parser-snapshot=") == 0)
+            parser_snapshot = argv[i] + 17;
+        else if (string(argv[i]).compare(0, 11, "-ast-cache=") == 0)
+            cache_directory = argv[i] + 11;
+        else if ("-ast-cache-stats"s == argv[i])
+            cache_stats = true;
+        else if ("-from-json"s == argv[i])
+            from_json = true;
+        else if ("-ir-stats"s == argv[i])
+            ir_stats = true;
+        else if ("-keep-unreachable"s == argv[i])
+            keep_unreachable = true;
+        else if (string(argv[i]).size() == 3 && argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] >= '0' &&
+                 argv[i][2] <= '3')
+            opt_level = argv[i][2] - '0';
+        else if (string(argv[i]).compare(0, 13, "-no-optimize=") == 0)
+            unoptimized.push_back(argv[i] + 13);
+        else if ("-time"s == argv[i])
+            time_phases = true;
         else if ("-h"s == argv[i] || "--help"s == argv[i])
         {
-            cout << "Usage: c1i [-emit-llvm] <input-c1-source>." << endl;
+            cout << "Usage: c1i [-emit-llvm] [-share-expressions] [-share-stats] [-parser-snapshot=<file>] "
+                    "[-ast-cache=<directory>] [-ast-cache-stats] [-from-json] [-ir-stats] [-keep-unreachable] "
+                    "[-O0|-O1|-O2|-O3] [-no-optimize=<function>]... [-time] <input-c1-source>."
+                 << endl
+                 << "With -from-json, the input is a syntax tree in JSON, as c1r_test writes it." << endl
+                 << "Functions and globals not reachable from main are not compiled, unless -keep-unreachable." << endl
+                 << "-O<n> optimizes the IR with LLVM's default pipeline for that level before it is printed or run, "
+                    "and sets the JIT's code generation level to match; -no-optimize leaves a function out." << endl
+                 << "-time reports the time spent optimizing, generating code and running." << endl;
             return 0;
         }
         else if (argv[i][0] == '-')
@@ -52,26 +139,98 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    // A missing or stale snapshot only costs speed.
+    if (!parser_snapshot.empty() && !load_parser_snapshot(parser_snapshot))
+        cerr << "Cannot load parser snapshot '" << parser_snapshot << "', ignored." << endl;
+
     ifstream in_stream(in_file);
-    recognizer c1r(in_stream);
+    in_stream.seekg(0, ios::end);
+    size_t in_size = in_stream.tellg();
+    in_stream.seekg(0);
 
-    error_reporter err(cerr);
-    if (!c1r.execute(err))
+    // The cache is keyed by the source, so it is read up front rather than by the recognizer.
+    unique_ptr<ast_cache> cache;
+    string source;
+    if (!cache_directory.empty())
     {
-        cerr << "Parsing failed. Exiting." << endl;
-        return 2;
+        cache.reset(new ast_cache(cache_directory));
+        source.assign(istreambuf_iterator<char>(in_stream), istreambuf_iterator<char>());
     }
-
-    auto ast = c1r.get_syntax_tree();
+    // Without a cache the source is mapped into memory and lexed in place, rather than read into a string first.
+    auto c1r = cache ? unique_ptr<recognizer>(new recognizer(source)) : recognizer::from_file(in_file);
 
     string name = in_file;
     name = name.substr(name.find_last_of("/\\") + 1);
 
+    // Parsing and building recurse as deep as the source nests.
+    error_reporter err(cerr);
     LLVMContext llvm_ctx;
-    assembly_builder builder(llvm_ctx, err);
-    builder.build(name, ast);
-    auto module = builder.get_module();
-    auto runtime = builder.get_runtime_info();
+    bool parsed;
+    unique_ptr<Module> module;
+    unique_ptr<runtime_info> runtime;
+    reachability_statistics reachability;
+    run_with_stack(stack_size_for(in_size), [&] {
+        shared_ptr<syntax_tree_node> ast;
+        if (cache)
+            ast = cache->lookup(source);
+        if (!ast && from_json)
+        {
+            syntax_tree_deserializer deserializer;
+            ast = cache ? deserializer.deserialize(source.data(), source.size()) : deserializer.deserialize(in_stream);
+            if (!ast)
+            {
+                cerr << deserializer.get_error() << endl;
+                parsed = false;
+                return;
+            }
+            if (cache && !cache->store(source, *static_pointer_cast<assembly>(ast)))
+                cerr << "Cannot write to AST cache '" << cache_directory << "', ignored." << endl;
+        }
+        else if (!ast)
+        {
+            parsed = c1r->execute(err);
+            if (!parsed)
+                return;
+            ast = c1r->get_syntax_tree();
+            // Stored before sharing expressions changes the tree. A cache that can't be written only costs speed.
+            if (cache && !cache->store(source, *static_pointer_cast<assembly>(ast)))
+                cerr << "Cannot write to AST cache '" << cache_directory << "', ignored." << endl;
+        }
+        parsed = true;
+        try
+        {
+            if (share)
+            {
+                auto statistics = share_expressions(*static_pointer_cast<assembly>(ast));
+                if (share_stats)
+                    cerr << "Shared " << statistics.shared() << " of " << statistics.expressions << " expressions ("
+                         << statistics.ratio() * 100 << "%)." << endl;
+            }
+            assembly_builder builder(llvm_ctx, err, share, keep_unreachable);
+            builder.build(name, ast);
+            reachability = builder.get_reachability();
+            module = builder.get_module();
+            runtime = builder.get_runtime_info();
+        }
+        catch (stack_exhausted &e)
+        {
+            // The stack was capped below what the source needs; see stack_size_for.
+            cerr << e.what() << " to compile '" << name << "'." << endl;
+        }
+    });
+
+    if (cache_stats && cache)
+    {
+        auto &statistics = cache->get_statistics();
+        cerr << "AST cache: " << statistics.hits << " hits, " << statistics.misses << " misses, " << statistics.rejected
+             << " rejected, " << statistics.stores << " stored." << endl;
+    }
+
+    if (!parsed)
+    {
+        cerr << "Parsing failed. Exiting." << endl;
+        return 2;
+    }
 
     if (!module)
     {
@@ -79,8 +238,80 @@ int main(int argc, char **argv)
         return 3;
     }
 
+    if (ir_stats)
+    {
+        size_t instructions = 0, blocks = 0;
+        for (auto &function : *module)
+            for (auto &block : function)
+            {
+                ++blocks;
+                instructions += block.size();
+            }
+        cerr << "IR: " << instructions << " instructions in " << blocks << " basic blocks." << endl;
+        if (!keep_unreachable)
+            cerr << "Reachable: " << reachability.reachable_functions << " of " << reachability.functions
+                 << " functions, " << reachability.reachable_globals << " of " << reachability.globals << " globals."
+                 << endl;
+    }
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    // The machine the JIT will generate code for, which passes are tuned for.
+    const CodeGenOpt::Level codegen_levels[] = {CodeGenOpt::None, CodeGenOpt::Less, CodeGenOpt::Default,
+                                                CodeGenOpt::Aggressive};
+    unique_ptr<TargetMachine> machine;
+    double optimize_time = 0;
+    if (opt_level >= 0)
+    {
+        machine.reset(EngineBuilder().setOptLevel(codegen_levels[opt_level]).selectTarget());
+        if (!machine)
+        {
+            cerr << "No target machine to optimize for. Exiting." << endl;
+            return 4;
+        }
+        module->setDataLayout(machine->createDataLayout());
+        module->setTargetTriple(machine->getTargetTriple().str());
+
+        for (auto &function_name : unoptimized)
+        {
+            auto function = module->getFunction(function_name);
+            if (!function || function->isDeclaration())
+            {
+                cerr << "No function '" << function_name << "' to leave unoptimized, ignored." << endl;
+                continue;
+            }
+            // optnone requires noinline, which also keeps its body from being optimized where it is called.
+            function->addFnAttr(Attribute::OptimizeNone);
+            function->addFnAttr(Attribute::NoInline);
+        }
+
+        auto start = chrono::steady_clock::now();
+        optimize(*module, machine.get(), opt_level);
+        optimize_time = milliseconds_since(start);
+
+        if (ir_stats)
+        {
+            size_t instructions = 0, blocks = 0;
+            for (auto &function : *module)
+                for (auto &block : function)
+                {
+                    ++blocks;
+                    instructions += block.size();
+                }
+            cerr << "Optimized IR: " << instructions << " instructions in " << blocks << " basic blocks." << endl;
+        }
+    }
+    else if (!unoptimized.empty())
+        cerr << "-no-optimize has no effect without -O, ignored." << endl;
+
     if (emit_llvm)
+    {
         module->print(outs(), nullptr);
+        if (time_phases)
+            cerr << "Time: optimize " << optimize_time << " ms." << endl;
+    }
     else
     {
         auto entry_func = module->getFunction("main");
@@ -90,24 +321,30 @@ int main(int argc, char **argv)
             return 4;
         }
 
-        InitializeNativeTarget();
-        InitializeNativeTargetAsmPrinter();
-        InitializeNativeTargetAsmParser();
-        
         for (auto t : runtime->get_runtime_symbols())
             sys::DynamicLibrary::AddSymbol(get<0>(t), get<1>(t));
 
         string error_info;
-        unique_ptr<ExecutionEngine> engine(EngineBuilder(move(module))
-                                               .setEngineKind(EngineKind::JIT)
-                                               .setErrorStr(&error_info)
-                                               .create());
+        EngineBuilder engine_builder(move(module));
+        engine_builder.setEngineKind(EngineKind::JIT).setErrorStr(&error_info);
+        unique_ptr<ExecutionEngine> engine(machine ? engine_builder.create(machine.release()) : engine_builder.create());
         if (!engine)
         {
             cerr << "EngineBuilder failed: " << error_info << endl;
             return 4;
         }
+
+        auto start = chrono::steady_clock::now();
+        engine->finalizeObject();
+        auto codegen_time = milliseconds_since(start);
+
+        start = chrono::steady_clock::now();
         engine->runFunction(entry_func, {});
+        auto run_time = milliseconds_since(start);
+
+        if (time_phases)
+            cerr << "Time: optimize " << optimize_time << " ms, generate code " << codegen_time << " ms, run "
+                 << run_time << " ms." << endl;
     }
 
     return 0;
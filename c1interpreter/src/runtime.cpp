@@ -10,105 +10,80 @@
 using namespace std;
 using namespace llvm;
 
-runtime_info::runtime_info(Module *module)
+runtime_info::runtime_info(Module *module) : module(module)
 {
-    input_ivar = new GlobalVariable(*module,
-                                   Type::getInt32Ty(module->getContext()),
-                                   false,
-                                   GlobalValue::ExternalLinkage,
-                                   ConstantInt::get(Type::getInt32Ty(module->getContext()), 0),
-                                   "input_ivar");
-    input_fvar = new GlobalVariable(*module,
-                                   Type::getDoubleTy(module->getContext()),
-                                   false,
-                                   GlobalValue::ExternalLinkage,
-                                   ConstantFP::get(Type::getDoubleTy(module->getContext()), 0),
-                                   "input_fvar");
-    output_ivar = new GlobalVariable(*module,
-                                    Type::getInt32Ty(module->getContext()),
-                                    false,
-                                    GlobalValue::ExternalLinkage,
-                                    ConstantInt::get(Type::getInt32Ty(module->getContext()), 0),
-                                    "output_ivar");
-    output_fvar = new GlobalVariable(*module,
-                                    Type::getDoubleTy(module->getContext()),
-                                    false,
-                                    GlobalValue::ExternalLinkage,
-                                    ConstantFP::get(Type::getDoubleTy(module->getContext()), 0),
-                                    "output_fvar");
-    auto inputInt_impl = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()),
-                                                         {Type::getInt32PtrTy(module->getContext())},
-                                                         false),
-                                       GlobalValue::LinkageTypes::ExternalLinkage,
-                                       "inputInt_impl",
-                                       module);
-    auto inputFloat_impl = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()),
-                                                         {Type::getDoublePtrTy(module->getContext())},
-                                                         false),
-                                       GlobalValue::LinkageTypes::ExternalLinkage,
-                                       "inputFloat_impl",
-                                       module);
-    auto outputInt_impl = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()),
-                                                          {Type::getInt32PtrTy(module->getContext())},
-                                                          false),
-                                        GlobalValue::LinkageTypes::ExternalLinkage,
-                                        "outputInt_impl",
-                                        module);
-    auto outputFloat_impl = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()),
-                                                          {Type::getDoublePtrTy(module->getContext())},
-                                                          false),
-                                        GlobalValue::LinkageTypes::ExternalLinkage,
-                                        "outputFloat_impl",
-                                        module);
-
-    IRBuilder<> builder(module->getContext());
+    // Symbols are emitted the first time they are asked for, so that programs not using them don't carry them.
+}
 
-    inputInt_func = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()), {}, false),
-                                  GlobalValue::LinkageTypes::ExternalLinkage,
-                                  "inputInt",
-                                  module);
-    builder.SetInsertPoint(BasicBlock::Create(module->getContext(), "entry", inputInt_func));
-    builder.CreateCall(inputInt_impl, {input_ivar});
-    builder.CreateRetVoid();
+GlobalVariable *runtime_info::get_io_variable(GlobalVariable *&var, const string &name, bool is_int)
+{
+    if (!var) {
+        auto type = is_int ? Type::getInt32Ty(module->getContext()) : Type::getDoubleTy(module->getContext());
+        var = new GlobalVariable(*module,
+                                 type,
+                                 false,
+                                 GlobalValue::ExternalLinkage,
+                                 is_int ? static_cast<Constant *>(ConstantInt::get(type, 0)) : ConstantFP::get(type, 0),
+                                 name);
+    }
+    return var;
+}
 
-    inputFloat_func = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()), {}, false),
-                                  GlobalValue::LinkageTypes::ExternalLinkage,
-                                  "inputFloat",
-                                  module);
-    builder.SetInsertPoint(BasicBlock::Create(module->getContext(), "entry", inputFloat_func));
-    builder.CreateCall(inputFloat_impl, {input_fvar});
-    builder.CreateRetVoid();
+Function *runtime_info::get_io_function(Function *&func, const string &name, GlobalVariable *var)
+{
+    if (!func) {
+        auto impl = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()), {var->getType()}, false),
+                                     GlobalValue::LinkageTypes::ExternalLinkage,
+                                     name + "_impl",
+                                     module);
 
-    outputInt_func = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()), {}, false),
-                                   GlobalValue::LinkageTypes::ExternalLinkage,
-                                   "outputInt",
-                                   module);
-    builder.SetInsertPoint(BasicBlock::Create(module->getContext(), "entry", outputInt_func));
-    builder.CreateCall(outputInt_impl, {output_ivar});
-    builder.CreateRetVoid();
+        IRBuilder<> builder(module->getContext());
 
-    outputFloat_func = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()), {}, false),
-                                   GlobalValue::LinkageTypes::ExternalLinkage,
-                                   "outputFloat",
-                                   module);
-    builder.SetInsertPoint(BasicBlock::Create(module->getContext(), "entry", outputFloat_func));
-    builder.CreateCall(outputFloat_impl, {output_fvar});
-    builder.CreateRetVoid();
+        func = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()), {}, false),
+                                GlobalValue::LinkageTypes::ExternalLinkage,
+                                name,
+                                module);
+        builder.SetInsertPoint(BasicBlock::Create(module->getContext(), "entry", func));
+        builder.CreateCall(impl, {var});
+        builder.CreateRetVoid();
+    }
+    return func;
 }
 
 using namespace string_literals;
 
-vector<tuple<string, llvm::GlobalValue *, bool, bool, bool, bool>> runtime_info::get_language_symbols()
+vector<tuple<string, bool, bool, bool, bool>> runtime_info::get_language_symbols()
 {
     return {
-        make_tuple("input_ivar"s, input_ivar, false, false, false, true),
-        make_tuple("input_fvar"s, input_fvar, false, false, false, false),
-        make_tuple("output_ivar"s, output_ivar, false, false, false, true),
-        make_tuple("output_fvar"s, output_fvar, false, false, false, false),
-        make_tuple("inputInt"s, inputInt_func, true, false, false, true),
-        make_tuple("inputFloat"s, inputFloat_func, true, false, false, false),
-        make_tuple("outputInt"s, outputInt_func, true, false, false, true),
-        make_tuple("outputFloat"s, outputFloat_func, true, false, false, false)};
+        make_tuple("input_ivar"s, false, false, false, true),
+        make_tuple("input_fvar"s, false, false, false, false),
+        make_tuple("output_ivar"s, false, false, false, true),
+        make_tuple("output_fvar"s, false, false, false, false),
+        make_tuple("inputInt"s, true, false, false, true),
+        make_tuple("inputFloat"s, true, false, false, false),
+        make_tuple("outputInt"s, true, false, false, true),
+        make_tuple("outputFloat"s, true, false, false, false)};
+}
+
+GlobalValue *runtime_info::get_language_symbol(const string &name)
+{
+    if (name == "input_ivar")
+        return get_io_variable(input_ivar, name, true);
+    if (name == "input_fvar")
+        return get_io_variable(input_fvar, name, false);
+    if (name == "output_ivar")
+        return get_io_variable(output_ivar, name, true);
+    if (name == "output_fvar")
+        return get_io_variable(output_fvar, name, false);
+    if (name == "inputInt")
+        return get_io_function(inputInt_func, name, get_io_variable(input_ivar, "input_ivar", true));
+    if (name == "inputFloat")
+        return get_io_function(inputFloat_func, name, get_io_variable(input_fvar, "input_fvar", false));
+    if (name == "outputInt")
+        return get_io_function(outputInt_func, name, get_io_variable(output_ivar, "output_ivar", true));
+    if (name == "outputFloat")
+        return get_io_function(outputFloat_func, name, get_io_variable(output_fvar, "output_fvar", false));
+    return nullptr;
 }
 
 vector<tuple<string, void *>> runtime_info::get_runtime_symbols()
@@ -2,6 +2,7 @@
 #ifndef _C1_RUNTIME_H_
 #define _C1_RUNTIME_H_
 
+#include <string>
 #include <vector>
 #include <tuple>
 
@@ -11,19 +12,29 @@
 
 class runtime_info
 {
-    llvm::GlobalVariable *input_ivar;
-    llvm::GlobalVariable *input_fvar;
-    llvm::GlobalVariable *output_ivar;
-    llvm::GlobalVariable *output_fvar;
-    llvm::Function *inputInt_func;
-    llvm::Function *inputFloat_func;
-    llvm::Function *outputInt_func;
-    llvm::Function *outputFloat_func;
+    llvm::Module *module;
+    llvm::GlobalVariable *input_ivar = nullptr;
+    llvm::GlobalVariable *input_fvar = nullptr;
+    llvm::GlobalVariable *output_ivar = nullptr;
+    llvm::GlobalVariable *output_fvar = nullptr;
+    llvm::Function *inputInt_func = nullptr;
+    llvm::Function *inputFloat_func = nullptr;
+    llvm::Function *outputInt_func = nullptr;
+    llvm::Function *outputFloat_func = nullptr;
+
+    // `var`, emitted as `name` if it isn't yet.
+    llvm::GlobalVariable *get_io_variable(llvm::GlobalVariable *&var, const std::string &name, bool is_int);
+    // `func`, emitted as `name` calling `name`_impl with the address of `var` if it isn't yet.
+    llvm::Function *get_io_function(llvm::Function *&func, const std::string &name, llvm::GlobalVariable *var);
 
   public:
     runtime_info(llvm::Module *module);
 
-    std::vector<std::tuple<std::string, llvm::GlobalValue *, bool, bool, bool, bool>> get_language_symbols();
+    // Names of the variables and functions of the language, with is_function, is_const, is_array and is_int.
+    std::vector<std::tuple<std::string, bool, bool, bool, bool>> get_language_symbols();
+
+    // The language symbol `name`, emitted into the module with what it uses the first time it is asked for.
+    llvm::GlobalValue *get_language_symbol(const std::string &name);
 
     std::vector<std::tuple<std::string, void *>> get_runtime_symbols();
 };
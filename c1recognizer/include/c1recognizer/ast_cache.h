@@ -0,0 +1,62 @@
+
+#ifndef _C1_AST_CACHE_H_
+#define _C1_AST_CACHE_H_
+
+#include <c1recognizer/syntax_tree.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+// An image is a syntax tree in a binary file: the arrays of its flat_syntax_tree as they are, nodes referring to their
+// children by index, followed by the spellings of its identifiers. Nothing in it depends on the address it is read
+// at, so it is read in place from a mapping of the file. It starts with a magic number and a format version; images
+// of other versions, or written on hosts of another byte order, are rejected rather than converted.
+
+// Image of the tree of `root`. Throws std::length_error if the tree has too many nodes for flat_syntax_tree.
+std::string write_ast_image(const assembly &root);
+
+// Rebuilds the tree held by the image at [data, data + size), which must be 8-byte aligned. Returns nullptr if the
+// image is malformed or of another version. The tree doesn't refer to the image once built.
+std::shared_ptr<assembly> read_ast_image(const void *data, size_t size);
+
+// A directory of images, named after a hash of the sources they were recognized from, for tools recognizing the same
+// sources over and over to skip lexing and parsing. Processes may share the directory: images are written to a
+// temporary file and renamed into place, so that a lookup never sees one half written.
+//
+// The hash is 128 bits wide and the image records the length of its source, but it is not a cryptographic hash: the
+// directory must only be writable by those trusted to provide the sources.
+class ast_cache
+{
+  public:
+    struct statistics
+    {
+        size_t hits = 0;
+        size_t misses = 0;   // Lookups finding no usable image, including rejected ones
+        size_t rejected = 0; // Images found but malformed, of another version or of another source
+        size_t stores = 0;   // Images written
+    };
+
+    // Keeps images in `directory`, which is created if missing.
+    explicit ast_cache(const std::string &directory);
+
+    // Tree of `source` if the cache holds its image, or nullptr. The image is mapped into memory rather than read.
+    std::shared_ptr<assembly> lookup(const std::string &source);
+    // Writes the image of `root`, the tree recognized from `source`. Returns false if it can't be written.
+    bool store(const std::string &source, const assembly &root);
+
+    const statistics &get_statistics() const { return stats; }
+    // File holding the image of `source`.
+    std::string path_for(const std::string &source) const;
+
+  private:
+    std::string directory;
+    statistics stats;
+};
+}
+}
+
+#endif
@@ -0,0 +1,67 @@
+
+#ifndef _C1_AST_CONTEXT_H_
+#define _C1_AST_CONTEXT_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+// Owns the nodes of one syntax tree. Nodes are bump-allocated in slabs, linked to each other by plain pointers, and
+// never freed one by one: destroying the context frees its slabs at once. Only nodes with members of their own on
+// the heap (lists) have their destructors run then; expressions have none.
+//
+// Recognizers hand out the root of a tree as a std::shared_ptr sharing ownership of the context, so that the tree
+// lives as long as any pointer to its root.
+class ast_context
+{
+  public:
+    ast_context();
+    ~ast_context();
+    ast_context(const ast_context &) = delete;
+    ast_context &operator=(const ast_context &) = delete;
+
+    template <typename T, typename... Args>
+    T *make(Args &&... args)
+    {
+        auto node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value)
+            destructors.push_back({node, [](void *p) { static_cast<T *>(p)->~T(); }});
+        ++nodes_count;
+        return node;
+    }
+
+    // Keeps `owner` alive as long as this context, for trees linking to nodes owned by other contexts.
+    void keep(std::shared_ptr<const void> owner);
+
+    size_t get_nodes_count() const { return nodes_count; }
+    // Bytes of the slabs allocated so far.
+    size_t get_slab_bytes() const { return slab_bytes; }
+
+  private:
+    struct destructor
+    {
+        void *node;
+        void (*destroy)(void *);
+    };
+
+    void *allocate(size_t size, size_t alignment);
+
+    std::vector<std::unique_ptr<char[]>> slabs;
+    char *cur;
+    char *end;
+    size_t slab_bytes;
+    size_t nodes_count;
+    std::vector<destructor> destructors;
+    std::vector<std::shared_ptr<const void>> kept;
+};
+}
+}
+
+#endif
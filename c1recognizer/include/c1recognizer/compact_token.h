@@ -0,0 +1,152 @@
+
+#ifndef _C1_COMPACT_TOKEN_H_
+#define _C1_COMPACT_TOKEN_H_
+
+#include <CharStream.h>
+#include <Lexer.h>
+#include <TokenFactory.h>
+#include <WritableToken.h>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace c1_recognizer
+{
+
+class token_arena;
+
+// Token packed into 48 bytes, allocated from a token_arena rather than the heap. Its text is a view into the source
+// text (or into the arena, for text set explicitly), only copied into a std::string when getText() is called.
+// Offsets, lengths, lines and columns are 32-bit, and types 16-bit. The stop index is derived from the length of the
+// text, so it only matches the source for tokens whose text is the source's.
+class compact_token : public antlr4::WritableToken
+{
+  public:
+    compact_token(token_arena &_arena, size_t _type, size_t _channel, size_t _start, const char *_text, size_t _length,
+                  size_t _line, size_t _column);
+
+    // Tokens live in their arena, so deleting one only runs its destructor; the arena frees them all at once.
+    static void *operator new(size_t size, token_arena &arena);
+    static void operator delete(void *) noexcept {}
+    static void operator delete(void *, token_arena &) noexcept {}
+
+    const char *text_begin() const { return text; }
+    size_t text_length() const { return length; }
+
+    virtual std::string getText() const override;
+    virtual size_t getType() const override;
+    virtual size_t getLine() const override;
+    virtual size_t getCharPositionInLine() const override;
+    virtual size_t getChannel() const override;
+    virtual size_t getTokenIndex() const override;
+    virtual size_t getStartIndex() const override;
+    virtual size_t getStopIndex() const override;
+    virtual antlr4::TokenSource *getTokenSource() const override;
+    virtual antlr4::CharStream *getInputStream() const override;
+    virtual std::string toString() const override;
+
+    virtual void setText(const std::string &_text) override;
+    virtual void setType(size_t _type) override;
+    virtual void setLine(size_t _line) override;
+    virtual void setCharPositionInLine(size_t pos) override;
+    virtual void setChannel(size_t _channel) override;
+    virtual void setTokenIndex(size_t _index) override;
+
+  private:
+    const char *text;
+    token_arena *arena;
+    uint32_t start;
+    uint32_t length;
+    uint32_t line;
+    uint32_t column;
+    uint32_t index;
+    uint16_t type;
+    uint16_t channel;
+};
+
+// Contiguous storage for the tokens of one source, in slabs of a few thousand tokens. Tokens must be deleted (or
+// abandoned) before reset() or destruction of the arena.
+class token_arena
+{
+  public:
+    token_arena();
+
+    // Forgets all tokens and starts over for `text`, which token start indices are byte offsets into, as with
+    // utf8_char_stream. Only the first slab is kept for reuse.
+    void reset(const char *_text, std::pair<antlr4::TokenSource *, antlr4::CharStream *> _source);
+
+    void *allocate(size_t size);
+    // Copies `text` into the arena, for tokens whose text isn't in the source.
+    const char *copy(const std::string &text);
+
+    const char *get_text() const { return base; }
+    antlr4::TokenSource *get_token_source() const { return source.first; }
+    antlr4::CharStream *get_input_stream() const { return source.second; }
+
+    size_t get_tokens_count() const { return tokens_count; }
+    size_t get_slabs_count() const { return slabs.size(); }
+
+  private:
+    std::vector<std::unique_ptr<char[]>> slabs;
+    char *cur;
+    char *end;
+    std::deque<std::string> texts;
+    const char *base;
+    std::pair<antlr4::TokenSource *, antlr4::CharStream *> source;
+    size_t tokens_count;
+};
+
+// Makes compact_tokens in its own arena.
+class compact_token_factory : public antlr4::TokenFactory<compact_token>
+{
+  public:
+    void reset(const char *text, std::pair<antlr4::TokenSource *, antlr4::CharStream *> source);
+    const token_arena &get_arena() const { return arena; }
+
+    virtual std::unique_ptr<compact_token> create(std::pair<antlr4::TokenSource *, antlr4::CharStream *> source,
+                                                  size_t type, const std::string &text, size_t channel, size_t start,
+                                                  size_t stop, size_t line, size_t charPositionInLine) override;
+    virtual std::unique_ptr<compact_token> create(size_t type, const std::string &text) override;
+
+  private:
+    token_arena arena;
+};
+
+// `Base` (C1Lexer, in practice) emitting compact_tokens. Lexer's own token factory can only make CommonTokens, so
+// the tokens are emitted through `factory` instead. reset_tokens() must be called with the text of each new input,
+// once the tokens of the previous one are gone.
+template <typename Base>
+class compact_token_lexer : public Base
+{
+  public:
+    using Base::Base;
+    using Base::emit;
+
+    void reset_tokens(const char *text) { factory.reset(text, {this, this->_input}); }
+    const token_arena &get_arena() const { return factory.get_arena(); }
+
+    virtual antlr4::Token *emit() override
+    {
+        Base::emit(factory.create({this, this->_input}, this->type, this->_text, this->channel,
+                                  this->tokenStartCharIndex, this->getCharIndex() - 1, this->tokenStartLine,
+                                  this->tokenStartCharPositionInLine));
+        return this->token.get();
+    }
+
+    virtual antlr4::Token *emitEOF() override
+    {
+        auto index = this->_input->index();
+        Base::emit(factory.create({this, this->_input}, antlr4::Token::EOF, "", antlr4::Token::DEFAULT_CHANNEL, index,
+                                  index - 1, this->getLine(), this->getCharPositionInLine()));
+        return this->token.get();
+    }
+
+  private:
+    compact_token_factory factory;
+};
+}
+
+#endif
@@ -0,0 +1,35 @@
+
+#ifndef _C1_EXPRESSION_SHARING_H_
+#define _C1_EXPRESSION_SHARING_H_
+
+#include <c1recognizer/syntax_tree.h>
+#include <cstddef>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+struct sharing_statistics
+{
+    size_t expressions = 0; // Expression nodes reachable before sharing
+    size_t distinct = 0;    // Expression nodes reachable after
+
+    size_t shared() const { return expressions - distinct; }
+    // Fraction of expression nodes replaced by an equal one.
+    double ratio() const { return expressions ? double(shared()) / expressions : 0; }
+};
+
+// Turns the expressions in function bodies of `root` into a DAG, replacing each expression with an equal one computed
+// earlier, when the operands it reads can't have changed since. Equal expressions are only shared within a run of
+// simple statements (definitions, assignments, empty ones) of one block, and in the condition of an `if` with the
+// run before it; an assignment or definition of a variable ends the sharing of expressions reading it, and a
+// function call, which may assign globals, of all of them. All uses of a shared expression are thus in straight-line
+// code with no write to its operands in between, and code generators may compute it once and reuse the value.
+//
+// Assignment targets, array lengths and global initializers are left alone. The replaced nodes stay in the
+// ast_context of the tree until it is released. Recurses as deep as expressions nest.
+sharing_statistics share_expressions(assembly &root);
+}
+}
+
+#endif
@@ -0,0 +1,65 @@
+
+#ifndef _C1_FAST_LEXER_H_
+#define _C1_FAST_LEXER_H_
+
+#include <TokenSource.h>
+#include <CommonToken.h>
+#include <c1recognizer/error_reporter.h>
+
+namespace c1_recognizer
+{
+
+// Token of type IntConst or FloatConst, carrying the value decoded while scanning.
+class literal_token : public antlr4::CommonToken
+{
+  public:
+    using antlr4::CommonToken::CommonToken;
+
+    // False if the literal is out of range; consumers should decode the text to get the same error as C1Lexer's.
+    bool has_value;
+    int int_value;
+    double float_value;
+};
+
+// Hand-written lexer producing exactly the tokens C1Lexer produces, scanning UTF-8 bytes in place.
+// Whitespace and comment bodies are skipped with SSE2 (or AVX2 if enabled at compile time), keywords are recognized
+// with a perfect hash, and line/column/index are tracked in code points just as ANTLR's lexer does.
+// Input must outlive the lexer; it is not copied.
+class fast_lexer : public antlr4::TokenSource
+{
+  public:
+    fast_lexer(const char *_begin, const char *_end, error_reporter &_err);
+
+    // Numbers lines and columns from `_line`:`_column` rather than 1:0, for input cut out of a larger source.
+    void set_position(size_t _line, size_t _column);
+
+    virtual std::unique_ptr<antlr4::Token> nextToken() override;
+    virtual size_t getLine() const override;
+    virtual size_t getCharPositionInLine() override;
+    virtual antlr4::CharStream *getInputStream() override;
+    virtual std::string getSourceName() override;
+    virtual Ref<antlr4::TokenFactory<antlr4::CommonToken>> getTokenFactory() override;
+
+  private:
+    template <typename T>
+    std::unique_ptr<T> make_token(size_t type, const char *stop);
+    std::unique_ptr<antlr4::Token> make_literal(size_t type, const char *stop);
+
+    const char *match_line_comment(const char *p);
+    const char *match_block_comment(const char *p);
+    const char *match_float(const char *p);
+    void recognition_error(const char *stop);
+
+    // Moves `cur` forward to `to`, updating line, column and index for arbitrary UTF-8 content.
+    void advance(const char *to);
+
+    const char *cur;
+    const char *end;
+    size_t line;
+    size_t column;
+    size_t index;
+    error_reporter &err;
+};
+}
+
+#endif
@@ -0,0 +1,189 @@
+
+#ifndef _C1_FLAT_SYNTAX_TREE_H_
+#define _C1_FLAT_SYNTAX_TREE_H_
+
+#include <c1recognizer/syntax_tree.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+// Compact copy of a syntax tree, for passes that walk large trees many times. Nodes are 32-bit indices into arrays
+// holding one field of every node each (kind, operator, three operands, location); there are no virtual bases, no
+// vtables and no pointers. Nodes are numbered in pre-order, so that a subtree, and hence a whole function, takes the
+// contiguous range [node, get_end(node)) of each array, and a pass over all its nodes is a linear scan.
+//
+// Operands are child nodes, or `none` for missing optional ones; lists of children (global definitions, statements
+// of a block, initializers) are runs of indices in a shared array. Initializers packed into a literal_list become
+// literal nodes like any other.
+class flat_syntax_tree
+{
+  public:
+    using index = uint32_t;
+    static const index none = ~index(0);
+
+    enum class kind : uint8_t
+    {
+        func_def,
+        cond,
+        binop,
+        unaryop,
+        lval,
+        literal,
+        var_def,
+        assign,
+        func_call,
+        block,
+        if_stmt,
+        while_stmt,
+        empty_stmt
+    };
+
+    struct location
+    {
+        int line;
+        int pos;
+    };
+
+    // Children of a node, in order.
+    class list
+    {
+      public:
+        list(const index *_begin, const index *_end) : first(_begin), last(_end) {}
+        const index *begin() const { return first; }
+        const index *end() const { return last; }
+        size_t size() const { return last - first; }
+        index operator[](size_t i) const { return first[i]; }
+
+      private:
+        const index *first;
+        const index *last;
+    };
+
+    // Copies the tree of `root`. Trees of any depth are copied without recursing. Throws std::length_error if the
+    // tree has too many nodes for 32-bit indices.
+    explicit flat_syntax_tree(const assembly &root);
+
+    size_t size() const { return kinds.size(); }
+    const location &get_root_location() const { return root_location; }
+    list get_global_defs() const { return get_list(root_list); }
+
+    kind get_kind(index node) const { return kinds[node]; }
+    const location &get_location(index node) const { return locations[node]; }
+    // Index right after the subtree of `node`.
+    index get_end(index node) const { return ends[node]; }
+
+    // Operators of cond, binop and unaryop nodes.
+    relop get_relop(index node) const { return static_cast<relop>(ops[node]); }
+    binop get_binop(index node) const { return static_cast<binop>(ops[node]); }
+    unaryop get_unaryop(index node) const { return static_cast<unaryop>(ops[node]); }
+
+    // Operands of cond and binop nodes; unaryop nodes only have get_rhs().
+    index get_lhs(index node) const { return first[node]; }
+    index get_rhs(index node) const { return kinds[node] == kind::unaryop ? first[node] : second[node]; }
+
+    // Names of func_def, lval, var_def and func_call nodes.
+    symbol get_name(index node) const { return first[node]; }
+
+    // Of literal and var_def nodes.
+    bool is_int(index node) const { return (ops[node] & int_flag) != 0; }
+    // Of var_def nodes.
+    bool is_constant(index node) const { return (ops[node] & constant_flag) != 0; }
+    // Values of literal nodes.
+    int get_int(index node) const { return static_cast<int>(first[node]); }
+    double get_float(index node) const { return floats[first[node]]; }
+
+    index get_array_index(index node) const { return second[node]; }  // lval
+    index get_array_length(index node) const { return second[node]; } // var_def
+    list get_initializers(index node) const { return get_list(third[node]); }
+    index get_body(index node) const { return second[node]; }         // func_def and while_stmt
+    list get_statements(index node) const { return get_list(first[node]); } // block
+    index get_target(index node) const { return first[node]; }        // assign
+    index get_value(index node) const { return second[node]; }        // assign
+    index get_pred(index node) const { return first[node]; }          // if_stmt and while_stmt
+    index get_then(index node) const { return second[node]; }         // if_stmt
+    index get_else(index node) const { return third[node]; }          // if_stmt
+
+    // Calls the member of `pass` handling the kind of `node`, as accept() does for syntax_tree_visitor, but without
+    // virtual calls: pass.visit_func_def(node), pass.visit_cond(node), and so on.
+    template <typename Pass>
+    void dispatch(index node, Pass &pass) const;
+
+  private:
+    class builder;
+    // Writes the arrays as they are.
+    friend std::string write_ast_image(const assembly &root);
+
+    static const uint8_t int_flag = 1;
+    static const uint8_t constant_flag = 2;
+
+    // Lists are stored as their size, followed by their elements.
+    list get_list(index offset) const { return list(&lists[offset + 1], &lists[offset + 1] + lists[offset]); }
+
+    std::vector<kind> kinds;
+    std::vector<uint8_t> ops; // Operator, or flags
+    std::vector<index> first;
+    std::vector<index> second;
+    std::vector<index> third;
+    std::vector<location> locations;
+    std::vector<index> ends;
+
+    std::vector<index> lists;
+    std::vector<double> floats;
+    location root_location;
+    index root_list;
+};
+
+template <typename Pass>
+void flat_syntax_tree::dispatch(index node, Pass &pass) const
+{
+    switch (kinds[node])
+    {
+    case kind::func_def:
+        pass.visit_func_def(node);
+        break;
+    case kind::cond:
+        pass.visit_cond(node);
+        break;
+    case kind::binop:
+        pass.visit_binop(node);
+        break;
+    case kind::unaryop:
+        pass.visit_unaryop(node);
+        break;
+    case kind::lval:
+        pass.visit_lval(node);
+        break;
+    case kind::literal:
+        pass.visit_literal(node);
+        break;
+    case kind::var_def:
+        pass.visit_var_def(node);
+        break;
+    case kind::assign:
+        pass.visit_assign(node);
+        break;
+    case kind::func_call:
+        pass.visit_func_call(node);
+        break;
+    case kind::block:
+        pass.visit_block(node);
+        break;
+    case kind::if_stmt:
+        pass.visit_if(node);
+        break;
+    case kind::while_stmt:
+        pass.visit_while(node);
+        break;
+    case kind::empty_stmt:
+        pass.visit_empty(node);
+        break;
+    }
+}
+}
+}
+
+#endif
@@ -0,0 +1,73 @@
+
+#ifndef _C1_INCREMENTAL_RECOGNIZER_H_
+#define _C1_INCREMENTAL_RECOGNIZER_H_
+
+#include <c1recognizer/recognizer.h>
+#include <c1recognizer/syntax_tree.h>
+#include <c1recognizer/error_reporter.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace c1_recognizer
+{
+
+// Keeps the syntax tree of a source up to date while it is edited, as in an editor. top_level_scanner cuts the source
+// between top-level definitions into segments; an edit rescans from the segment it starts in until the cuts line up
+// with the old ones again, and only that text is recognized again. Its global definitions replace those of the old
+// segments, and the nodes after it are moved to their new lines and columns. Only these are touched, hence an edit
+// within one function costs about as much as recognizing that function, plus a pass over the nodes after it if the
+// edit adds or removes lines.
+//
+// The tree is updated in place, so it stays shared with earlier results of get_syntax_tree(). If the new text fails
+// to parse, the whole source is recognized instead, so that errors are reported just as a recognizer would; the tree
+// is then nullptr until an edit fixes the source.
+class incremental_recognizer
+{
+  public:
+    incremental_recognizer();
+
+    void set_lexer_engine(lexer_engine _engine);
+    void set_parser_engine(parser_engine _engine);
+
+    // Recognizes `_source` whole.
+    bool parse(const std::string &_source, error_reporter &_err);
+    // Replaces `removed` bytes at byte `offset` of the source by `inserted`, and updates the syntax tree. Throws
+    // std::out_of_range if the replaced bytes aren't in the source.
+    bool edit(size_t offset, size_t removed, const std::string &inserted, error_reporter &_err);
+
+    const std::string &get_source() const { return source; }
+    std::shared_ptr<syntax_tree::assembly> get_syntax_tree() const;
+
+  private:
+    // Text from a cut to the next, holding the global definitions from `first_def` to the next segment's.
+    struct segment
+    {
+        size_t offset;
+        size_t line;
+        size_t column;
+        size_t first_def;
+    };
+
+    bool parse_whole(error_reporter &_err);
+    // Sets `first_def` of segments [from, to), whose definitions are [first, last) of the tree.
+    void number_defs(size_t from, size_t to, size_t first, size_t last);
+
+    // Owns the tree: the root, and for each global definition recognized by an edit, the tree of the region it is in,
+    // which owns the ast_context it was made in (nullptr for those in the context of the root). A region's context is
+    // freed once none of its definitions is left.
+    struct tree_owner
+    {
+        std::shared_ptr<syntax_tree::assembly> root;
+        std::vector<std::shared_ptr<syntax_tree::syntax_tree_node>> def_owners;
+    };
+
+    std::string source;
+    std::shared_ptr<tree_owner> owner;
+    syntax_tree::assembly *ast;
+    std::vector<segment> segments; // Empty unless `ast` is up to date.
+    recognizer rcg;
+};
+}
+
+#endif
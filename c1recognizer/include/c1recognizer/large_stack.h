@@ -0,0 +1,55 @@
+
+#ifndef _C1_LARGE_STACK_H_
+#define _C1_LARGE_STACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+
+namespace c1_recognizer
+{
+
+// Parsers, and visitors walking the syntax tree, recurse once per level of nesting of blocks, statements and
+// expressions, so a source nested deeply enough overflows any fixed stack (100k nested blocks need some 40 MiB with
+// C1Parser). Such work is to be run on a thread whose stack grows with the source instead. Destroying a syntax tree
+// never recurses, so the tree may be released on any thread.
+
+// Stack size enough to recognize a source of `source_size` bytes however it nests, and to walk its syntax tree.
+// Only the part of the stack actually used is backed by memory. The size is capped at 1 GiB, which a source of a few
+// MiB nested all the way down may still exhaust; check_stack() then stops the work with stack_exhausted.
+size_t stack_size_for(size_t source_size);
+
+// Runs `task` on a new thread with a stack of `size` bytes, and waits for it. Exceptions thrown by `task` are
+// rethrown; std::system_error is thrown if the thread can't be started.
+void run_with_stack(size_t size, const std::function<void()> &task);
+
+// Thrown by check_stack() instead of letting a source nested too deeply overflow the stack.
+class stack_exhausted : public std::runtime_error
+{
+  public:
+    stack_exhausted();
+};
+
+// Lowest address the calling thread's stack may grow to before check_stack() throws; UINTPTR_MAX until the first call
+// on the thread looks its stack up. Constant-initialized in place, so reading it needs no TLS wrapper call.
+inline uintptr_t &stack_limit()
+{
+    static thread_local uintptr_t limit = UINTPTR_MAX;
+    return limit;
+}
+// Called by check_stack() past stack_limit(): looks up the limit of a thread calling it for the first time, then throws
+// stack_exhausted if the stack is really that deep.
+void check_stack_limit();
+
+// Throws stack_exhausted once the stack of the calling thread is nearly used up. Code recursing once per level of
+// nesting calls it on every level, so that it fails with an exception, and not a crash, well before the end.
+inline void check_stack()
+{
+    char here;
+    if (reinterpret_cast<uintptr_t>(&here) < stack_limit())
+        check_stack_limit();
+}
+}
+
+#endif
@@ -0,0 +1,58 @@
+
+#ifndef _C1_PARSER_SNAPSHOT_H_
+#define _C1_PARSER_SNAPSHOT_H_
+
+#include <memory>
+#include <string>
+
+namespace antlr4
+{
+class Parser;
+namespace atn
+{
+class ParserATNSimulator;
+}
+}
+
+namespace c1_recognizer
+{
+
+// C1Parser shares one prediction DFA and one prediction context cache among all its instances in a process. Both start
+// empty and are filled in while parsing, so short-lived processes spend most of their parse time warming them up.
+// A snapshot stores both in a binary file, to be written after parsing a training corpus and loaded at startup.
+//
+// All functions here take the runtime's DFA locks while they touch the process-wide DFA.
+
+// Writes the DFA and context cache built so far in this process to `path`. Returns false if the file can't be written.
+bool save_parser_snapshot(const std::string &path);
+
+// Adds what a snapshot written by save_parser_snapshot holds to the DFA, mapping the file into memory rather than
+// reading it. Returns false, leaving the parser untouched, if the file is unreadable or malformed, or was made for a
+// different C1Parser ATN.
+bool load_parser_snapshot(const std::string &path);
+
+// A private DFA and context cache for C1Parser, for one thread to predict with, so that it doesn't contend on the
+// process-wide DFA while it grows. See recognizer::set_dfa_shard.
+class parser_dfa_shard
+{
+  public:
+    parser_dfa_shard();
+    ~parser_dfa_shard();
+
+    // Adds everything the process-wide DFA holds to this shard.
+    void pull();
+    // Adds everything this shard holds to the process-wide DFA.
+    void push();
+
+  private:
+    friend class recognizer;
+
+    // A new simulator for C1Parser `parser`, predicting with this shard.
+    antlr4::atn::ParserATNSimulator *make_simulator(antlr4::Parser &parser);
+
+    struct tables; // The DFA of each decision, and the context cache
+    std::unique_ptr<tables> data;
+};
+}
+
+#endif
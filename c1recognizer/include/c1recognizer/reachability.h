@@ -0,0 +1,31 @@
+
+#ifndef _C1_REACHABILITY_H_
+#define _C1_REACHABILITY_H_
+
+#include <c1recognizer/semantic_analysis.h>
+#include <c1recognizer/syntax_tree.h>
+#include <cstddef>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+struct reachability_statistics
+{
+    size_t functions = 0;           // Functions in semantic_info, predeclared ones included
+    size_t reachable_functions = 0;
+    size_t globals = 0;             // Global variables, predeclared ones included
+    size_t reachable_globals = 0;
+};
+
+// Marks as reachable in `info` the functions that the function named `entry` calls, directly or not, and the global
+// variables they read or assign, and all others as not, so that code generators can leave them out. The tree must have
+// been analyzed into `info` without errors. Reads replaced with constants don't make a variable reachable, and
+// neither do global initializers, which are constant. If there is no function named `entry`, all are reachable.
+//
+// Function bodies are walked once each, recursing as deep as their statements nest.
+reachability_statistics find_reachable(semantic_info &info, symbol entry);
+}
+}
+
+#endif
@@ -4,23 +4,68 @@
 
 #include <c1recognizer/syntax_tree.h>
 #include <c1recognizer/error_reporter.h>
+#include <memory>
 #include <string>
 #include <iostream>
 
-namespace antlr4
+namespace c1_recognizer
 {
-class ANTLRInputStream;
-}
 
-namespace c1_recognizer
+class parser_dfa_shard;
+
+// Engines that are able to split the source into C1Lexer's tokens.
+enum class lexer_engine
 {
+    antlr, // C1Lexer, running the ATN over the decoded code points.
+    fast   // fast_lexer, scanning UTF-8 bytes directly.
+};
+
+// Engines that are able to turn tokens from C1Lexer into a syntax tree.
+enum class parser_engine
+{
+    antlr,            // C1Parser without a parse tree, syntax_tree_listener building the syntax tree from its events.
+    recursive_descent // recursive_descent_parser builds the syntax tree directly in one pass.
+};
 
 class recognizer
 {
   public:
     recognizer() = delete;
     recognizer(const std::string &input_string);
+    // The stream is read by execute(), and must live until then.
     recognizer(std::istream &input_stream);
+    // A recognizer of the file at `path`, which it maps into memory and lexes in place, falling back to reading it if
+    // it can't be mapped (e.g. a pipe). execute() fails with an error if the file can't be read at all.
+    static std::unique_ptr<recognizer> from_file(const std::string &path);
+
+    // Replaces the source to parse. Lexer and parser objects built by earlier executions are reused.
+    // Positions are numbered from `line`:`column`, for sources cut out of a larger one.
+    void reset(const std::string &input_string, size_t line = 1, size_t column = 0);
+
+    void set_lexer_engine(lexer_engine _engine);
+    void set_parser_engine(parser_engine _engine);
+
+    // With the antlr parser engine, parse with SLL prediction and bail out on the first syntax error, re-parsing with
+    // full LL and error reporting only then. Results are the same; valid inputs skip full-context prediction.
+    void set_two_stage_parsing(bool enabled);
+
+    // With an input stream, lex and parse while reading it, so that only a bounded window of the input is held in
+    // memory. With the recursive descent parser engine, only a bounded window of tokens is held too; the antlr parser
+    // engine keeps every token, as its rule contexts refer to them. The lexer engine is always antlr, since fast_lexer
+    // scans the whole input at once.
+    void set_streaming(bool enabled);
+
+    // With the antlr parser engine, predict with `shard` instead of the process-wide DFA; nullptr switches back.
+    // The shard must outlive the executions using it.
+    void set_dfa_shard(parser_dfa_shard *shard);
+
+    // Process-wide counts of two-stage parses, to tell how often the SLL pass suffices.
+    struct two_stage_counters
+    {
+        size_t sll_parses;   // Parses started with the SLL pass.
+        size_t ll_fallbacks; // Of those, parses the SLL pass bailed out of.
+    };
+    static two_stage_counters get_two_stage_counters();
 
     bool execute(error_reporter &_err);
     std::shared_ptr<syntax_tree::syntax_tree_node> get_syntax_tree();
@@ -28,9 +73,26 @@ class recognizer
     ~recognizer();
 
   private:
+    struct pipeline;
+    struct mapped_file;
+
+    bool execute_streaming(error_reporter &_err);
+
     std::shared_ptr<syntax_tree::syntax_tree_node> ast;
-    antlr4::ANTLRInputStream *input;
+    // The input is one of `source`, `mapped` (text of `path`) and `stream`, which is read into `source` unless
+    // streaming.
     std::string source;
+    std::unique_ptr<mapped_file> mapped;
+    std::string path;
+    std::istream *stream;
+    bool streaming;
+    size_t start_line;
+    size_t start_column;
+    lexer_engine lexer;
+    parser_engine engine;
+    bool two_stage;
+    parser_dfa_shard *shard;
+    std::unique_ptr<pipeline> objects;
 };
 }
 
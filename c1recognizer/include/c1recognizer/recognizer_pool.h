@@ -0,0 +1,82 @@
+
+#ifndef _C1_RECOGNIZER_POOL_H_
+#define _C1_RECOGNIZER_POOL_H_
+
+#include <c1recognizer/recognizer.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace c1_recognizer
+{
+
+struct parse_result
+{
+    std::shared_ptr<syntax_tree::syntax_tree_node> ast; // nullptr if the source has errors.
+    std::string errors;                                 // Everything reported while recognizing the source.
+};
+
+// Recognizes batches of sources on a fixed set of worker threads. Each worker keeps its own recognizer, so lexer and
+// parser objects are built once per thread rather than once per source.
+//
+// With the antlr parser engine, all C1Parser instances predict with one process-wide DFA by default. Every new DFA
+// state is added under a lock shared with all other threads; with per-thread DFAs, each worker predicts with its own
+// parser_dfa_shard instead. A shard is seeded from the process-wide DFA before its first batch, and added back to it
+// when the pool is destroyed.
+class recognizer_pool
+{
+  public:
+    recognizer_pool(size_t threads);
+    ~recognizer_pool();
+
+    // These apply from the next batch on.
+    void set_lexer_engine(lexer_engine _engine);
+    void set_parser_engine(parser_engine _engine);
+    void set_two_stage_parsing(bool enabled);
+    void set_per_thread_dfa(bool enabled);
+
+    // Recognizes all of `sources`, returning the results in the same order. Must not be called concurrently.
+    std::vector<parse_result> parse_all(const std::vector<std::string> &sources);
+
+    // Recognizes one large source on all workers. top_level_scanner cuts it between top-level definitions into a few
+    // parts per worker, which are recognized as separate sources with positions numbered as in the whole, and their
+    // global definitions are joined in order. If any part fails, the source is
+    // recognized whole instead, so errors are reported just as parse_all would. Must not be called concurrently.
+    parse_result parse_split(const std::string &source);
+
+  private:
+    struct worker;
+
+    // Line and column the source of a job starts at.
+    using position = std::pair<size_t, size_t>;
+
+    std::vector<parse_result> run_batch(const std::vector<std::string> &_sources, const std::vector<position> *_starts);
+    void run(worker &self);
+
+    std::vector<std::unique_ptr<worker>> workers;
+    std::vector<std::thread> threads;
+
+    lexer_engine lexer;
+    parser_engine engine;
+    bool two_stage;
+    bool per_thread_dfa;
+
+    // State of the current batch, guarded by `lock` except for the job counter.
+    std::mutex lock;
+    std::condition_variable batch_started;
+    std::condition_variable batch_finished;
+    size_t batch;
+    size_t running;
+    bool stopping;
+    const std::vector<std::string> *sources;
+    const std::vector<position> *starts; // nullptr if all sources start at 1:0.
+    std::vector<parse_result> *results;
+    std::atomic<size_t> next_job;
+};
+}
+
+#endif
@@ -0,0 +1,69 @@
+
+#ifndef _C1_RECURSIVE_DESCENT_PARSER_H_
+#define _C1_RECURSIVE_DESCENT_PARSER_H_
+
+#include <c1recognizer/syntax_tree.h>
+#include <c1recognizer/error_reporter.h>
+#include <memory>
+
+namespace antlr4
+{
+class Token;
+class TokenStream;
+}
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+// Hand-written parser for C1, building syntax tree directly from the token stream in one pass.
+// Statements are parsed by recursive descent with at most two tokens of lookahead; expressions are parsed by
+// precedence climbing. The resulting tree is identical to what syntax_tree_builder builds from C1Parser's parse tree.
+// Tokens are only used until the next one after them is consumed, so the parser can run over sliding_token_stream.
+class recursive_descent_parser
+{
+  public:
+    recursive_descent_parser(antlr4::TokenStream &_tokens, error_reporter &_err);
+
+    // Parses a whole `compilationUnit` into a new ast_context. Returns nullptr if any syntax error is found.
+    std::shared_ptr<syntax_tree_node> operator()();
+
+    int get_errors_count();
+
+  private:
+    // Expression along with the first token it is parsed from, which is where the enclosing binop locates.
+    struct expr_result
+    {
+        ptr<expr_syntax> node;
+        int line;
+        int pos;
+    };
+
+    void compilation_unit(assembly &result);
+    void decl(ptr_list<var_def_stmt_syntax> &result);
+    ptr<var_def_stmt_syntax> constdef();
+    ptr<var_def_stmt_syntax> vardef();
+    void array_initializers(var_def_stmt_syntax &result);
+    ptr<func_def_syntax> funcdef();
+    ptr<block_syntax> block();
+    ptr<stmt_syntax> stmt();
+    ptr<lval_syntax> lval();
+    ptr<cond_syntax> cond();
+    expr_result exp(int precedence);
+    ptr<literal_syntax> number();
+    // Decodes and consumes the number token ahead, without making a node of it.
+    literal_syntax decode_number();
+
+    bool starts_exp(size_t type);
+    antlr4::Token *match(size_t type);
+    [[noreturn]] void syntax_error(const std::string &expecting);
+
+    antlr4::TokenStream &tokens;
+    error_reporter &err;
+    int count;
+    ast_context *context; // Of the tree being built
+};
+}
+}
+
+#endif
@@ -0,0 +1,69 @@
+
+#ifndef _C1_SEMANTIC_ANALYSIS_H_
+#define _C1_SEMANTIC_ANALYSIS_H_
+
+#include <c1recognizer/error_reporter.h>
+#include <c1recognizer/syntax_tree.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+struct variable_info
+{
+    symbol name;
+    value_type type; // Of the elements, for arrays
+    bool is_constant;
+    bool is_array;
+    bool is_global;
+    int32_t array_length; // Of arrays defined in the tree, 0 otherwise
+    // Whether the variable is a constant scalar of known value, which reads of it are replaced with.
+    bool has_value;
+    double value;
+    ptr<var_def_stmt_syntax> definition; // nullptr for predeclared variables
+    bool reachable = true;               // See find_reachable() (reachability.h)
+};
+
+struct function_info
+{
+    symbol name;
+    ptr<func_def_syntax> definition; // nullptr for predeclared functions
+    bool reachable = true;
+};
+
+// Variables and functions of a program, indexed by the slots analyze_semantics() sets in its nodes. Those defined
+// outside of the tree, by a runtime, are predeclared before analysis, and take the first slots.
+struct semantic_info
+{
+    std::vector<variable_info> variables;
+    std::vector<function_info> functions;
+    size_t conversions = 0; // Implicit conversions between int and float
+
+    int32_t predeclare_variable(symbol name, value_type type, bool is_constant, bool is_array);
+    int32_t predeclare_function(symbol name);
+};
+
+// Checks the semantics of `root` and annotates it for code generators, which then need no knowledge of types or
+// scopes:
+//   - each lval_syntax, var_def_stmt_syntax, func_def_syntax and func_call_stmt_syntax gets the slot in `info` of the
+//     variable or function it refers to or defines;
+//   - each expression gets its type, and is marked constant with its value if made of literals and of reads of
+//     constants with constant initializers: scalars, and elements of arrays at constant indices. Such reads are
+//     replaced with the value, and constant scalars read only so need no storage;
+//   - a cond_syntax gets the type its operands are compared as.
+// Implicit conversions are left to the code generator, which finds them where the type of an expression differs from
+// the one it is used as: the type of the binop_expr_syntax or cond_syntax using it, or of the variable it is stored to.
+//
+// Errors are reported to `err`, and analysis goes on past them to report as many as it can. Returns false if there
+// were any, and then the annotations are incomplete. Global initializers and array lengths must be constant.
+//
+// Works on trees made a DAG by share_expressions() too. Chains of binary operators nest without recursion, other
+// expressions recurse as deep as they nest. Trees may be analyzed on several threads at once.
+bool analyze_semantics(assembly &root, semantic_info &info, error_reporter &err);
+}
+}
+
+#endif
@@ -0,0 +1,52 @@
+
+#ifndef _C1_SLIDING_TOKEN_STREAM_H_
+#define _C1_SLIDING_TOKEN_STREAM_H_
+
+#include <Token.h>
+#include <TokenSource.h>
+#include <TokenStream.h>
+#include <deque>
+#include <memory>
+
+namespace c1_recognizer
+{
+
+// Token stream holding only the tokens since the oldest mark, plus the last consumed one, so that memory stays
+// bounded however long the input is. A token is deleted once the stream moves two tokens past it without a mark;
+// parsers over this stream must copy what they need from a token before then, which recursive_descent_parser does.
+// Like CommonTokenStream, only tokens on the default channel are kept.
+class sliding_token_stream : public antlr4::TokenStream
+{
+  public:
+    sliding_token_stream(antlr4::TokenSource *_source);
+
+    virtual antlr4::Token *LT(ssize_t k) override;
+    virtual antlr4::Token *get(size_t index) const override;
+    virtual antlr4::TokenSource *getTokenSource() const override;
+    virtual std::string getText(const antlr4::misc::Interval &interval) override;
+    virtual std::string getText() override;
+    virtual std::string getText(antlr4::RuleContext *ctx) override;
+    virtual std::string getText(antlr4::Token *start, antlr4::Token *stop) override;
+
+    virtual void consume() override;
+    virtual size_t LA(ssize_t i) override;
+    virtual ssize_t mark() override;
+    virtual void release(ssize_t marker) override;
+    virtual size_t index() override;
+    virtual void seek(size_t index) override;
+    virtual size_t size() override;
+    virtual std::string getSourceName() const override;
+
+  private:
+    // Fetches tokens until the one at `index` is buffered. Returns false if the input ends before it.
+    bool available(size_t index);
+
+    antlr4::TokenSource *source;
+    std::deque<std::unique_ptr<antlr4::Token>> window;
+    size_t start;   // Index of window.front().
+    size_t p;       // Index of the current token.
+    size_t markers; // Marks not released yet; the window only slides without any.
+};
+}
+
+#endif
@@ -0,0 +1,73 @@
+
+#ifndef _C1_STATIC_VISITOR_H_
+#define _C1_STATIC_VISITOR_H_
+
+#include <c1recognizer/syntax_tree.h>
+#include <c1recognizer/large_stack.h>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+// Base of passes dispatching on the node_kind of expressions, statements and global definitions instead of calling
+// accept(). A pass derives from static_visitor<pass>, defines visit() for all the concrete nodes of the bases it
+// dispatches on, and calls dispatch() on children known only by their base. Each visit() may return what it
+// computes, the same type for all nodes of a base; calls are resolved at compile time, so they may be inlined.
+// syntax_tree_visitor still works on the same trees. Dispatching on an expression or a statement checks the stack,
+// as passes recurse through it.
+template <typename Derived>
+class static_visitor
+{
+  public:
+    decltype(auto) dispatch(expr_syntax &node)
+    {
+        check_stack();
+        switch (node.kind)
+        {
+        case node_kind::binop:
+            return derived().visit(static_cast<binop_expr_syntax &>(node));
+        case node_kind::unaryop:
+            return derived().visit(static_cast<unaryop_expr_syntax &>(node));
+        case node_kind::lval:
+            return derived().visit(static_cast<lval_syntax &>(node));
+        default:
+            return derived().visit(static_cast<literal_syntax &>(node));
+        }
+    }
+
+    decltype(auto) dispatch(stmt_syntax &node)
+    {
+        check_stack();
+        switch (node.kind)
+        {
+        case node_kind::var_def:
+            return derived().visit(static_cast<var_def_stmt_syntax &>(node));
+        case node_kind::assign:
+            return derived().visit(static_cast<assign_stmt_syntax &>(node));
+        case node_kind::func_call:
+            return derived().visit(static_cast<func_call_stmt_syntax &>(node));
+        case node_kind::block:
+            return derived().visit(static_cast<block_syntax &>(node));
+        case node_kind::if_stmt:
+            return derived().visit(static_cast<if_stmt_syntax &>(node));
+        case node_kind::while_stmt:
+            return derived().visit(static_cast<while_stmt_syntax &>(node));
+        default:
+            return derived().visit(static_cast<empty_stmt_syntax &>(node));
+        }
+    }
+
+    decltype(auto) dispatch(global_def_syntax &node)
+    {
+        if (node.kind == node_kind::var_def)
+            return derived().visit(static_cast<var_def_stmt_syntax &>(node));
+        return derived().visit(static_cast<func_def_syntax &>(node));
+    }
+
+  private:
+    Derived &derived() { return static_cast<Derived &>(*this); }
+};
+}
+}
+
+#endif
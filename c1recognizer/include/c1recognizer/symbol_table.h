@@ -0,0 +1,30 @@
+
+#ifndef _C1_SYMBOL_TABLE_H_
+#define _C1_SYMBOL_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+// Identifiers are interned in one table for the whole process, and syntax tree nodes carry their 32-bit index instead
+// of a copy of the spelling. The same identifier has the same symbol in every tree, however and on whatever thread
+// it was recognized, so trees built in parts (split or incrementally reparsed sources) need no renumbering, and passes
+// compare and hash names as integers. Spellings are never freed.
+using symbol = uint32_t;
+
+// Symbol of `spelling`, adding it to the table the first time. Safe to call from any thread; only adding an
+// identifier takes a lock.
+symbol intern(const std::string &spelling);
+// Spelling of a symbol returned by intern(), read without a lock. The reference stays valid for the life of the
+// process.
+const std::string &spelling(symbol name);
+// Number of distinct identifiers interned so far.
+size_t symbols_count();
+}
+}
+
+#endif
@@ -2,6 +2,9 @@
 #ifndef _C1_SYNTAX_TREE_H_
 #define _C1_SYNTAX_TREE_H_
 
+#include <c1recognizer/ast_context.h>
+#include <c1recognizer/symbol_table.h>
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <string>
@@ -10,9 +13,9 @@ namespace c1_recognizer
 {
 namespace syntax_tree
 {
-// Use unique postd::stringtype to reference stored objects
+// Nodes refer to each other by plain pointers; they are owned by the ast_context they were made in.
 template <typename T>
-using ptr = std::shared_ptr<T>;
+using ptr = T *;
 
 // List of reference of type
 template <typename T>
@@ -44,6 +47,33 @@ enum class unaryop
     minus
 };
 
+// Static type of an expression or a variable, as semantic analysis (semantic_analysis.h) finds it.
+enum class value_type : uint8_t
+{
+    unknown = 0, // Not analyzed, or ill-typed
+    int_type,
+    float_type
+};
+
+// Kind of a concrete expression, statement or global definition, kept in the node for static_visitor to dispatch on
+// without virtual calls. Nodes set it in their constructors, so members a builder may leave unset are initialized
+// where they are declared.
+enum class node_kind : uint8_t
+{
+    func_def,
+    binop,
+    unaryop,
+    lval,
+    literal,
+    var_def,
+    assign,
+    func_call,
+    block,
+    if_stmt,
+    while_stmt,
+    empty_stmt
+};
+
 // Forward declaration
 struct syntax_tree_node;
 struct assembly;
@@ -68,10 +98,11 @@ struct while_stmt_syntax;
 struct syntax_tree_visitor;
 
 // Virtual base of all kinds of syntax tree nodes.
+// Nodes don't own their children, so destroying a tree never recurses however deep it is nested.
 struct syntax_tree_node
 {
-    int line;
-    int pos;
+    int line = 0;
+    int pos = 0;
     // Used in syntax_tree_visitor. Irrelevant to syntax tree generation.
     virtual void accept(syntax_tree_visitor &visitor) = 0;
 };
@@ -86,14 +117,18 @@ struct assembly : syntax_tree_node
 // Virtual base of lobal definitions, function or variable one.
 struct global_def_syntax : virtual syntax_tree_node
 {
+    node_kind kind;
+    global_def_syntax(node_kind _kind) : kind(_kind) {}
     virtual void accept(syntax_tree_visitor &visitor) override = 0;
 };
 
 // Function definition.
 struct func_def_syntax : global_def_syntax
 {
-    std::string name;
+    func_def_syntax() : global_def_syntax(node_kind::func_def) {}
+    symbol name;
     ptr<block_syntax> body;
+    int32_t slot = -1; // Set by semantic analysis
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
 
@@ -102,18 +137,26 @@ struct cond_syntax : syntax_tree_node
 {
     relop op;
     ptr<expr_syntax> lhs, rhs;
+    value_type operand_type = value_type::unknown; // Both operands are converted to it; set by semantic analysis
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
 
 // Virtual base of expressions.
 struct expr_syntax : virtual syntax_tree_node
 {
+    node_kind kind;
+    // Set by semantic analysis. A constant expression has its value in `constant`, which holds any int exactly.
+    value_type type = value_type::unknown;
+    bool is_constant = false;
+    double constant = 0;
+    expr_syntax(node_kind _kind) : kind(_kind) {}
     virtual void accept(syntax_tree_visitor &visitor) = 0;
 };
 
 // Expression like `lhs op rhs`.
 struct binop_expr_syntax : expr_syntax
 {
+    binop_expr_syntax() : expr_syntax(node_kind::binop) {}
     binop op;
     ptr<expr_syntax> lhs, rhs;
     virtual void accept(syntax_tree_visitor &visitor) override final;
@@ -122,6 +165,7 @@ struct binop_expr_syntax : expr_syntax
 // Expression like `op rhs`.
 struct unaryop_expr_syntax : expr_syntax
 {
+    unaryop_expr_syntax() : expr_syntax(node_kind::unaryop) {}
     unaryop op;
     ptr<expr_syntax> rhs;
     virtual void accept(syntax_tree_visitor &visitor) override final;
@@ -130,23 +174,54 @@ struct unaryop_expr_syntax : expr_syntax
 // Expression like `ident` or `ident[exp]`.
 struct lval_syntax : expr_syntax
 {
-    std::string name;
-    ptr<expr_syntax> array_index; // nullptr if not indexed as array
+    lval_syntax() : expr_syntax(node_kind::lval) {}
+    symbol name;
+    ptr<expr_syntax> array_index = nullptr; // nullptr if not indexed as array
+    int32_t slot = -1;                      // Variable the name refers to; set by semantic analysis
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
 
 // Expression constructed by a literal number.
 struct literal_syntax : expr_syntax
 {
+    literal_syntax() : expr_syntax(node_kind::literal) {}
     bool is_int;
     int intConst;
     double floatConst;
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
 
+// Literals of an initializer list, stored packed rather than as literal_syntax nodes: a table of constants would
+// otherwise take a node, a control block and a pointer per element. All are ints, or all are floats.
+struct literal_list
+{
+    struct position
+    {
+        int line;
+        int pos;
+    };
+
+    bool is_int = true;
+    std::vector<int32_t> ints;      // Values if is_int
+    std::vector<double> floats;     // Values if !is_int
+    std::vector<position> positions;
+
+    size_t size() const { return positions.size(); }
+    bool empty() const { return positions.empty(); }
+    // Appends `literal`, unless the list holds literals of the other kind.
+    bool add(const literal_syntax &literal);
+    // Literal at `i`, as a node would hold it.
+    literal_syntax at(size_t i) const;
+    // Appends nodes made in `context` for all the literals to `nodes`, and empties the list.
+    void unpack(ast_context &context, ptr_list<expr_syntax> &nodes);
+    void clear();
+};
+
 // Virtual base for statements.
 struct stmt_syntax : virtual syntax_tree_node
 {
+    node_kind kind;
+    stmt_syntax(node_kind _kind) : kind(_kind) {}
     virtual void accept(syntax_tree_visitor &visitor) = 0;
 };
 
@@ -154,17 +229,27 @@ struct stmt_syntax : virtual syntax_tree_node
 // represents a single variable definition.
 struct var_def_stmt_syntax : stmt_syntax, global_def_syntax
 {
+    var_def_stmt_syntax() : stmt_syntax(node_kind::var_def), global_def_syntax(node_kind::var_def) {}
     bool is_constant;
     bool is_int;
-    std::string name;
-    ptr<expr_syntax> array_length; // nullptr for non-array variables
+    symbol name;
+    ptr<expr_syntax> array_length = nullptr; // nullptr for non-array variables
     ptr_list<expr_syntax> initializers;
+    // Initializers of an array instead of `initializers` when all are literals of one kind.
+    literal_list literal_initializers;
+    int32_t slot = -1; // Set by semantic analysis
+    size_t initializers_count() const { return initializers.size() + literal_initializers.size(); }
+    // Appends an array initializer, packing it while all are literals of one kind; the tree is in `context`.
+    void add_initializer(ast_context &context, ptr<expr_syntax> init);
+    // Same for a literal not made a node yet; one is made in `context` only if the list can no longer be packed.
+    void add_initializer(ast_context &context, const literal_syntax &literal);
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
 
 // Assignment statement.
 struct assign_stmt_syntax : stmt_syntax
 {
+    assign_stmt_syntax() : stmt_syntax(node_kind::assign) {}
     ptr<lval_syntax> target;
     ptr<expr_syntax> value;
     virtual void accept(syntax_tree_visitor &visitor) override final;
@@ -173,13 +258,16 @@ struct assign_stmt_syntax : stmt_syntax
 // Function call statement.
 struct func_call_stmt_syntax : stmt_syntax
 {
-    std::string name;
+    func_call_stmt_syntax() : stmt_syntax(node_kind::func_call) {}
+    symbol name;
+    int32_t slot = -1; // Function called; set by semantic analysis
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
 
 // Block statement.
 struct block_syntax : stmt_syntax
 {
+    block_syntax() : stmt_syntax(node_kind::block) {}
     ptr_list<stmt_syntax> body;
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
@@ -187,15 +275,17 @@ struct block_syntax : stmt_syntax
 // If statement.
 struct if_stmt_syntax : stmt_syntax
 {
+    if_stmt_syntax() : stmt_syntax(node_kind::if_stmt) {}
     ptr<cond_syntax> pred;
     ptr<stmt_syntax> then_body;
-    ptr<stmt_syntax> else_body;
+    ptr<stmt_syntax> else_body = nullptr;
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
 
 // While statement.
 struct while_stmt_syntax : stmt_syntax
 {
+    while_stmt_syntax() : stmt_syntax(node_kind::while_stmt) {}
     ptr<cond_syntax> pred;
     ptr<stmt_syntax> body;
     virtual void accept(syntax_tree_visitor &visitor) override final;
@@ -204,6 +294,7 @@ struct while_stmt_syntax : stmt_syntax
 // Empty statement (aka a single ';').
 struct empty_stmt_syntax : stmt_syntax
 {
+    empty_stmt_syntax() : stmt_syntax(node_kind::empty_stmt) {}
     virtual void accept(syntax_tree_visitor &visitor) override final;
 };
 
@@ -5,6 +5,7 @@
 #include "c1recognizer/syntax_tree.h"
 #include "C1ParserBaseVisitor.h"
 #include <c1recognizer/error_reporter.h>
+#include <memory>
 
 namespace c1_recognizer
 {
@@ -29,10 +30,12 @@ class syntax_tree_builder : public C1ParserBaseVisitor
     virtual antlrcpp::Any visitExp(C1Parser::ExpContext *ctx) override;
     virtual antlrcpp::Any visitNumber(C1Parser::NumberContext *ctx) override;
 
-    ptr<syntax_tree_node> operator()(antlr4::tree::ParseTree *ctx);
+    // Builds the syntax tree of `ctx` into a new ast_context.
+    std::shared_ptr<syntax_tree_node> operator()(antlr4::tree::ParseTree *ctx);
 
   private:
     error_reporter &err;
+    std::shared_ptr<ast_context> context; // Of the tree being built
 };
 }
 }
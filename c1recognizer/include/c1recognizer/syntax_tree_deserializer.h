@@ -0,0 +1,39 @@
+
+#ifndef _C1_SYNTAX_TREE_DESERIALIZER_H_
+#define _C1_SYNTAX_TREE_DESERIALIZER_H_
+
+#include <c1recognizer/syntax_tree.h>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+// Rebuilds syntax trees from the JSON that c1r_test writes (test/syntax_tree_serializer.hpp). The JSON is parsed as a
+// stream of SAX events, with no document built, and neither parsing nor building recurses, so the input may be larger
+// than memory would hold as a document and nest as deep as a tree can. Keys of an object may come in any order. Keys
+// the serializer doesn't write are errors, while missing `line` and `pos` keys default to 0.
+//
+// Array initializers that are all literals of one kind are packed into their var_def, like the recognizer does.
+class syntax_tree_deserializer
+{
+  public:
+    // Tree described by the JSON read from `in`, made in a new ast_context, or nullptr if the input isn't a syntax
+    // tree in JSON; see get_error().
+    std::shared_ptr<assembly> deserialize(std::istream &in);
+    // The same for JSON in [json, json + size).
+    std::shared_ptr<assembly> deserialize(const char *json, size_t size);
+
+    // Why the last deserialize() failed, with the offset in bytes where it was noticed.
+    const std::string &get_error() const { return error; }
+
+  private:
+    std::string error;
+};
+}
+}
+
+#endif
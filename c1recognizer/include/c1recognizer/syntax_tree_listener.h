@@ -0,0 +1,98 @@
+
+#ifndef _C1_SYNTAX_TREE_LISTENER_H_
+#define _C1_SYNTAX_TREE_LISTENER_H_
+
+#include <c1recognizer/syntax_tree.h>
+#include <Token.h>
+#include <tree/ParseTreeListener.h>
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace c1_recognizer
+{
+namespace syntax_tree
+{
+// Parse listener building the syntax tree while C1Parser runs, so that the parser needn't build a parse tree
+// (setBuildParseTree(false)). Rule contexts then only hold their terminals, hence subtrees are kept on typed stacks
+// instead: each rule pushes its node when it exits, and its parent pops it. Rules are told apart by their index, and
+// tokens by their type, without RTTI. The tree is identical to what syntax_tree_builder builds from the parse tree.
+//
+// The tree is only complete if the parse succeeded; after a syntax error get_syntax_tree() may return anything.
+// The parser exits rules from destructors, so exceptions while building (an out-of-range literal, just as with
+// syntax_tree_builder) are kept and rethrown by get_syntax_tree().
+class syntax_tree_listener : public antlr4::tree::ParseTreeListener
+{
+  public:
+    syntax_tree_listener();
+
+    virtual void visitTerminal(antlr4::tree::TerminalNode *node) override;
+    virtual void visitErrorNode(antlr4::tree::ErrorNode *node) override;
+    virtual void enterEveryRule(antlr4::ParserRuleContext *ctx) override;
+    virtual void exitEveryRule(antlr4::ParserRuleContext *ctx) override;
+
+    // Result of the last compilationUnit parsed, owning the ast_context it was built in.
+    std::shared_ptr<assembly> get_syntax_tree();
+
+  private:
+    // Sizes of the stacks when a rule was entered; what is above them belongs to the rule.
+    struct frame
+    {
+        size_t rule;
+        size_t tokens;
+        size_t exprs;
+        size_t lvals;
+        size_t stmts;
+        size_t defs;
+    };
+
+    void exit_compilation_unit(const frame &f, antlr4::Token *start);
+    void exit_decl(const frame &f);
+    void exit_type_decl(const frame &f);
+    void exit_var_def(const frame &f, antlr4::Token *start, bool is_constant);
+    void exit_funcdef(const frame &f, antlr4::Token *start);
+    void exit_block(const frame &f, antlr4::Token *start);
+    void exit_stmt(const frame &f, antlr4::Token *start);
+    void exit_lval(const frame &f, antlr4::Token *start);
+    void exit_cond(const frame &f, antlr4::Token *start);
+    void exit_exp(const frame &f, antlr4::Token *start);
+    void exit_number(const frame &f);
+    // Packs the initializer the terminal just visited ends, while all of the list are literals of one kind.
+    void pack_initializer(const frame &f);
+    // Makes the node of the pending literal, once anything but packing is to be done with it.
+    void make_pending_literal();
+
+    // Terminal of the rule at `f` of type `type`, or nullptr.
+    antlr4::Token *find_token(const frame &f, size_t type);
+    // Number of terminals of the rule at `f` of type `type`.
+    size_t count_tokens(const frame &f, size_t type);
+
+    // Pops the top of `stack`, or returns nullptr if it has nothing above `base`; only a syntax error does that.
+    template <typename T>
+    static ptr<T> pop(std::vector<ptr<T>> &stack, size_t base = 0);
+
+    std::vector<frame> frames;
+    std::vector<antlr4::Token *> tokens;
+    std::vector<ptr<expr_syntax>> exprs;
+    std::vector<ptr<lval_syntax>> lvals;
+    std::vector<ptr<cond_syntax>> conds;
+    std::vector<ptr<stmt_syntax>> stmts;
+    std::vector<ptr<block_syntax>> blocks;
+    std::vector<ptr<var_def_stmt_syntax>> defs;
+    std::vector<ptr<global_def_syntax>> globals;
+    // Initializers of the variable definition being parsed, while they can be packed; see literal_list.
+    literal_list packed;
+    bool packing;
+    // Number exit_number decoded while packing, held here rather than in a node until it is known to be a lone
+    // initializer; exprs has a nullptr at `pending_index` in its place.
+    literal_syntax pending_literal;
+    bool has_pending_literal;
+    size_t pending_index;
+    std::shared_ptr<ast_context> context; // Of the compilationUnit being parsed
+    ptr<assembly> result;
+    std::exception_ptr error;
+};
+}
+}
+
+#endif
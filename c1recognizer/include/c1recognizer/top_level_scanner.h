@@ -0,0 +1,50 @@
+
+#ifndef _C1_TOP_LEVEL_SCANNER_H_
+#define _C1_TOP_LEVEL_SCANNER_H_
+
+#include <cstddef>
+
+namespace c1_recognizer
+{
+
+// Finds where top-level definitions end without lexing, so that a source can be cut into parts recognized on their
+// own. A declaration ends with a ';' at brace depth 0, and a function definition with the '}' closing a body opened
+// right after ')'; braces of array initializers end nothing. Comments are skipped the way C1Lexer skips them, so that
+// braces in them don't count. A cut is only reported once code follows it, as a compilation unit can't be empty.
+//
+// The scan only looks at braces, so a source with syntax errors may be cut anywhere; the parts then fail to parse.
+class top_level_scanner
+{
+  public:
+    struct cut
+    {
+        size_t offset; // Bytes from the start of the scanned text to where the next definition's text starts.
+        size_t line;
+        size_t column; // In code points, as C1Lexer numbers columns.
+    };
+
+    // Scans [_begin, _end), which must start at a cut (or at the start of a source) at `_line`:`_column`.
+    top_level_scanner(const char *_begin, const char *_end, size_t _line = 1, size_t _column = 0);
+
+    // Advances to the next cut, returning false at the end of the text.
+    bool next(cut &result);
+
+  private:
+    // Skips a comment starting at `cur`, leaving `cur` at its last character, or returns false if there is none.
+    bool skip_comment();
+    void new_line(const char *p);
+    size_t column_at(const char *p) const;
+
+    const char *begin;
+    const char *cur;
+    const char *end;
+    size_t line;
+    const char *line_start;
+    size_t line_start_column;
+    size_t depth;
+    bool in_body; // Whether the braces at depth 1 are a function body.
+    char last;    // Last character of code, outside comments and whitespace.
+};
+}
+
+#endif
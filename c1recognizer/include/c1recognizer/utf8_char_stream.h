@@ -0,0 +1,79 @@
+
+#ifndef _C1_UTF8_CHAR_STREAM_H_
+#define _C1_UTF8_CHAR_STREAM_H_
+
+#include <CharStream.h>
+#include <iostream>
+#include <string>
+
+namespace c1_recognizer
+{
+
+// Char streams over UTF-8 text, yielding code points to C1Lexer without decoding the whole input to UTF-32 first.
+// Indices are byte offsets of code points rather than code point counts. The lexer only compares them and hands them
+// back to getText, so tokens are the same as with ANTLRInputStream, except for their start and stop indices.
+// Malformed sequences yield U+FFFD.
+
+// Text held in memory, which must outlive the stream and any token made from it; it is not copied.
+class utf8_char_stream : public antlr4::CharStream
+{
+  public:
+    utf8_char_stream(const char *_begin, const char *_end, const std::string &_name = "");
+
+    virtual void consume() override;
+    virtual size_t LA(ssize_t i) override;
+    virtual ssize_t mark() override;
+    virtual void release(ssize_t marker) override;
+    virtual size_t index() override;
+    virtual void seek(size_t index) override;
+    virtual size_t size() override;
+    virtual std::string getText(const antlr4::misc::Interval &interval) override;
+    virtual std::string getSourceName() const override;
+    virtual std::string toString() const override;
+
+  private:
+    const char *begin;
+    const char *end;
+    const char *cur;
+    std::string name;
+};
+
+// Text read from a std::istream in chunks, keeping only what is needed since the oldest mark. Text of an interval is
+// only available while it is buffered, so lexers over this stream should copy the text into their tokens.
+class unbuffered_utf8_stream : public antlr4::CharStream
+{
+  public:
+    unbuffered_utf8_stream(std::istream &_input, const std::string &_name = "");
+
+    virtual void consume() override;
+    virtual size_t LA(ssize_t i) override;
+    virtual ssize_t mark() override;
+    virtual void release(ssize_t marker) override;
+    virtual size_t index() override;
+    virtual void seek(size_t index) override;
+    virtual size_t size() override;
+    virtual std::string getText(const antlr4::misc::Interval &interval) override;
+    virtual std::string getSourceName() const override;
+    virtual std::string toString() const override;
+
+  private:
+    // Reads the next chunk, returning false at the end of input.
+    bool fill();
+    // Whether buffer[offset] exists, reading as much as that takes.
+    bool available(size_t offset);
+    // Buffer offset just past the code point starting at `offset`, reading as much as that takes.
+    size_t code_point_end(size_t offset);
+
+    std::istream &input;
+    std::string name;
+    std::string buffer;
+    size_t start;             // Stream index of buffer[0].
+    size_t p;                 // Buffer offset of the current code point.
+    size_t markers;           // Marks not released yet; the buffer is only trimmed without any.
+    size_t previous;          // Code point before the current one, for LA(-1).
+    size_t previous_at_start; // Code point before buffer[0], for seeking back to it.
+    bool at_end;
+};
+}
+
+#endif
@@ -0,0 +1,672 @@
+#include <c1recognizer/ast_cache.h>
+#include <c1recognizer/flat_syntax_tree.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace c1_recognizer::syntax_tree;
+
+// An image is a header followed by these sections, each starting at a multiple of 8 bytes, all in host byte order:
+//
+//   kinds, ops:             one byte per node
+//   first, second, third:   32-bit operands per node, as in flat_syntax_tree
+//   locations:              line and position per node, 32 bits each
+//   lists:                  32-bit words of the lists, each its size followed by its elements
+//   floats:                 64-bit values of float literals
+//   spelling ends:          32-bit offset of the end of each spelling
+//   spellings:              the spellings of all identifiers, one after another
+//
+// Names of nodes are numbered anew in the image, from 0 in order of first use; the spellings section gives each
+// number its identifier. Nodes are in pre-order, so the children of a node always have greater indices than it;
+// reading relies on it to reject cycles.
+namespace
+{
+using node_index = flat_syntax_tree::index;
+using kind = flat_syntax_tree::kind;
+using location = flat_syntax_tree::location;
+
+const uint64_t magic = 0x314d495453414331; // "1CASTIM1" read as little-endian characters.
+const uint64_t version = 1;
+const node_index none = flat_syntax_tree::none;
+const uint8_t int_flag = 1;
+const uint8_t constant_flag = 2;
+
+struct image_header
+{
+    uint64_t magic;
+    uint64_t version;
+    uint64_t source_hash[2]; // Zero unless written by ast_cache
+    uint64_t source_size;
+    uint64_t nodes;
+    uint64_t list_words;
+    uint64_t floats;
+    uint64_t symbols;
+    uint64_t spelling_bytes;
+    int32_t root_line;
+    int32_t root_pos;
+    uint32_t root_list;
+    uint32_t reserved;
+};
+
+size_t align(size_t offset) { return (offset + 7) / 8 * 8; }
+
+// Offsets of the sections of an image. Counts in the header must have been checked to fit 32 bits, so that none of
+// the sums overflow.
+struct image_layout
+{
+    explicit image_layout(const image_header &header)
+    {
+        size_t n = header.nodes;
+        kinds = sizeof(image_header);
+        ops = align(kinds + n);
+        first = align(ops + n);
+        second = align(first + n * sizeof(node_index));
+        third = align(second + n * sizeof(node_index));
+        locations = align(third + n * sizeof(node_index));
+        lists = align(locations + n * sizeof(location));
+        floats = align(lists + header.list_words * sizeof(node_index));
+        spelling_ends = align(floats + header.floats * sizeof(double));
+        spellings = align(spelling_ends + header.symbols * sizeof(uint32_t));
+        size = align(spellings + header.spelling_bytes);
+    }
+
+    size_t kinds, ops, first, second, third, locations, lists, floats, spelling_ends, spellings, size;
+};
+
+bool has_name(kind k) { return k == kind::func_def || k == kind::lval || k == kind::var_def || k == kind::func_call; }
+
+struct malformed_image
+{
+};
+
+// Rebuilds the tree in two passes over the nodes: the first makes them and fills in their own fields, the second links
+// them to their children. Neither recurses, so trees of any depth are read. Every index, count and operator is
+// checked before use, as images come from files anyone may have written to.
+class image_reader
+{
+  public:
+    image_reader(const image_header &_header, const char *image)
+        : header(_header), n(static_cast<node_index>(header.nodes)), context(nullptr)
+    {
+        image_layout layout(header);
+        kinds = reinterpret_cast<const kind *>(image + layout.kinds);
+        ops = reinterpret_cast<const uint8_t *>(image + layout.ops);
+        first = reinterpret_cast<const node_index *>(image + layout.first);
+        second = reinterpret_cast<const node_index *>(image + layout.second);
+        third = reinterpret_cast<const node_index *>(image + layout.third);
+        locations = reinterpret_cast<const location *>(image + layout.locations);
+        lists = reinterpret_cast<const node_index *>(image + layout.lists);
+        floats = reinterpret_cast<const double *>(image + layout.floats);
+        spelling_ends = reinterpret_cast<const uint32_t *>(image + layout.spelling_ends);
+        spellings = image + layout.spellings;
+    }
+
+    std::shared_ptr<assembly> read()
+    {
+        uint32_t begin = 0;
+        names.reserve(header.symbols);
+        for (size_t i = 0; i < header.symbols; ++i)
+        {
+            auto end = spelling_ends[i];
+            if (end < begin || end > header.spelling_bytes)
+                throw malformed_image();
+            names.push_back(intern(std::string(spellings + begin, end - begin)));
+            begin = end;
+        }
+
+        auto owner = std::make_shared<ast_context>();
+        context = owner.get();
+        made.assign(n, nullptr);
+        packed.assign(n, false);
+        for (node_index i = 0; i < n; ++i)
+            make(i);
+        for (node_index i = 0; i < n; ++i)
+            link(i);
+
+        auto root = context->make<assembly>();
+        root->line = header.root_line;
+        root->pos = header.root_pos;
+        for (auto def : list_at(header.root_list))
+        {
+            if (def >= n)
+                throw malformed_image();
+            root->global_defs.push_back(global_def(def));
+        }
+        return std::shared_ptr<assembly>(owner, root);
+    }
+
+  private:
+    void make(node_index i)
+    {
+        switch (kinds[i])
+        {
+        case kind::func_def:
+            made[i] = located<func_def_syntax>(i);
+            static_cast<func_def_syntax *>(made[i])->name = name_at(i);
+            break;
+        case kind::cond:
+        {
+            auto node = located<cond_syntax>(i);
+            node->op = static_cast<relop>(op_at(i, static_cast<uint8_t>(relop::greater_equal)));
+            made[i] = node;
+            break;
+        }
+        case kind::binop:
+        {
+            auto node = located<binop_expr_syntax>(i);
+            node->op = static_cast<binop>(op_at(i, static_cast<uint8_t>(binop::modulo)));
+            made[i] = node;
+            break;
+        }
+        case kind::unaryop:
+        {
+            auto node = located<unaryop_expr_syntax>(i);
+            node->op = static_cast<unaryop>(op_at(i, static_cast<uint8_t>(unaryop::minus)));
+            made[i] = node;
+            break;
+        }
+        case kind::lval:
+            made[i] = located<lval_syntax>(i);
+            static_cast<lval_syntax *>(made[i])->name = name_at(i);
+            break;
+        case kind::literal:
+            // Literals packed into their var_def are made along with it.
+            if (!packed[i])
+            {
+                auto node = located<literal_syntax>(i);
+                literal_at(i, *node);
+                made[i] = node;
+            }
+            break;
+        case kind::var_def:
+            make_var_def(i);
+            break;
+        case kind::assign:
+            made[i] = located<assign_stmt_syntax>(i);
+            break;
+        case kind::func_call:
+            made[i] = located<func_call_stmt_syntax>(i);
+            static_cast<func_call_stmt_syntax *>(made[i])->name = name_at(i);
+            break;
+        case kind::block:
+            made[i] = located<block_syntax>(i);
+            break;
+        case kind::if_stmt:
+            made[i] = located<if_stmt_syntax>(i);
+            break;
+        case kind::while_stmt:
+            made[i] = located<while_stmt_syntax>(i);
+            break;
+        case kind::empty_stmt:
+            made[i] = located<empty_stmt_syntax>(i);
+            break;
+        default:
+            throw malformed_image();
+        }
+    }
+
+    // Array initializers that are all literals of one kind are packed into the node, as add_initializer() would have
+    // left them, rather than made into nodes of their own.
+    void make_var_def(node_index i)
+    {
+        auto node = located<var_def_stmt_syntax>(i);
+        node->name = name_at(i);
+        node->is_int = (ops[i] & int_flag) != 0;
+        node->is_constant = (ops[i] & constant_flag) != 0;
+        made[i] = node;
+        if (second[i] == none)
+            return;
+
+        auto inits = list_at(third[i]);
+        bool packable = inits.size() > 0;
+        for (auto init : inits)
+            packable = packable && child(init, i) && kinds[init] == kind::literal &&
+                       (ops[init] & int_flag) == (ops[inits[0]] & int_flag);
+        if (!packable)
+            return;
+        for (auto init : inits)
+        {
+            literal_syntax literal;
+            literal.line = locations[init].line;
+            literal.pos = locations[init].pos;
+            literal_at(init, literal);
+            node->literal_initializers.add(literal);
+            packed[init] = true;
+        }
+    }
+
+    void link(node_index i)
+    {
+        switch (kinds[i])
+        {
+        case kind::func_def:
+            static_cast<func_def_syntax *>(made[i])->body = block(first_child(second[i], i));
+            break;
+        case kind::cond:
+        {
+            auto node = static_cast<cond_syntax *>(made[i]);
+            node->lhs = expression(first_child(first[i], i));
+            node->rhs = expression(first_child(second[i], i));
+            break;
+        }
+        case kind::binop:
+        {
+            auto node = static_cast<binop_expr_syntax *>(made[i]);
+            node->lhs = expression(first_child(first[i], i));
+            node->rhs = expression(first_child(second[i], i));
+            break;
+        }
+        case kind::unaryop:
+            static_cast<unaryop_expr_syntax *>(made[i])->rhs = expression(first_child(first[i], i));
+            break;
+        case kind::lval:
+            if (second[i] != none)
+                static_cast<lval_syntax *>(made[i])->array_index = expression(first_child(second[i], i));
+            break;
+        case kind::var_def:
+        {
+            auto node = static_cast<var_def_stmt_syntax *>(made[i]);
+            if (second[i] != none)
+                node->array_length = expression(first_child(second[i], i));
+            if (!node->literal_initializers.empty())
+                break;
+            for (auto init : list_at(third[i]))
+                node->initializers.push_back(expression(first_child(init, i)));
+            break;
+        }
+        case kind::assign:
+        {
+            auto node = static_cast<assign_stmt_syntax *>(made[i]);
+            auto target = first_child(first[i], i);
+            if (kinds[target] != kind::lval)
+                throw malformed_image();
+            node->target = static_cast<lval_syntax *>(made[target]);
+            node->value = expression(first_child(second[i], i));
+            break;
+        }
+        case kind::block:
+        {
+            auto node = static_cast<block_syntax *>(made[i]);
+            auto body = list_at(first[i]);
+            node->body.reserve(body.size());
+            for (auto stmt : body)
+                node->body.push_back(statement(first_child(stmt, i)));
+            break;
+        }
+        case kind::if_stmt:
+        {
+            auto node = static_cast<if_stmt_syntax *>(made[i]);
+            node->pred = condition(first_child(first[i], i));
+            node->then_body = statement(first_child(second[i], i));
+            if (third[i] != none)
+                node->else_body = statement(first_child(third[i], i));
+            break;
+        }
+        case kind::while_stmt:
+        {
+            auto node = static_cast<while_stmt_syntax *>(made[i]);
+            node->pred = condition(first_child(first[i], i));
+            node->body = statement(first_child(second[i], i));
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    template <typename T>
+    T *located(node_index i)
+    {
+        auto node = context->make<T>();
+        node->line = locations[i].line;
+        node->pos = locations[i].pos;
+        return node;
+    }
+
+    bool child(node_index node, node_index parent) const { return node > parent && node < n; }
+
+    node_index first_child(node_index node, node_index parent) const
+    {
+        if (!child(node, parent))
+            throw malformed_image();
+        return node;
+    }
+
+    symbol name_at(node_index i) const
+    {
+        if (first[i] >= names.size())
+            throw malformed_image();
+        return names[first[i]];
+    }
+
+    uint8_t op_at(node_index i, uint8_t last) const
+    {
+        if (ops[i] > last)
+            throw malformed_image();
+        return ops[i];
+    }
+
+    void literal_at(node_index i, literal_syntax &literal) const
+    {
+        literal.is_int = (ops[i] & int_flag) != 0;
+        if (literal.is_int)
+        {
+            literal.intConst = static_cast<int>(first[i]);
+            literal.floatConst = 0;
+        }
+        else
+        {
+            if (first[i] >= header.floats)
+                throw malformed_image();
+            literal.intConst = 0;
+            literal.floatConst = floats[first[i]];
+        }
+    }
+
+    flat_syntax_tree::list list_at(node_index offset) const
+    {
+        if (offset >= header.list_words || lists[offset] >= header.list_words - offset)
+            throw malformed_image();
+        return flat_syntax_tree::list(&lists[offset + 1], &lists[offset + 1] + lists[offset]);
+    }
+
+    ptr<expr_syntax> expression(node_index i) const
+    {
+        switch (kinds[i])
+        {
+        case kind::binop:
+            return static_cast<binop_expr_syntax *>(made[i]);
+        case kind::unaryop:
+            return static_cast<unaryop_expr_syntax *>(made[i]);
+        case kind::lval:
+            return static_cast<lval_syntax *>(made[i]);
+        case kind::literal:
+            // A literal packed into a var_def can't be anything else's child.
+            if (packed[i])
+                throw malformed_image();
+            return static_cast<literal_syntax *>(made[i]);
+        default:
+            throw malformed_image();
+        }
+    }
+
+    ptr<stmt_syntax> statement(node_index i) const
+    {
+        switch (kinds[i])
+        {
+        case kind::var_def:
+            return static_cast<var_def_stmt_syntax *>(made[i]);
+        case kind::assign:
+            return static_cast<assign_stmt_syntax *>(made[i]);
+        case kind::func_call:
+            return static_cast<func_call_stmt_syntax *>(made[i]);
+        case kind::block:
+            return static_cast<block_syntax *>(made[i]);
+        case kind::if_stmt:
+            return static_cast<if_stmt_syntax *>(made[i]);
+        case kind::while_stmt:
+            return static_cast<while_stmt_syntax *>(made[i]);
+        case kind::empty_stmt:
+            return static_cast<empty_stmt_syntax *>(made[i]);
+        default:
+            throw malformed_image();
+        }
+    }
+
+    ptr<global_def_syntax> global_def(node_index i) const
+    {
+        if (kinds[i] == kind::func_def)
+            return static_cast<func_def_syntax *>(made[i]);
+        if (kinds[i] == kind::var_def)
+            return static_cast<var_def_stmt_syntax *>(made[i]);
+        throw malformed_image();
+    }
+
+    ptr<block_syntax> block(node_index i) const
+    {
+        if (kinds[i] != kind::block)
+            throw malformed_image();
+        return static_cast<block_syntax *>(made[i]);
+    }
+
+    ptr<cond_syntax> condition(node_index i) const
+    {
+        if (kinds[i] != kind::cond)
+            throw malformed_image();
+        return static_cast<cond_syntax *>(made[i]);
+    }
+
+    const image_header &header;
+    node_index n;
+    const kind *kinds;
+    const uint8_t *ops;
+    const node_index *first;
+    const node_index *second;
+    const node_index *third;
+    const location *locations;
+    const node_index *lists;
+    const double *floats;
+    const uint32_t *spelling_ends;
+    const char *spellings;
+
+    ast_context *context;
+    std::vector<symbol> names;
+    // Node made for each index, as a pointer to its own type; nullptr for packed literals.
+    std::vector<void *> made;
+    std::vector<bool> packed;
+};
+
+// Header of the image at [data, data + size) if it is of this version and the sizes it gives add up, or nullptr.
+const image_header *checked_header(const void *data, size_t size)
+{
+    if (reinterpret_cast<uintptr_t>(data) % 8 != 0 || size < sizeof(image_header))
+        return nullptr;
+    auto header = static_cast<const image_header *>(data);
+    if (header->magic != magic || header->version != version)
+        return nullptr;
+    for (auto count : {header->nodes, header->list_words, header->floats, header->symbols, header->spelling_bytes})
+        if (count >= none)
+            return nullptr;
+    if (image_layout(*header).size != size)
+        return nullptr;
+    return header;
+}
+
+// Two 64-bit lanes over the source, 8 bytes at a time, each multiplied and rotated after every word and finally mixed
+// with the length.
+void hash_source(const std::string &source, uint64_t (&hash)[2])
+{
+    const uint64_t k1 = 0x9e3779b97f4a7c15ull, k2 = 0xc2b2ae3d27d4eb4full;
+    uint64_t h1 = 0x243f6a8885a308d3ull, h2 = 0x13198a2e03707344ull;
+    auto mix = [&](uint64_t word) {
+        h1 = (h1 ^ word) * k1;
+        h1 = h1 << 31 | h1 >> 33;
+        h2 = (h2 ^ word) * k2;
+        h2 = h2 << 29 | h2 >> 35;
+    };
+    size_t i = 0;
+    for (; i + 8 <= source.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, source.data() + i, 8);
+        mix(word);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, source.data() + i, source.size() - i);
+    mix(tail);
+    mix(source.size());
+    auto finish = [](uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ h >> 33;
+    };
+    hash[0] = finish(h1 ^ h2);
+    hash[1] = finish(h2 + k1);
+}
+}
+
+std::string c1_recognizer::syntax_tree::write_ast_image(const assembly &root)
+{
+    flat_syntax_tree tree(root);
+    std::vector<node_index> first = tree.first;
+    std::unordered_map<symbol, uint32_t> numbers;
+    std::string spellings;
+    std::vector<uint32_t> spelling_ends;
+    for (size_t i = 0; i < tree.size(); ++i)
+    {
+        if (!has_name(tree.kinds[i]))
+            continue;
+        auto found = numbers.emplace(first[i], static_cast<uint32_t>(numbers.size()));
+        if (found.second)
+        {
+            spellings += spelling(first[i]);
+            spelling_ends.push_back(static_cast<uint32_t>(spellings.size()));
+        }
+        first[i] = found.first->second;
+    }
+
+    image_header header = {};
+    header.magic = magic;
+    header.version = version;
+    header.nodes = tree.size();
+    header.list_words = tree.lists.size();
+    header.floats = tree.floats.size();
+    header.symbols = spelling_ends.size();
+    header.spelling_bytes = spellings.size();
+    header.root_line = tree.root_location.line;
+    header.root_pos = tree.root_location.pos;
+    header.root_list = tree.root_list;
+    if (header.list_words >= none || header.spelling_bytes >= none)
+        throw std::length_error("syntax tree too large for an image");
+
+    image_layout layout(header);
+    std::string image(layout.size, '\0');
+    auto put = [&image](size_t offset, const void *data, size_t bytes) {
+        if (bytes)
+            std::memcpy(&image[offset], data, bytes);
+    };
+    put(0, &header, sizeof(header));
+    put(layout.kinds, tree.kinds.data(), tree.size());
+    put(layout.ops, tree.ops.data(), tree.size());
+    put(layout.first, first.data(), first.size() * sizeof(node_index));
+    put(layout.second, tree.second.data(), tree.second.size() * sizeof(node_index));
+    put(layout.third, tree.third.data(), tree.third.size() * sizeof(node_index));
+    put(layout.locations, tree.locations.data(), tree.locations.size() * sizeof(location));
+    put(layout.lists, tree.lists.data(), tree.lists.size() * sizeof(node_index));
+    put(layout.floats, tree.floats.data(), tree.floats.size() * sizeof(double));
+    put(layout.spelling_ends, spelling_ends.data(), spelling_ends.size() * sizeof(uint32_t));
+    put(layout.spellings, spellings.data(), spellings.size());
+    return image;
+}
+
+std::shared_ptr<assembly> c1_recognizer::syntax_tree::read_ast_image(const void *data, size_t size)
+{
+    auto header = checked_header(data, size);
+    if (!header)
+        return nullptr;
+    try
+    {
+        return image_reader(*header, static_cast<const char *>(data)).read();
+    }
+    catch (malformed_image &)
+    {
+        return nullptr;
+    }
+}
+
+ast_cache::ast_cache(const std::string &_directory) : directory(_directory)
+{
+    // Fails harmlessly if it exists; if it can't be made, stores fail.
+    mkdir(directory.c_str(), 0777);
+}
+
+std::string ast_cache::path_for(const std::string &source) const
+{
+    uint64_t hash[2];
+    hash_source(source, hash);
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx%016llx.ast", static_cast<unsigned long long>(hash[0]),
+             static_cast<unsigned long long>(hash[1]));
+    return directory + "/" + name;
+}
+
+std::shared_ptr<assembly> ast_cache::lookup(const std::string &source)
+{
+    int fd = open(path_for(source).c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        ++stats.misses;
+        return nullptr;
+    }
+    struct stat info;
+    void *mapped = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        size = static_cast<size_t>(info.st_size);
+        mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    std::shared_ptr<assembly> result;
+    if (mapped != MAP_FAILED)
+    {
+        uint64_t hash[2];
+        hash_source(source, hash);
+        auto header = checked_header(mapped, size);
+        if (header && header->source_size == source.size() && header->source_hash[0] == hash[0] &&
+            header->source_hash[1] == hash[1])
+            result = read_ast_image(mapped, size);
+        munmap(mapped, size);
+    }
+    if (result)
+        ++stats.hits;
+    else
+    {
+        ++stats.rejected;
+        ++stats.misses;
+    }
+    return result;
+}
+
+bool ast_cache::store(const std::string &source, const assembly &root)
+{
+    auto image = write_ast_image(root);
+    image_header header;
+    std::memcpy(&header, image.data(), sizeof(header));
+    hash_source(source, header.source_hash);
+    header.source_size = source.size();
+    std::memcpy(&image[0], &header, sizeof(header));
+
+    auto path = path_for(source);
+    auto temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(image.data(), image.size());
+        if (!out)
+        {
+            out.close();
+            unlink(temporary.c_str());
+            return false;
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+    ++stats.stores;
+    return true;
+}
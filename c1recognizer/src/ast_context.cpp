@@ -0,0 +1,43 @@
+#include <c1recognizer/ast_context.h>
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace c1_recognizer::syntax_tree;
+
+namespace
+{
+// Slabs start small, as most trees are, and double up to the largest size.
+const size_t first_slab_size = 4096;
+const size_t max_slab_size = size_t(1) << 20;
+}
+
+ast_context::ast_context() : cur(nullptr), end(nullptr), slab_bytes(0), nodes_count(0) {}
+
+ast_context::~ast_context()
+{
+    for (auto &d : destructors)
+        d.destroy(d.node);
+}
+
+void ast_context::keep(std::shared_ptr<const void> owner) { kept.push_back(std::move(owner)); }
+
+void *ast_context::allocate(size_t size, size_t alignment)
+{
+    auto aligned = [&] {
+        auto address = reinterpret_cast<uintptr_t>(cur);
+        return cur + (alignment - address % alignment) % alignment;
+    };
+    if (!cur || aligned() + size > end)
+    {
+        size_t slab_size = slabs.empty() ? first_slab_size : std::min(slab_bytes, max_slab_size);
+        slab_size = std::max(slab_size, size + alignment);
+        slabs.emplace_back(new char[slab_size]);
+        cur = slabs.back().get();
+        end = cur + slab_size;
+        slab_bytes += slab_size;
+    }
+    auto result = aligned();
+    cur = result + size;
+    return result;
+}
@@ -0,0 +1,164 @@
+#include <c1recognizer/compact_token.h>
+
+#include <Exceptions.h>
+
+#include <limits>
+#include <sstream>
+
+using namespace c1_recognizer;
+using namespace antlr4;
+
+namespace
+{
+const size_t slab_tokens = 4096;
+
+static_assert(sizeof(compact_token) <= 48, "compact_token is not packed.");
+
+// Fields hold -1 (EOF, INVALID_INDEX) as their maximum value.
+template <typename T>
+size_t widen(T value)
+{
+    return value == std::numeric_limits<T>::max() ? static_cast<size_t>(-1) : value;
+}
+
+template <typename T>
+T narrow(size_t value)
+{
+    return value == static_cast<size_t>(-1) ? std::numeric_limits<T>::max() : static_cast<T>(value);
+}
+}
+
+compact_token::compact_token(token_arena &_arena, size_t _type, size_t _channel, size_t _start, const char *_text,
+                             size_t _length, size_t _line, size_t _column)
+    : text(_text), arena(&_arena), start(narrow<uint32_t>(_start)), length(_length), line(_line), column(_column),
+      index(narrow<uint32_t>(INVALID_INDEX)), type(narrow<uint16_t>(_type)), channel(_channel) {}
+
+void *compact_token::operator new(size_t size, token_arena &arena) { return arena.allocate(size); }
+
+std::string compact_token::getText() const
+{
+    if (getType() == Token::EOF)
+        return "<EOF>";
+    return std::string(text, length);
+}
+
+size_t compact_token::getType() const { return widen(type); }
+
+size_t compact_token::getLine() const { return line; }
+
+size_t compact_token::getCharPositionInLine() const { return column; }
+
+size_t compact_token::getChannel() const { return channel; }
+
+size_t compact_token::getTokenIndex() const { return widen(index); }
+
+size_t compact_token::getStartIndex() const { return widen(start); }
+
+size_t compact_token::getStopIndex() const { return getStartIndex() + length - 1; }
+
+TokenSource *compact_token::getTokenSource() const { return arena->get_token_source(); }
+
+CharStream *compact_token::getInputStream() const { return arena->get_input_stream(); }
+
+// Same format as CommonToken, showing the type as a number.
+std::string compact_token::toString() const
+{
+    std::string shown = getText();
+    if (shown.empty())
+        shown = "<no text>";
+    std::string escaped;
+    for (auto c : shown)
+        if (c == '\n')
+            escaped += "\\n";
+        else if (c == '\r')
+            escaped += "\\r";
+        else if (c == '\t')
+            escaped += "\\t";
+        else
+            escaped += c;
+
+    std::stringstream ss;
+    ss << "[@" << static_cast<ssize_t>(getTokenIndex()) << "," << static_cast<ssize_t>(getStartIndex()) << ":"
+       << static_cast<ssize_t>(getStopIndex()) << "='" << escaped << "',<" << static_cast<ssize_t>(getType()) << ">";
+    if (channel > 0)
+        ss << ",channel=" << channel;
+    ss << "," << line << ":" << column << "]";
+    return ss.str();
+}
+
+void compact_token::setText(const std::string &_text)
+{
+    text = arena->copy(_text);
+    length = _text.size();
+}
+
+void compact_token::setType(size_t _type) { type = narrow<uint16_t>(_type); }
+
+void compact_token::setLine(size_t _line) { line = _line; }
+
+void compact_token::setCharPositionInLine(size_t pos) { column = pos; }
+
+void compact_token::setChannel(size_t _channel) { channel = _channel; }
+
+void compact_token::setTokenIndex(size_t _index) { index = narrow<uint32_t>(_index); }
+
+token_arena::token_arena() : cur(nullptr), end(nullptr), base(nullptr), source(nullptr, nullptr), tokens_count(0) {}
+
+void token_arena::reset(const char *_text, std::pair<TokenSource *, CharStream *> _source)
+{
+    if (slabs.size() > 1)
+        slabs.resize(1);
+    cur = slabs.empty() ? nullptr : slabs[0].get();
+    end = slabs.empty() ? nullptr : cur + slab_tokens * sizeof(compact_token);
+    texts.clear();
+    base = _text;
+    source = _source;
+    tokens_count = 0;
+}
+
+void *token_arena::allocate(size_t size)
+{
+    static_assert(sizeof(compact_token) % alignof(compact_token) == 0, "Tokens in a slab would be misaligned.");
+    if (size != sizeof(compact_token))
+        throw IllegalArgumentException("token arenas only hold compact_tokens");
+    if (cur == end)
+    {
+        // new char[] is aligned for any fundamental type, so for tokens too.
+        slabs.emplace_back(new char[slab_tokens * sizeof(compact_token)]);
+        cur = slabs.back().get();
+        end = cur + slab_tokens * sizeof(compact_token);
+    }
+    auto result = cur;
+    cur += size;
+    ++tokens_count;
+    return result;
+}
+
+const char *token_arena::copy(const std::string &text)
+{
+    texts.push_back(text);
+    return texts.back().data();
+}
+
+void compact_token_factory::reset(const char *text, std::pair<TokenSource *, CharStream *> source)
+{
+    arena.reset(text, source);
+}
+
+std::unique_ptr<compact_token> compact_token_factory::create(std::pair<TokenSource *, CharStream *>, size_t type,
+                                                             const std::string &text, size_t channel, size_t start,
+                                                             size_t stop, size_t line, size_t charPositionInLine)
+{
+    // The arena knows the source already; only a text override isn't in it.
+    const char *begin = text.empty() ? arena.get_text() + start : arena.copy(text);
+    size_t length = text.empty() ? stop + 1 - start : text.size();
+    return std::unique_ptr<compact_token>(
+        new (arena) compact_token(arena, type, channel, start, begin, length, line, charPositionInLine));
+}
+
+std::unique_ptr<compact_token> compact_token_factory::create(size_t type, const std::string &text)
+{
+    auto begin = arena.copy(text);
+    return std::unique_ptr<compact_token>(new (arena) compact_token(arena, type, Token::DEFAULT_CHANNEL,
+                                                                    INVALID_INDEX, begin, text.size(), 0, 0));
+}
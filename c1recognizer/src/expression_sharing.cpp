@@ -0,0 +1,179 @@
+#include <c1recognizer/expression_sharing.h>
+#include <c1recognizer/static_visitor.h>
+
+#include <cstring>
+#include <unordered_map>
+
+using namespace c1_recognizer::syntax_tree;
+
+namespace
+{
+// Structure of an expression whose operands are already shared, so that equal expressions have equal keys. A
+// variable read is keyed by its name and by how many times the name was assigned or defined before.
+struct expr_key
+{
+    int kind;
+    int op;
+    uint64_t value;
+    const void *lhs;
+    const void *rhs;
+
+    bool operator==(const expr_key &other) const
+    {
+        return kind == other.kind && op == other.op && value == other.value && lhs == other.lhs && rhs == other.rhs;
+    }
+};
+
+struct expr_key_hash
+{
+    size_t operator()(const expr_key &key) const
+    {
+        size_t h = std::hash<uint64_t>()(key.value);
+        for (size_t part : {size_t(key.kind), size_t(key.op), reinterpret_cast<size_t>(key.lhs),
+                            reinterpret_cast<size_t>(key.rhs)})
+            h = h * 31 + part;
+        return h;
+    }
+};
+
+enum expr_kind
+{
+    binop_kind,
+    unaryop_kind,
+    lval_kind,
+    literal_kind
+};
+
+class expression_sharer : public static_visitor<expression_sharer>
+{
+  public:
+    sharing_statistics statistics;
+
+    void visit(assembly &node)
+    {
+        for (auto def : node.global_defs)
+            if (def->kind == node_kind::func_def)
+                visit(static_cast<func_def_syntax &>(*def));
+    }
+
+    void visit(func_def_syntax &node)
+    {
+        visit(*node.body);
+        forget_all();
+    }
+
+    void visit(cond_syntax &node)
+    {
+        node.lhs = dispatch(*node.lhs);
+        node.rhs = dispatch(*node.rhs);
+    }
+
+    // Expressions return the node equal to them to use instead.
+    ptr<expr_syntax> visit(binop_expr_syntax &node)
+    {
+        node.lhs = dispatch(*node.lhs);
+        node.rhs = dispatch(*node.rhs);
+        return lookup({binop_kind, static_cast<int>(node.op), 0, node.lhs, node.rhs}, &node);
+    }
+
+    ptr<expr_syntax> visit(unaryop_expr_syntax &node)
+    {
+        node.rhs = dispatch(*node.rhs);
+        return lookup({unaryop_kind, static_cast<int>(node.op), 0, nullptr, node.rhs}, &node);
+    }
+
+    ptr<expr_syntax> visit(lval_syntax &node)
+    {
+        if (node.array_index)
+            node.array_index = dispatch(*node.array_index);
+        uint64_t value = uint64_t(node.name) << 32 | versions[node.name];
+        return lookup({lval_kind, 0, value, node.array_index, nullptr}, &node);
+    }
+
+    ptr<expr_syntax> visit(literal_syntax &node)
+    {
+        uint64_t value = 0;
+        if (node.is_int)
+            value = static_cast<uint32_t>(node.intConst);
+        else
+            std::memcpy(&value, &node.floatConst, sizeof(value));
+        return lookup({literal_kind, node.is_int, value, nullptr, nullptr}, &node);
+    }
+
+    void visit(var_def_stmt_syntax &node)
+    {
+        for (auto &init : node.initializers)
+            init = dispatch(*init);
+        assigned(node.name);
+    }
+
+    void visit(assign_stmt_syntax &node)
+    {
+        node.value = dispatch(*node.value);
+        if (node.target->array_index)
+            node.target->array_index = dispatch(*node.target->array_index);
+        assigned(node.target->name);
+    }
+
+    void visit(func_call_stmt_syntax &) { forget_all(); }
+
+    void visit(block_syntax &node)
+    {
+        // Names defined in the block go out of scope at its end.
+        forget_all();
+        for (auto stmt : node.body)
+            dispatch(*stmt);
+        forget_all();
+    }
+
+    void visit(if_stmt_syntax &node)
+    {
+        visit(*node.pred);
+        forget_all();
+        dispatch(*node.then_body);
+        forget_all();
+        if (node.else_body)
+        {
+            dispatch(*node.else_body);
+            forget_all();
+        }
+    }
+
+    void visit(while_stmt_syntax &node)
+    {
+        // The condition is evaluated again after each iteration.
+        forget_all();
+        visit(*node.pred);
+        forget_all();
+        dispatch(*node.body);
+        forget_all();
+    }
+
+    void visit(empty_stmt_syntax &) {}
+
+  private:
+    ptr<expr_syntax> lookup(const expr_key &key, ptr<expr_syntax> expr)
+    {
+        ++statistics.expressions;
+        auto found = table.emplace(key, expr);
+        if (found.second)
+            ++statistics.distinct;
+        return found.first->second;
+    }
+
+    // Reads of `name` before this point are no longer equal to reads after.
+    void assigned(symbol name) { ++versions[name]; }
+
+    void forget_all() { table.clear(); }
+
+    std::unordered_map<expr_key, ptr<expr_syntax>, expr_key_hash> table;
+    std::unordered_map<symbol, uint32_t> versions;
+};
+}
+
+sharing_statistics c1_recognizer::syntax_tree::share_expressions(assembly &root)
+{
+    expression_sharer sharer;
+    sharer.visit(root);
+    return sharer.statistics;
+}
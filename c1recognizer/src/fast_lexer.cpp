@@ -0,0 +1,566 @@
+#include <c1recognizer/fast_lexer.h>
+
+#include <CommonTokenFactory.h>
+#include <C1Lexer.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace c1_recognizer;
+using namespace antlr4;
+
+namespace
+{
+// Keywords listed in C1Lexer.tokens, found by a minimal perfect hash over (first char, last char, length).
+struct keyword
+{
+    const char *text;
+    size_t length;
+    size_t type;
+};
+
+constexpr keyword keywords[] = {{"if", 2, C1Lexer::If},       {"else", 4, C1Lexer::Else},   {"while", 5, C1Lexer::While},
+                                {"const", 5, C1Lexer::Const}, {"int", 3, C1Lexer::Int},     {"float", 5, C1Lexer::Float},
+                                {"void", 4, C1Lexer::Void}};
+constexpr size_t keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+
+constexpr size_t keyword_hash(char first, char last, size_t length) { return (first + 5 * last + length) & 7; }
+
+struct keyword_table
+{
+    int slots[8];
+
+    constexpr keyword_table() : slots{-1, -1, -1, -1, -1, -1, -1, -1}
+    {
+        for (size_t i = 0; i < keyword_count; ++i)
+            slots[keyword_hash(keywords[i].text[0], keywords[i].text[keywords[i].length - 1], keywords[i].length)] = i;
+    }
+
+    constexpr bool is_perfect() const
+    {
+        size_t used = 0;
+        for (auto slot : slots)
+            if (slot >= 0)
+                ++used;
+        return used == keyword_count;
+    }
+};
+
+constexpr keyword_table keyword_slots;
+static_assert(keyword_slots.is_perfect(), "Keyword hash has collisions.");
+
+size_t identifier_type(const char *begin, size_t length)
+{
+    if (length < 2 || length > 5)
+        return C1Lexer::Identifier;
+    int slot = keyword_slots.slots[keyword_hash(begin[0], begin[length - 1], length)];
+    if (slot >= 0 && keywords[slot].length == length && std::memcmp(keywords[slot].text, begin, length) == 0)
+        return keywords[slot].type;
+    return C1Lexer::Identifier;
+}
+
+// Character classes, looked up by unsigned byte.
+enum char_class : unsigned char
+{
+    cc_other = 0,
+    cc_space = 1,
+    cc_ident_start = 2,
+    cc_digit = 4
+};
+
+struct char_class_table
+{
+    unsigned char classes[256];
+
+    constexpr char_class_table() : classes{}
+    {
+        classes[' '] = classes['\t'] = classes['\r'] = classes['\n'] = cc_space;
+        for (int c = 'a'; c <= 'z'; ++c)
+            classes[c] = cc_ident_start;
+        for (int c = 'A'; c <= 'Z'; ++c)
+            classes[c] = cc_ident_start;
+        classes['_'] = cc_ident_start;
+        for (int c = '0'; c <= '9'; ++c)
+            classes[c] = cc_digit;
+    }
+};
+
+constexpr char_class_table char_classes;
+
+inline unsigned char class_of(char c) { return char_classes.classes[static_cast<unsigned char>(c)]; }
+inline bool is_space(char c) { return class_of(c) == cc_space; }
+inline bool is_digit(char c) { return class_of(c) == cc_digit; }
+inline bool is_ident_char(char c) { return class_of(c) & (cc_ident_start | cc_digit); }
+inline bool is_hex_digit(char c) { return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+inline bool is_continuation_byte(char c) { return (static_cast<unsigned char>(c) & 0xC0) == 0x80; }
+
+// Vectorized scanning primitives. Each processes whole blocks while they fit, then finishes byte by byte.
+
+#if defined(__AVX2__)
+const size_t block_size = 32;
+using block = __m256i;
+inline block load_block(const char *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+inline block splat(char c) { return _mm256_set1_epi8(c); }
+inline block equal(block a, block b) { return _mm256_cmpeq_epi8(a, b); }
+inline block either(block a, block b) { return _mm256_or_si256(a, b); }
+// Bytes 0x80-0xBF, which are -128 to -65 as signed bytes.
+inline block continuation(block a) { return _mm256_cmpgt_epi8(splat(-64), a); }
+inline unsigned mask_of(block a) { return static_cast<unsigned>(_mm256_movemask_epi8(a)); }
+#elif defined(__SSE2__)
+const size_t block_size = 16;
+using block = __m128i;
+inline block load_block(const char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+inline block splat(char c) { return _mm_set1_epi8(c); }
+inline block equal(block a, block b) { return _mm_cmpeq_epi8(a, b); }
+inline block either(block a, block b) { return _mm_or_si128(a, b); }
+inline block continuation(block a) { return _mm_cmplt_epi8(a, splat(-64)); }
+inline unsigned mask_of(block a) { return static_cast<unsigned>(_mm_movemask_epi8(a)); }
+#endif
+
+// First byte in [p, end) that is not whitespace.
+const char *skip_whitespace(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    while (p + block_size <= end)
+    {
+        auto bytes = load_block(p);
+        auto spaces = either(either(equal(bytes, splat(' ')), equal(bytes, splat('\n'))),
+                             either(equal(bytes, splat('\t')), equal(bytes, splat('\r'))));
+        unsigned others = ~mask_of(spaces);
+        if (block_size < 32)
+            others &= (1u << block_size) - 1;
+        if (others)
+            return p + __builtin_ctz(others);
+        p += block_size;
+    }
+#endif
+    while (p < end && is_space(*p))
+        ++p;
+    return p;
+}
+
+// First byte in [p, end) that is '\n', '\r' or '\\', i.e. anything a line comment body needs to look at.
+const char *find_line_comment_stop(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    while (p + block_size <= end)
+    {
+        auto bytes = load_block(p);
+        unsigned stops = mask_of(
+            either(either(equal(bytes, splat('\n')), equal(bytes, splat('\r'))), equal(bytes, splat('\\'))));
+        if (stops)
+            return p + __builtin_ctz(stops);
+        p += block_size;
+    }
+#endif
+    while (p < end && *p != '\n' && *p != '\r' && *p != '\\')
+        ++p;
+    return p;
+}
+
+// First '*' in [p, end).
+const char *find_star(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    while (p + block_size <= end)
+    {
+        unsigned stars = mask_of(equal(load_block(p), splat('*')));
+        if (stars)
+            return p + __builtin_ctz(stars);
+        p += block_size;
+    }
+#endif
+    while (p < end && *p != '*')
+        ++p;
+    return p;
+}
+
+size_t count_newlines(const char *p, const char *end)
+{
+    size_t count = 0;
+#if defined(__SSE2__)
+    for (; p + block_size <= end; p += block_size)
+        count += __builtin_popcount(mask_of(equal(load_block(p), splat('\n'))));
+#endif
+    for (; p < end; ++p)
+        count += *p == '\n';
+    return count;
+}
+
+size_t count_code_points(const char *p, const char *end)
+{
+    size_t count = end - p;
+#if defined(__SSE2__)
+    for (; p + block_size <= end; p += block_size)
+        count -= __builtin_popcount(mask_of(continuation(load_block(p))));
+#endif
+    for (; p < end; ++p)
+        count -= is_continuation_byte(*p);
+    return count;
+}
+
+// Length of the UTF-8 sequence starting at p, clamped to the input.
+const char *next_code_point(const char *p, const char *end)
+{
+    ++p;
+    while (p < end && is_continuation_byte(*p))
+        ++p;
+    return p;
+}
+
+// Same escaping as Lexer::getErrorDisplay.
+std::string error_display(const char *begin, const char *end)
+{
+    std::string result;
+    for (auto p = begin; p < end; ++p)
+        switch (*p)
+        {
+        case '\n':
+            result += "\\n";
+            break;
+        case '\r':
+            result += "\\r";
+            break;
+        case '\t':
+            result += "\\t";
+            break;
+        default:
+            result += *p;
+        }
+    return result;
+}
+}
+
+fast_lexer::fast_lexer(const char *_begin, const char *_end, error_reporter &_err)
+    : cur(_begin), end(_end), line(1), column(0), index(0), err(_err) {}
+
+void fast_lexer::set_position(size_t _line, size_t _column)
+{
+    line = _line;
+    column = _column;
+}
+
+size_t fast_lexer::getLine() const { return line; }
+
+size_t fast_lexer::getCharPositionInLine() { return column; }
+
+CharStream *fast_lexer::getInputStream() { return nullptr; }
+
+std::string fast_lexer::getSourceName() { return IntStream::UNKNOWN_SOURCE_NAME; }
+
+Ref<TokenFactory<CommonToken>> fast_lexer::getTokenFactory() { return CommonTokenFactory::DEFAULT; }
+
+void fast_lexer::advance(const char *to)
+{
+    size_t newlines = count_newlines(cur, to);
+    size_t code_points = count_code_points(cur, to);
+    if (newlines)
+    {
+        auto last_newline = to - 1;
+        while (*last_newline != '\n')
+            --last_newline;
+        line += newlines;
+        column = count_code_points(last_newline + 1, to);
+    }
+    else
+        column += code_points;
+    index += code_points;
+    cur = to;
+}
+
+// Every token type C1Lexer emits consists of ASCII characters within one line, so positions move by bytes here.
+template <typename T>
+std::unique_ptr<T> fast_lexer::make_token(size_t type, const char *stop)
+{
+    size_t length = stop - cur;
+    // Not make_unique: forwarding by reference would need definitions of the runtime's static constants.
+    std::unique_ptr<T> token(new T(std::make_pair<TokenSource *, CharStream *>(this, nullptr), type,
+                                   Token::DEFAULT_CHANNEL, index, index + length - 1));
+    token->setLine(line);
+    token->setCharPositionInLine(column);
+    token->setText(std::string(cur, length));
+    index += length;
+    column += length;
+    cur = stop;
+    return token;
+}
+
+std::unique_ptr<Token> fast_lexer::make_literal(size_t type, const char *stop)
+{
+    const char *begin = cur;
+    size_t length = stop - begin;
+    auto token = make_token<literal_token>(type, stop);
+    token->has_value = true;
+    if (type == C1Lexer::IntConst)
+    {
+        // Same bases as syntax_tree_builder picks; anything above INT_MAX makes std::stoi throw there.
+        long long value = 0;
+        int base = 10;
+        const char *p = begin;
+        if (length > 1 && begin[0] == '0' && (begin[1] == 'x' || begin[1] == 'X'))
+        {
+            base = 16;
+            p += 2;
+        }
+        else if (begin[0] == '0')
+            base = 8;
+        for (; p < stop && token->has_value; ++p)
+        {
+            int digit = is_digit(*p) ? *p - '0' : (*p | 0x20) - 'a' + 10;
+            value = value * base + digit;
+            if (value > INT_MAX)
+                token->has_value = false;
+        }
+        token->int_value = static_cast<int>(value);
+    }
+    else
+    {
+        // strtod needs a terminated string; short literals are copied to the stack instead of a std::string.
+        char buffer[64];
+        if (length < sizeof(buffer))
+        {
+            std::memcpy(buffer, begin, length);
+            buffer[length] = '\0';
+            errno = 0;
+            token->float_value = std::strtod(buffer, nullptr);
+            token->has_value = errno != ERANGE;
+        }
+        else
+            token->has_value = false;
+    }
+    return token;
+}
+
+// LineComment : ('//' | '/\\' '\r'? '\n' '/') ~[\n\r\\]* ('\\' ('\r'? '\n')? ~[\n\r\\]*)* '\r'? '\n' -> skip
+// Returns the end of the longest match, or nullptr if there is none (so that it lexes as a '/').
+const char *fast_lexer::match_line_comment(const char *p)
+{
+    auto newline_end = [this](const char *q) -> const char * {
+        if (q < end && *q == '\n')
+            return q + 1;
+        if (q + 1 < end && q[0] == '\r' && q[1] == '\n')
+            return q + 2;
+        return nullptr;
+    };
+
+    const char *q = p + 1;
+    if (q < end && *q == '/')
+        ++q;
+    else if (q < end && *q == '\\')
+    {
+        q = newline_end(q + 1);
+        if (!q || q == end || *q != '/')
+            return nullptr;
+        ++q;
+    }
+    else
+        return nullptr;
+
+    // A backslash may or may not take the newline after it, so each escaped newline is also a possible end.
+    const char *accepted = nullptr;
+    while (true)
+    {
+        q = find_line_comment_stop(q, end);
+        if (q == end)
+            return accepted;
+        if (*q != '\\')
+        {
+            auto stop = newline_end(q);
+            return stop ? stop : accepted;
+        }
+        ++q;
+        if (auto stop = newline_end(q))
+            accepted = q = stop;
+    }
+}
+
+// BlockComment : '/*' .*? '*/' -> skip
+const char *fast_lexer::match_block_comment(const char *p)
+{
+    const char *q = p + 2;
+    while (true)
+    {
+        q = find_star(q, end);
+        if (q + 1 >= end)
+            return nullptr;
+        if (q[1] == '/')
+            return q + 2;
+        ++q;
+    }
+}
+
+// FloatConst : ([0-9]* '.' [0-9]+ | [0-9]+ '.') Exponent? | [0-9]+ Exponent, Exponent : [eE] [+-]? [0-9]+
+// Returns the end of the longest match, or nullptr.
+const char *fast_lexer::match_float(const char *p)
+{
+    const char *q = p;
+    while (q < end && is_digit(*q))
+        ++q;
+    bool has_integer = q != p;
+    bool has_dot = false;
+    if (q < end && *q == '.')
+    {
+        const char *fraction = q + 1;
+        const char *r = fraction;
+        while (r < end && is_digit(*r))
+            ++r;
+        if (has_integer || r != fraction)
+        {
+            has_dot = true;
+            q = r;
+        }
+    }
+    if (!has_integer && !has_dot)
+        return nullptr;
+
+    if (q < end && (*q == 'e' || *q == 'E'))
+    {
+        const char *r = q + 1;
+        if (r < end && (*r == '+' || *r == '-'))
+            ++r;
+        const char *digits = r;
+        while (r < end && is_digit(*r))
+            ++r;
+        if (r != digits)
+            return r;
+    }
+    return has_dot ? q : nullptr;
+}
+
+// Reports the same error C1Lexer does, covering [cur, stop), and skips it.
+void fast_lexer::recognition_error(const char *stop)
+{
+    err.error(line, column, "token recognition error at: '" + error_display(cur, stop) + "'");
+    advance(stop);
+}
+
+std::unique_ptr<Token> fast_lexer::nextToken()
+{
+    while (true)
+    {
+        auto p = skip_whitespace(cur, end);
+        if (p != cur)
+            advance(p);
+
+        if (cur == end)
+        {
+            std::unique_ptr<CommonToken> eof(new CommonToken(std::make_pair<TokenSource *, CharStream *>(this, nullptr),
+                                                             Token::EOF, Token::DEFAULT_CHANNEL, index, index - 1));
+            eof->setLine(line);
+            eof->setCharPositionInLine(column);
+            eof->setText("<EOF>");
+            return eof;
+        }
+
+        char c = *cur;
+        switch (c)
+        {
+        case ',':
+            return make_token<CommonToken>(C1Lexer::Comma, cur + 1);
+        case ';':
+            return make_token<CommonToken>(C1Lexer::SemiColon, cur + 1);
+        case '[':
+            return make_token<CommonToken>(C1Lexer::LeftBracket, cur + 1);
+        case ']':
+            return make_token<CommonToken>(C1Lexer::RightBracket, cur + 1);
+        case '{':
+            return make_token<CommonToken>(C1Lexer::LeftBrace, cur + 1);
+        case '}':
+            return make_token<CommonToken>(C1Lexer::RightBrace, cur + 1);
+        case '(':
+            return make_token<CommonToken>(C1Lexer::LeftParen, cur + 1);
+        case ')':
+            return make_token<CommonToken>(C1Lexer::RightParen, cur + 1);
+        case '+':
+            return make_token<CommonToken>(C1Lexer::Plus, cur + 1);
+        case '-':
+            return make_token<CommonToken>(C1Lexer::Minus, cur + 1);
+        case '*':
+            return make_token<CommonToken>(C1Lexer::Multiply, cur + 1);
+        case '%':
+            return make_token<CommonToken>(C1Lexer::Modulo, cur + 1);
+        case '=':
+            if (cur + 1 < end && cur[1] == '=')
+                return make_token<CommonToken>(C1Lexer::Equal, cur + 2);
+            return make_token<CommonToken>(C1Lexer::Assign, cur + 1);
+        case '<':
+            if (cur + 1 < end && cur[1] == '=')
+                return make_token<CommonToken>(C1Lexer::LessEqual, cur + 2);
+            return make_token<CommonToken>(C1Lexer::Less, cur + 1);
+        case '>':
+            if (cur + 1 < end && cur[1] == '=')
+                return make_token<CommonToken>(C1Lexer::GreaterEqual, cur + 2);
+            return make_token<CommonToken>(C1Lexer::Greater, cur + 1);
+        case '!':
+            if (cur + 1 < end && cur[1] == '=')
+                return make_token<CommonToken>(C1Lexer::NonEqual, cur + 2);
+            // C1Lexer fails on the character after '!' and drops it along with the '!'.
+            recognition_error(cur + 1 < end ? next_code_point(cur + 1, end) : end);
+            continue;
+        case '/':
+        {
+            const char *stop = nullptr;
+            if (cur + 1 < end && cur[1] == '*')
+                stop = match_block_comment(cur);
+            else if (cur + 1 < end && (cur[1] == '/' || cur[1] == '\\'))
+                stop = match_line_comment(cur);
+            if (!stop)
+                return make_token<CommonToken>(C1Lexer::Divide, cur + 1);
+            advance(stop);
+            continue;
+        }
+        default:
+            break;
+        }
+
+        auto cls = class_of(c);
+        if (cls == cc_ident_start)
+        {
+            auto stop = cur + 1;
+            while (stop < end && is_ident_char(*stop))
+                ++stop;
+            return make_token<CommonToken>(identifier_type(cur, stop - cur), stop);
+        }
+        if (cls == cc_digit || c == '.')
+        {
+            // IntConst : '0' [0-7]* | [1-9] [0-9]* | '0' [xX] [0-9a-fA-F]+; the longer of it and FloatConst wins.
+            const char *int_stop = nullptr;
+            if (c == '0')
+            {
+                if (cur + 2 < end && (cur[1] == 'x' || cur[1] == 'X') && is_hex_digit(cur[2]))
+                {
+                    int_stop = cur + 3;
+                    while (int_stop < end && is_hex_digit(*int_stop))
+                        ++int_stop;
+                }
+                else
+                {
+                    int_stop = cur + 1;
+                    while (int_stop < end && *int_stop >= '0' && *int_stop <= '7')
+                        ++int_stop;
+                }
+            }
+            else if (c != '.')
+            {
+                int_stop = cur + 1;
+                while (int_stop < end && is_digit(*int_stop))
+                    ++int_stop;
+            }
+            auto float_stop = match_float(cur);
+            if (float_stop && (!int_stop || float_stop > int_stop))
+                return make_literal(C1Lexer::FloatConst, float_stop);
+            if (int_stop)
+                return make_literal(C1Lexer::IntConst, int_stop);
+            // A lone '.' fails on the character after it, which is dropped as well.
+            recognition_error(cur + 1 < end ? next_code_point(cur + 1, end) : end);
+            continue;
+        }
+        recognition_error(next_code_point(cur, end));
+    }
+}
@@ -0,0 +1,210 @@
+#include <c1recognizer/flat_syntax_tree.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace c1_recognizer::syntax_tree;
+
+const flat_syntax_tree::index flat_syntax_tree::none;
+
+// Numbers the nodes in pre-order with a stack of nodes still to copy, rather than by recursing, so that trees of any
+// depth can be copied. Each node is copied when popped, and its children pushed in reverse order along with the slot
+// to receive their index.
+class flat_syntax_tree::builder : public syntax_tree_visitor
+{
+  public:
+    builder(flat_syntax_tree &_tree) : tree(_tree) {}
+
+    void build(const assembly &root)
+    {
+        tree.root_location = {root.line, root.pos};
+        tree.root_list = add_list(root.global_defs.size());
+        for (size_t i = root.global_defs.size(); i-- > 0;)
+            push(root.global_defs[i], &tree.lists, tree.root_list + 1 + i);
+        while (!pending.empty())
+        {
+            auto item = pending.back();
+            pending.pop_back();
+            if (tree.kinds.size() >= none)
+                throw std::length_error("too many syntax tree nodes for flat_syntax_tree");
+            current = static_cast<index>(tree.kinds.size());
+            (*item.slot)[item.slot_pos] = current;
+            parents.push_back(item.parent);
+            if (item.node)
+                // accept() is not const, but visiting only reads the node.
+                const_cast<syntax_tree_node *>(item.node)->accept(*this);
+            else
+                add_packed(*item.packed, item.packed_pos);
+        }
+
+        // Parents precede their children, so the end of each subtree is final before it is propagated to its parent.
+        tree.ends.resize(tree.kinds.size());
+        for (size_t i = 0; i < tree.ends.size(); ++i)
+            tree.ends[i] = static_cast<index>(i + 1);
+        for (size_t i = tree.kinds.size(); i-- > 0;)
+            if (parents[i] != none)
+                tree.ends[parents[i]] = std::max(tree.ends[parents[i]], tree.ends[i]);
+    }
+
+    virtual void visit(assembly &) override {}
+
+    virtual void visit(func_def_syntax &node) override
+    {
+        add(node, kind::func_def, 0, node.name);
+        push(node.body, &tree.second, current);
+    }
+
+    virtual void visit(cond_syntax &node) override
+    {
+        add(node, kind::cond, static_cast<uint8_t>(node.op));
+        push(node.rhs, &tree.second, current);
+        push(node.lhs, &tree.first, current);
+    }
+
+    virtual void visit(binop_expr_syntax &node) override
+    {
+        add(node, kind::binop, static_cast<uint8_t>(node.op));
+        push(node.rhs, &tree.second, current);
+        push(node.lhs, &tree.first, current);
+    }
+
+    virtual void visit(unaryop_expr_syntax &node) override
+    {
+        add(node, kind::unaryop, static_cast<uint8_t>(node.op));
+        push(node.rhs, &tree.first, current);
+    }
+
+    virtual void visit(lval_syntax &node) override
+    {
+        add(node, kind::lval, 0, node.name);
+        if (node.array_index)
+            push(node.array_index, &tree.second, current);
+    }
+
+    virtual void visit(literal_syntax &node) override
+    {
+        add_literal({node.line, node.pos}, node.is_int, node.intConst, node.floatConst);
+    }
+
+    virtual void visit(var_def_stmt_syntax &node) override
+    {
+        uint8_t flags = (node.is_int ? int_flag : 0) | (node.is_constant ? constant_flag : 0);
+        auto count = node.initializers_count();
+        auto list = add_list(count);
+        add(node, kind::var_def, flags, node.name, none, list);
+        auto &packed = node.literal_initializers;
+        for (size_t i = count; i-- > 0;)
+            if (i < node.initializers.size())
+                push(node.initializers[i], &tree.lists, list + 1 + i);
+            else
+                pending.push_back({nullptr, &packed, i - node.initializers.size(), &tree.lists, list + 1 + i,
+                                   current});
+        if (node.array_length)
+            push(node.array_length, &tree.second, current);
+    }
+
+    virtual void visit(assign_stmt_syntax &node) override
+    {
+        add(node, kind::assign);
+        push(node.value, &tree.second, current);
+        push(node.target, &tree.first, current);
+    }
+
+    virtual void visit(func_call_stmt_syntax &node) override
+    {
+        add(node, kind::func_call, 0, node.name);
+    }
+
+    virtual void visit(block_syntax &node) override
+    {
+        auto list = add_list(node.body.size());
+        add(node, kind::block, 0, list);
+        for (size_t i = node.body.size(); i-- > 0;)
+            push(node.body[i], &tree.lists, list + 1 + i);
+    }
+
+    virtual void visit(if_stmt_syntax &node) override
+    {
+        add(node, kind::if_stmt);
+        if (node.else_body)
+            push(node.else_body, &tree.third, current);
+        push(node.then_body, &tree.second, current);
+        push(node.pred, &tree.first, current);
+    }
+
+    virtual void visit(while_stmt_syntax &node) override
+    {
+        add(node, kind::while_stmt);
+        push(node.body, &tree.second, current);
+        push(node.pred, &tree.first, current);
+    }
+
+    virtual void visit(empty_stmt_syntax &node) override { add(node, kind::empty_stmt); }
+
+  private:
+    // A node to copy, or else a literal packed in a literal_list; its parent is `none` for global definitions.
+    struct item
+    {
+        const syntax_tree_node *node;
+        const literal_list *packed;
+        size_t packed_pos;
+        std::vector<index> *slot;
+        size_t slot_pos;
+        index parent;
+    };
+
+    void push(const syntax_tree_node *node, std::vector<index> *slot, size_t slot_pos)
+    {
+        pending.push_back({node, nullptr, 0, slot, slot_pos, current});
+    }
+
+    void add(const syntax_tree_node &node, kind k, uint8_t op = 0, index a = none, index b = none, index c = none)
+    {
+        add({node.line, node.pos}, k, op, a, b, c);
+    }
+
+    void add(location loc, kind k, uint8_t op, index a, index b, index c)
+    {
+        tree.kinds.push_back(k);
+        tree.ops.push_back(op);
+        tree.first.push_back(a);
+        tree.second.push_back(b);
+        tree.third.push_back(c);
+        tree.locations.push_back(loc);
+    }
+
+    void add_literal(location loc, bool is_int, int int_value, double float_value)
+    {
+        if (is_int)
+            add(loc, kind::literal, int_flag, static_cast<index>(int_value), none, none);
+        else
+        {
+            add(loc, kind::literal, 0, static_cast<index>(tree.floats.size()), none, none);
+            tree.floats.push_back(float_value);
+        }
+    }
+
+    void add_packed(const literal_list &packed, size_t i)
+    {
+        location loc{packed.positions[i].line, packed.positions[i].pos};
+        add_literal(loc, packed.is_int, packed.is_int ? packed.ints[i] : 0, packed.is_int ? 0 : packed.floats[i]);
+    }
+
+    index add_list(size_t size)
+    {
+        auto offset = static_cast<index>(tree.lists.size());
+        tree.lists.push_back(static_cast<index>(size));
+        tree.lists.resize(tree.lists.size() + size, none);
+        return offset;
+    }
+
+    flat_syntax_tree &tree;
+    std::vector<item> pending;
+    std::vector<index> parents;
+    index current = none;
+};
+
+flat_syntax_tree::flat_syntax_tree(const assembly &root)
+{
+    builder(*this).build(root);
+}
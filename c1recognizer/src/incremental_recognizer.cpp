@@ -0,0 +1,274 @@
+#include <c1recognizer/incremental_recognizer.h>
+#include <c1recognizer/top_level_scanner.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+using namespace c1_recognizer;
+using namespace c1_recognizer::syntax_tree;
+
+namespace
+{
+// Moves nodes by `lines`, and those on line `line` by `columns` too; all nodes moved are on or after it.
+class position_shifter : public syntax_tree_visitor
+{
+  public:
+    position_shifter(int _line, int _lines, int _columns) : line(_line), lines(_lines), columns(_columns) {}
+
+    virtual void visit(assembly &node) override
+    {
+        for (auto &def : node.global_defs)
+            def->accept(*this);
+    }
+    virtual void visit(func_def_syntax &node) override
+    {
+        shift(node);
+        accept(node.body);
+    }
+    virtual void visit(cond_syntax &node) override
+    {
+        shift(node);
+        accept(node.lhs);
+        accept(node.rhs);
+    }
+    virtual void visit(binop_expr_syntax &node) override
+    {
+        shift(node);
+        accept(node.lhs);
+        accept(node.rhs);
+    }
+    virtual void visit(unaryop_expr_syntax &node) override
+    {
+        shift(node);
+        accept(node.rhs);
+    }
+    virtual void visit(lval_syntax &node) override
+    {
+        shift(node);
+        accept(node.array_index);
+    }
+    virtual void visit(literal_syntax &node) override { shift(node); }
+    virtual void visit(var_def_stmt_syntax &node) override
+    {
+        shift(node);
+        accept(node.array_length);
+        for (auto &init : node.initializers)
+            accept(init);
+        for (auto &p : node.literal_initializers.positions)
+        {
+            if (p.line == line)
+                p.pos += columns;
+            p.line += lines;
+        }
+    }
+    virtual void visit(assign_stmt_syntax &node) override
+    {
+        shift(node);
+        accept(node.target);
+        accept(node.value);
+    }
+    virtual void visit(func_call_stmt_syntax &node) override { shift(node); }
+    virtual void visit(block_syntax &node) override
+    {
+        shift(node);
+        for (auto &stmt : node.body)
+            accept(stmt);
+    }
+    virtual void visit(if_stmt_syntax &node) override
+    {
+        shift(node);
+        accept(node.pred);
+        accept(node.then_body);
+        accept(node.else_body);
+    }
+    virtual void visit(while_stmt_syntax &node) override
+    {
+        shift(node);
+        accept(node.pred);
+        accept(node.body);
+    }
+    virtual void visit(empty_stmt_syntax &node) override { shift(node); }
+
+  private:
+    void shift(syntax_tree_node &node)
+    {
+        if (node.line == line)
+            node.pos += columns;
+        node.line += lines;
+    }
+
+    // Array lengths and else branches are optional.
+    template <typename T>
+    void accept(ptr<T> node)
+    {
+        if (node)
+            node->accept(*this);
+    }
+
+    int line;
+    int lines;
+    int columns;
+};
+
+// Whether a definition is before a cut; definitions start at their first token, which is after the cut opening their
+// segment.
+bool is_before(const global_def_syntax &def, size_t line, size_t column)
+{
+    return static_cast<size_t>(def.line) < line ||
+           (static_cast<size_t>(def.line) == line && static_cast<size_t>(def.pos) < column);
+}
+}
+
+incremental_recognizer::incremental_recognizer() : ast(nullptr), rcg(std::string()) {}
+
+void incremental_recognizer::set_lexer_engine(lexer_engine _engine) { rcg.set_lexer_engine(_engine); }
+
+void incremental_recognizer::set_parser_engine(parser_engine _engine) { rcg.set_parser_engine(_engine); }
+
+std::shared_ptr<assembly> incremental_recognizer::get_syntax_tree() const
+{
+    if (!ast)
+        return nullptr;
+    return std::shared_ptr<assembly>(owner, ast);
+}
+
+bool incremental_recognizer::parse(const std::string &_source, error_reporter &_err)
+{
+    source = _source;
+    return parse_whole(_err);
+}
+
+bool incremental_recognizer::edit(size_t offset, size_t removed, const std::string &inserted, error_reporter &_err)
+{
+    if (offset > source.size() || removed > source.size() - offset)
+        throw std::out_of_range("edit beyond the end of the source");
+    source.replace(offset, removed, inserted);
+    if (segments.empty())
+        return parse_whole(_err);
+
+    // The text before the segment the edit starts in is unchanged, and the scan restarts at its cut. An edit right at
+    // a cut may join the segment to the one before, e.g. by removing all code after it.
+    size_t first = std::upper_bound(segments.begin(), segments.end(), offset,
+                                    [](size_t o, const segment &s) { return o < s.offset; }) -
+                   segments.begin() - 1;
+    if (first > 0 && segments[first].offset == offset)
+        --first;
+    auto start = segments[first];
+
+    // Scan up to the first cut after the edit that is also an old one; the text after it is unchanged, hence so are
+    // the cuts after it.
+    std::vector<top_level_scanner::cut> cuts;
+    size_t last = first + 1;
+    size_t region_end = source.size();
+    top_level_scanner scanner(source.data() + start.offset, source.data() + source.size(), start.line, start.column);
+    top_level_scanner::cut cut;
+    while (scanner.next(cut))
+    {
+        cut.offset += start.offset;
+        if (cut.offset >= offset + inserted.size())
+        {
+            size_t old_offset = cut.offset - inserted.size() + removed;
+            while (last < segments.size() && segments[last].offset < old_offset)
+                ++last;
+            if (last < segments.size() && segments[last].offset == old_offset)
+            {
+                region_end = cut.offset;
+                break;
+            }
+        }
+        cuts.push_back(cut);
+    }
+    if (region_end == source.size())
+        last = segments.size();
+
+    std::ostringstream discarded;
+    error_reporter region_err(discarded);
+    rcg.reset(source.substr(start.offset, region_end - start.offset), start.line, start.column);
+    if (!rcg.execute(region_err))
+        return parse_whole(_err);
+    auto region_tree = rcg.get_syntax_tree();
+    auto region = static_cast<assembly *>(region_tree.get());
+
+    auto &defs = ast->global_defs;
+    size_t old_first_def = start.first_def;
+    size_t old_last_def = last < segments.size() ? segments[last].first_def : defs.size();
+    size_t new_last_def = old_first_def + region->global_defs.size();
+
+    // Move what follows the edit; only what is on the line of the cut ending the region moves sideways.
+    if (last < segments.size())
+    {
+        int old_line = segments[last].line;
+        int lines = static_cast<int>(cut.line) - old_line;
+        int columns = static_cast<int>(cut.column) - static_cast<int>(segments[last].column);
+        if (lines != 0 || columns != 0)
+        {
+            position_shifter shifter(old_line, lines, columns);
+            for (auto i = old_last_def; i < defs.size(); ++i)
+                defs[i]->accept(shifter);
+        }
+        for (auto i = last; i < segments.size(); ++i)
+        {
+            auto &s = segments[i];
+            s.offset = s.offset - removed + inserted.size();
+            if (static_cast<int>(s.line) == old_line)
+                s.column += columns;
+            s.line += lines;
+            s.first_def = s.first_def - old_last_def + new_last_def;
+        }
+    }
+
+    defs.erase(defs.begin() + old_first_def, defs.begin() + old_last_def);
+    defs.insert(defs.begin() + old_first_def, region->global_defs.begin(), region->global_defs.end());
+    auto &def_owners = owner->def_owners;
+    def_owners.erase(def_owners.begin() + old_first_def, def_owners.begin() + old_last_def);
+    def_owners.insert(def_owners.begin() + old_first_def, region->global_defs.size(), region_tree);
+    if (first == 0)
+    {
+        ast->line = region->line;
+        ast->pos = region->pos;
+    }
+
+    segments.erase(segments.begin() + first + 1, segments.begin() + last);
+    std::vector<segment> inserted_segments;
+    for (auto &c : cuts)
+        inserted_segments.push_back({c.offset, c.line, c.column, 0});
+    segments.insert(segments.begin() + first + 1, inserted_segments.begin(), inserted_segments.end());
+    number_defs(first, first + 1 + cuts.size(), old_first_def, new_last_def);
+    return true;
+}
+
+bool incremental_recognizer::parse_whole(error_reporter &_err)
+{
+    owner = nullptr;
+    ast = nullptr;
+    segments.clear();
+    rcg.reset(source);
+    if (!rcg.execute(_err))
+        return false;
+    owner = std::make_shared<tree_owner>();
+    owner->root = std::static_pointer_cast<assembly>(rcg.get_syntax_tree());
+    ast = owner->root.get();
+    owner->def_owners.resize(ast->global_defs.size());
+
+    segments.push_back({0, 1, 0, 0});
+    top_level_scanner scanner(source.data(), source.data() + source.size());
+    top_level_scanner::cut cut;
+    while (scanner.next(cut))
+        segments.push_back({cut.offset, cut.line, cut.column, 0});
+    number_defs(0, segments.size(), 0, ast->global_defs.size());
+    return true;
+}
+
+void incremental_recognizer::number_defs(size_t from, size_t to, size_t first, size_t last)
+{
+    auto &defs = ast->global_defs;
+    size_t def = first;
+    segments[from].first_def = first;
+    for (auto i = from + 1; i < to; ++i)
+    {
+        while (def < last && is_before(*defs[def], segments[i].line, segments[i].column))
+            ++def;
+        segments[i].first_def = def;
+    }
+}
@@ -0,0 +1,91 @@
+#include <c1recognizer/large_stack.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <exception>
+#include <system_error>
+
+#include <pthread.h>
+
+using namespace c1_recognizer;
+
+namespace
+{
+const size_t min_stack_size = size_t(8) << 20;
+const size_t max_stack_size = size_t(1) << 30;
+// Each byte may open a level of nesting ('(', '{', a unary '-'), and a level takes a few hundred bytes of stack.
+const size_t stack_per_source_byte = 512;
+// Left by check_stack() for what runs between two checks, and for the handlers of stack_exhausted.
+const size_t max_stack_reserve = size_t(1) << 20;
+
+struct stack_task
+{
+    const std::function<void()> *task;
+    std::exception_ptr error;
+};
+
+void *run_task(void *arg)
+{
+    auto &t = *static_cast<stack_task *>(arg);
+    try
+    {
+        (*t.task)();
+    }
+    catch (...)
+    {
+        t.error = std::current_exception();
+    }
+    return nullptr;
+}
+}
+
+size_t c1_recognizer::stack_size_for(size_t source_size)
+{
+    if (source_size > (max_stack_size - min_stack_size) / stack_per_source_byte)
+        return max_stack_size;
+    return min_stack_size + source_size * stack_per_source_byte;
+}
+
+void c1_recognizer::run_with_stack(size_t size, const std::function<void()> &task)
+{
+    pthread_attr_t attr;
+    int result = pthread_attr_init(&attr);
+    if (result != 0)
+        throw std::system_error(result, std::generic_category(), "pthread_attr_init");
+    result = pthread_attr_setstacksize(&attr, std::max<size_t>(size, PTHREAD_STACK_MIN));
+    stack_task t{&task, nullptr};
+    pthread_t thread;
+    if (result == 0)
+        result = pthread_create(&thread, &attr, run_task, &t);
+    pthread_attr_destroy(&attr);
+    if (result != 0)
+        throw std::system_error(result, std::generic_category(), "cannot start a thread for the stack");
+    pthread_join(thread, nullptr);
+    if (t.error)
+        std::rethrow_exception(t.error);
+}
+
+stack_exhausted::stack_exhausted() : std::runtime_error("Nesting too deep for the stack") {}
+
+void c1_recognizer::check_stack_limit()
+{
+    char here;
+    auto &stack_limit = c1_recognizer::stack_limit();
+    if (stack_limit == UINTPTR_MAX)
+    {
+        // Stacks grow down on every target this builds for; an unknown stack is never checked.
+        stack_limit = 0;
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0)
+        {
+            void *address;
+            size_t size;
+            if (pthread_attr_getstack(&attr, &address, &size) == 0)
+                stack_limit = reinterpret_cast<uintptr_t>(address) + std::min(size / 4, max_stack_reserve);
+            pthread_attr_destroy(&attr);
+        }
+    }
+    if (reinterpret_cast<uintptr_t>(&here) < stack_limit)
+        throw stack_exhausted();
+}
@@ -0,0 +1,605 @@
+#include <c1recognizer/parser_snapshot.h>
+
+#include <antlr4-runtime.h>
+#include <C1Lexer.h>
+#include <C1Parser.h>
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace c1_recognizer;
+
+using namespace antlr4;
+using namespace antlr4::atn;
+using namespace antlr4::dfa;
+
+// The file is a sequence of 64-bit words in host byte order:
+//
+//   header:      magic, version, ATN fingerprint, number of decisions
+//   semantics:   count, then records; operands always precede the AND/OR referring to them
+//   contexts:    count, then records; parents always precede their children
+//   cache:       count, context ids in the shared context cache
+//   per decision: state count, states, edges count, edges, start states count, start states
+//
+// Records refer to each other by their index in their section. Each DFA state is written as
+//   state number, is accept state, requires full context, prediction,
+//   configs: unique alt, read only, conflicting alts count, alts,
+//            count, then (ATN state, alt, context, reaches into outer context, semantic)
+//   predicates: count, then (semantic, alt)
+// Edges are (source state, symbol, target state) with `error_state` standing for ATNSimulator::ERROR, and start states
+// are (precedence, state), with precedence 0 for non-precedence decisions.
+//
+// DFA states only ever hold SLL configurations, and ATNConfigSet::add recomputes the flags derived from them, so
+// neither is stored. Conflicting alts are only tested up to the decision's number of alternatives: runtime builds
+// disagree on the width of antlrcpp::BitSet, so the bits (and fields) past that aren't safe to touch.
+namespace
+{
+const uint64_t magic = 0x31504e5350524331; // "1CRPSNP1" read as little-endian characters.
+const uint64_t version = 1;
+const uint64_t nil = UINT64_MAX;
+const uint64_t error_state = UINT64_MAX - 1;
+
+enum semantic_kind : uint64_t
+{
+    semantic_none,
+    semantic_predicate,
+    semantic_precedence,
+    semantic_and,
+    semantic_or
+};
+
+enum context_kind : uint64_t
+{
+    context_empty,
+    context_singleton,
+    context_array
+};
+
+// Identifies the ATN a snapshot refers to by states' numbers and types, and their transitions.
+uint64_t atn_fingerprint(const ATN &atn)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+    mix(atn.states.size());
+    for (auto state : atn.states)
+    {
+        if (!state)
+        {
+            mix(nil);
+            continue;
+        }
+        mix(state->getStateType());
+        mix(state->ruleIndex);
+        mix(state->transitions.size());
+        for (auto transition : state->transitions)
+        {
+            mix(transition->getSerializationType());
+            mix(transition->target->stateNumber);
+        }
+    }
+    mix(atn.getNumberOfDecisions());
+    return hash;
+}
+
+// Runs `f` on the simulator all C1Parser instances share, which owns references to the static DFA and cache.
+template <typename F>
+bool with_simulator(F f)
+{
+    ANTLRInputStream input;
+    C1Lexer lexer(&input);
+    CommonTokenStream tokens(&lexer);
+    C1Parser parser(&tokens);
+    return f(*parser.getInterpreter<ParserATNSimulator>());
+}
+
+class snapshot_writer
+{
+  public:
+    uint64_t semantic_id(const Ref<SemanticContext> &semantic)
+    {
+        auto found = semantic_ids.find(semantic.get());
+        if (found != semantic_ids.end())
+            return found->second;
+
+        std::vector<uint64_t> record;
+        if (semantic == SemanticContext::NONE)
+            record = {semantic_none};
+        else if (auto pred = std::dynamic_pointer_cast<SemanticContext::Predicate>(semantic))
+            record = {semantic_predicate, pred->ruleIndex, pred->predIndex, pred->isCtxDependent};
+        else if (auto prec = std::dynamic_pointer_cast<SemanticContext::PrecedencePredicate>(semantic))
+            record = {semantic_precedence, static_cast<uint64_t>(static_cast<int64_t>(prec->precedence))};
+        else
+        {
+            auto op = std::dynamic_pointer_cast<SemanticContext::Operator>(semantic);
+            auto operands = op->getOperands();
+            record = {std::dynamic_pointer_cast<SemanticContext::AND>(semantic) ? semantic_and : semantic_or,
+                      operands.size()};
+            for (auto &operand : operands)
+                record.push_back(semantic_id(operand));
+        }
+        semantics.insert(semantics.end(), record.begin(), record.end());
+        return semantic_ids[semantic.get()] = semantic_count++;
+    }
+
+    uint64_t context_id(const Ref<PredictionContext> &context)
+    {
+        if (!context)
+            return nil;
+        auto found = context_ids.find(context.get());
+        if (found != context_ids.end())
+            return found->second;
+
+        std::vector<uint64_t> record;
+        if (context->isEmpty() && std::dynamic_pointer_cast<EmptyPredictionContext>(context))
+            record = {context_empty};
+        else if (std::dynamic_pointer_cast<SingletonPredictionContext>(context))
+            record = {context_singleton, context_id(context->getParent(0)), context->getReturnState(0)};
+        else
+        {
+            record = {context_array, context->size()};
+            for (size_t i = 0; i < context->size(); ++i)
+            {
+                record.push_back(context_id(context->getParent(i)));
+                record.push_back(context->getReturnState(i));
+            }
+        }
+        contexts.insert(contexts.end(), record.begin(), record.end());
+        return context_ids[context.get()] = context_count++;
+    }
+
+    void write_dfa(const DFA &dfa)
+    {
+        std::unordered_map<const DFAState *, uint64_t> state_ids;
+        auto states = dfa.getStates();
+        for (auto state : states)
+            state_ids.emplace(state, state_ids.size());
+        auto id_of = [&state_ids](const DFAState *state) {
+            return state == ATNSimulator::ERROR.get() ? error_state : state_ids.at(state);
+        };
+
+        auto alternatives = dfa.atnStartState->transitions.size();
+        dfas.push_back(states.size());
+        std::vector<uint64_t> edges;
+        for (auto state : states)
+        {
+            dfas.insert(dfas.end(), {static_cast<uint64_t>(state->stateNumber), state->isAcceptState,
+                                     state->requiresFullContext, state->prediction});
+            auto &configs = *state->configs;
+            std::vector<uint64_t> conflicting_alts;
+            for (size_t alt = 0; alt <= alternatives; ++alt)
+                if (configs.conflictingAlts.test(alt))
+                    conflicting_alts.push_back(alt);
+            dfas.insert(dfas.end(), {configs.uniqueAlt, configs.isReadonly(), conflicting_alts.size()});
+            dfas.insert(dfas.end(), conflicting_alts.begin(), conflicting_alts.end());
+            dfas.push_back(configs.configs.size());
+            for (auto &config : configs.configs)
+                dfas.insert(dfas.end(), {config->state->stateNumber, config->alt, context_id(config->context),
+                                         config->reachesIntoOuterContext, semantic_id(config->semanticContext)});
+            dfas.push_back(state->predicates.size());
+            for (auto prediction : state->predicates)
+                dfas.insert(dfas.end(), {semantic_id(prediction->pred), static_cast<uint64_t>(prediction->alt)});
+            for (auto &edge : state->edges)
+                edges.insert(edges.end(), {state_ids.at(state), edge.first, id_of(edge.second)});
+        }
+        dfas.push_back(edges.size() / 3);
+        dfas.insert(dfas.end(), edges.begin(), edges.end());
+
+        if (dfa.isPrecedenceDfa())
+        {
+            dfas.push_back(dfa.s0->edges.size());
+            for (auto &start : dfa.s0->edges)
+                dfas.insert(dfas.end(), {start.first, id_of(start.second)});
+        }
+        else if (dfa.s0)
+            dfas.insert(dfas.end(), {1, 0, id_of(dfa.s0)});
+        else
+            dfas.push_back(0);
+    }
+
+    std::vector<uint64_t> write(const ATN &atn, const std::vector<DFA> &decisions, const PredictionContextCache &cache)
+    {
+        for (auto &dfa : decisions)
+            write_dfa(dfa);
+        std::vector<uint64_t> cached;
+        for (auto &context : cache)
+            cached.push_back(context_id(context));
+
+        std::vector<uint64_t> words = {magic, version, atn_fingerprint(atn), decisions.size()};
+        words.push_back(semantic_count);
+        words.insert(words.end(), semantics.begin(), semantics.end());
+        words.push_back(context_count);
+        words.insert(words.end(), contexts.begin(), contexts.end());
+        words.push_back(cached.size());
+        words.insert(words.end(), cached.begin(), cached.end());
+        words.insert(words.end(), dfas.begin(), dfas.end());
+        return words;
+    }
+
+  private:
+    std::unordered_map<const SemanticContext *, uint64_t> semantic_ids;
+    std::unordered_map<const PredictionContext *, uint64_t> context_ids;
+    std::vector<uint64_t> semantics, contexts, dfas;
+    uint64_t semantic_count = 0, context_count = 0;
+};
+
+// Thrown while reading a malformed snapshot; never escapes load_words.
+struct malformed_snapshot
+{
+};
+
+class snapshot_reader
+{
+  public:
+    snapshot_reader(const uint64_t *_begin, const uint64_t *_end) : cur(_begin), end(_end) {}
+
+    void load(const ATN &atn, std::vector<DFA> &decisions, PredictionContextCache &cache)
+    {
+        if (next() != magic || next() != version || next() != atn_fingerprint(atn) || next() != decisions.size())
+            throw malformed_snapshot();
+
+        for (auto count = next(); count > 0; --count)
+            semantics.push_back(read_semantic());
+        for (auto count = next(); count > 0; --count)
+            contexts.push_back(read_context());
+        std::vector<Ref<PredictionContext>> cached;
+        for (auto count = next(); count > 0; --count)
+            cached.push_back(context(next()));
+
+        // States are only handed over to the DFA once the whole snapshot has been read.
+        std::vector<dfa_contents> contents(decisions.size());
+        for (size_t i = 0; i < decisions.size(); ++i)
+            read_dfa(atn, decisions[i], contents[i]);
+        if (cur != end)
+            throw malformed_snapshot();
+
+        for (size_t i = 0; i < decisions.size(); ++i)
+            merge(decisions[i], contents[i]);
+        cache.insert(cached.begin(), cached.end());
+    }
+
+  private:
+    uint64_t next()
+    {
+        if (cur == end)
+            throw malformed_snapshot();
+        return *cur++;
+    }
+
+    const Ref<SemanticContext> &semantic(uint64_t id)
+    {
+        if (id >= semantics.size())
+            throw malformed_snapshot();
+        return semantics[id];
+    }
+
+    Ref<PredictionContext> context(uint64_t id)
+    {
+        if (id == nil)
+            return nullptr;
+        if (id >= contexts.size())
+            throw malformed_snapshot();
+        return contexts[id];
+    }
+
+    Ref<SemanticContext> read_semantic()
+    {
+        auto kind = next();
+        switch (kind)
+        {
+        case semantic_none:
+            return SemanticContext::NONE;
+        case semantic_predicate:
+        {
+            auto rule = next();
+            auto pred = next();
+            return std::make_shared<SemanticContext::Predicate>(rule, pred, next() != 0);
+        }
+        case semantic_precedence:
+            return std::make_shared<SemanticContext::PrecedencePredicate>(static_cast<int>(next()));
+        case semantic_and:
+        case semantic_or:
+        {
+            auto count = next();
+            if (count == 0)
+                throw malformed_snapshot();
+            auto result = semantic(next());
+            for (; count > 1; --count)
+                result = kind == semantic_and ? SemanticContext::And(result, semantic(next()))
+                                : SemanticContext::Or(result, semantic(next()));
+            return result;
+        }
+        default:
+            throw malformed_snapshot();
+        }
+    }
+
+    Ref<PredictionContext> read_context()
+    {
+        switch (next())
+        {
+        case context_empty:
+            return PredictionContext::EMPTY;
+        case context_singleton:
+        {
+            auto parent = context(next());
+            return SingletonPredictionContext::create(parent, next());
+        }
+        case context_array:
+        {
+            std::vector<Ref<PredictionContext>> parents;
+            std::vector<size_t> return_states;
+            for (auto count = next(); count > 0; --count)
+            {
+                parents.push_back(context(next()));
+                return_states.push_back(next());
+            }
+            return std::make_shared<ArrayPredictionContext>(parents, return_states);
+        }
+        default:
+            throw malformed_snapshot();
+        }
+    }
+
+    struct dfa_contents
+    {
+        std::vector<std::unique_ptr<DFAState>> states;
+        std::vector<std::tuple<uint64_t, size_t, uint64_t>> edges; // Source, symbol, target.
+        std::vector<std::pair<size_t, uint64_t>> starts;            // Precedence, state.
+    };
+
+    // Adds states the DFA doesn't have yet, and edges and start states it doesn't have yet.
+    static void merge(DFA &dfa, dfa_contents &contents)
+    {
+        std::vector<DFAState *> mapped;
+        bool was_empty = dfa.states.empty();
+        dfa.states.reserve(dfa.states.size() + contents.states.size());
+        for (auto &state : contents.states)
+        {
+            auto found = dfa.states.find(state.get());
+            if (found != dfa.states.end())
+            {
+                mapped.push_back(*found);
+                continue;
+            }
+            if (!was_empty)
+                state->stateNumber = static_cast<int>(dfa.states.size());
+            mapped.push_back(state.get());
+            dfa.states.insert(state.release());
+        }
+
+        auto state = [&mapped](uint64_t id) { return id == error_state ? ATNSimulator::ERROR.get() : mapped[id]; };
+        for (auto &edge : contents.edges)
+            state(std::get<0>(edge))->edges.emplace(std::get<1>(edge), state(std::get<2>(edge)));
+        for (auto &start : contents.starts)
+            if (dfa.isPrecedenceDfa())
+                dfa.s0->edges.emplace(start.first, state(start.second));
+            else if (!dfa.s0)
+                dfa.s0 = state(start.second);
+    }
+
+    void read_dfa(const ATN &atn, const DFA &dfa, dfa_contents &contents)
+    {
+        auto &states = contents.states;
+        auto alternatives = dfa.atnStartState->transitions.size();
+        for (auto count = next(); count > 0; --count)
+        {
+            auto state_number = next();
+            auto is_accept_state = next() != 0;
+            auto requires_full_context = next() != 0;
+            auto prediction = next();
+
+            std::unique_ptr<ATNConfigSet> configs(new ATNConfigSet(false));
+            auto unique_alt = next();
+            auto read_only = next() != 0;
+            for (auto alts = next(); alts > 0; --alts)
+            {
+                auto alt = next();
+                if (alt > alternatives)
+                    throw malformed_snapshot();
+                configs->conflictingAlts.set(alt);
+            }
+            auto configs_count = next();
+            configs->configs.reserve(configs_count);
+            for (; configs_count > 0; --configs_count)
+            {
+                auto atn_state = next();
+                if (atn_state >= atn.states.size())
+                    throw malformed_snapshot();
+                auto alt = next();
+                auto config_context = context(next());
+                auto reaches = next();
+                auto config = std::make_shared<ATNConfig>(atn.states[atn_state], alt, config_context, semantic(next()));
+                config->reachesIntoOuterContext = reaches;
+                configs->add(config);
+            }
+            configs->uniqueAlt = unique_alt;
+            configs->setReadonly(read_only);
+
+            std::unique_ptr<DFAState> state(new DFAState(std::move(configs)));
+            state->stateNumber = static_cast<int>(state_number);
+            state->isAcceptState = is_accept_state;
+            state->requiresFullContext = requires_full_context;
+            state->prediction = prediction;
+            for (auto predicates = next(); predicates > 0; --predicates)
+            {
+                auto &pred = semantic(next());
+                state->predicates.push_back(new DFAState::PredPrediction(pred, static_cast<int>(next())));
+            }
+            states.push_back(std::move(state));
+        }
+
+        auto state = [&states](uint64_t id) {
+            if (id != error_state && id >= states.size())
+                throw malformed_snapshot();
+            return id;
+        };
+        for (auto count = next(); count > 0; --count)
+        {
+            auto source = next();
+            if (source >= states.size())
+                throw malformed_snapshot();
+            auto symbol = next();
+            contents.edges.emplace_back(source, symbol, state(next()));
+        }
+        auto start_count = next();
+        if (!dfa.isPrecedenceDfa() && start_count > 1)
+            throw malformed_snapshot();
+        for (; start_count > 0; --start_count)
+        {
+            auto precedence = next();
+            contents.starts.emplace_back(precedence, state(next()));
+        }
+    }
+
+    const uint64_t *cur;
+    const uint64_t *end;
+    std::vector<Ref<SemanticContext>> semantics;
+    std::vector<Ref<PredictionContext>> contexts;
+};
+
+bool load_words(const uint64_t *begin, const uint64_t *end, const ATN &atn, std::vector<DFA> &decisions,
+                PredictionContextCache &cache)
+{
+    try
+    {
+        snapshot_reader(begin, end).load(atn, decisions, cache);
+        return true;
+    }
+    catch (malformed_snapshot &)
+    {
+        return false;
+    }
+}
+
+// The runtime guards all DFAs in the process with two locks, kept protected in ATNSimulator. They are taken in the same
+// order everywhere here, and the runtime never holds both at once.
+struct dfa_locks : ParserATNSimulator
+{
+    static antlrcpp::SingleWriteMultipleReadLock &states() { return _stateLock; }
+    static antlrcpp::SingleWriteMultipleReadLock &edges() { return _edgeLock; }
+};
+
+struct read_locked
+{
+    read_locked()
+    {
+        dfa_locks::states().readLock();
+        dfa_locks::edges().readLock();
+    }
+    ~read_locked()
+    {
+        dfa_locks::edges().readUnlock();
+        dfa_locks::states().readUnlock();
+    }
+};
+
+struct write_locked
+{
+    write_locked()
+    {
+        dfa_locks::states().writeLock();
+        dfa_locks::edges().writeLock();
+    }
+    ~write_locked()
+    {
+        dfa_locks::edges().writeUnlock();
+        dfa_locks::states().writeUnlock();
+    }
+};
+}
+
+bool c1_recognizer::save_parser_snapshot(const std::string &path)
+{
+    std::vector<uint64_t> words;
+    with_simulator([&words](ParserATNSimulator &simulator) {
+        read_locked locked;
+        words = snapshot_writer().write(simulator.atn, simulator.decisionToDFA, simulator.getSharedContextCache());
+        return true;
+    });
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint64_t));
+    return static_cast<bool>(out);
+}
+
+bool c1_recognizer::load_parser_snapshot(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0 || info.st_size % sizeof(uint64_t) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    auto size = static_cast<size_t>(info.st_size);
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+
+    auto words = static_cast<const uint64_t *>(mapped);
+    bool loaded = with_simulator([words, size](ParserATNSimulator &simulator) {
+        write_locked locked;
+        return load_words(words, words + size / sizeof(uint64_t), simulator.atn, simulator.decisionToDFA,
+                          simulator.getSharedContextCache());
+    });
+    munmap(mapped, size);
+    return loaded;
+}
+
+struct parser_dfa_shard::tables
+{
+    std::vector<DFA> decisions;
+    PredictionContextCache cache;
+};
+
+parser_dfa_shard::parser_dfa_shard() : data(new tables)
+{
+    with_simulator([this](ParserATNSimulator &simulator) {
+        for (size_t i = 0; i < simulator.atn.getNumberOfDecisions(); ++i)
+            data->decisions.emplace_back(simulator.atn.getDecisionState(i), i);
+        return true;
+    });
+}
+
+parser_dfa_shard::~parser_dfa_shard() = default;
+
+ParserATNSimulator *parser_dfa_shard::make_simulator(Parser &parser)
+{
+    return new ParserATNSimulator(&parser, parser.getATN(), data->decisions, data->cache);
+}
+
+void parser_dfa_shard::pull()
+{
+    with_simulator([this](ParserATNSimulator &simulator) {
+        std::vector<uint64_t> words;
+        {
+            read_locked locked;
+            words = snapshot_writer().write(simulator.atn, simulator.decisionToDFA, simulator.getSharedContextCache());
+        }
+        return load_words(words.data(), words.data() + words.size(), simulator.atn, data->decisions, data->cache);
+    });
+}
+
+void parser_dfa_shard::push()
+{
+    with_simulator([this](ParserATNSimulator &simulator) {
+        auto words = snapshot_writer().write(simulator.atn, data->decisions, data->cache);
+        write_locked locked;
+        return load_words(words.data(), words.data() + words.size(), simulator.atn, simulator.decisionToDFA,
+                          simulator.getSharedContextCache());
+    });
+}
@@ -0,0 +1,146 @@
+#include <c1recognizer/reachability.h>
+#include <c1recognizer/static_visitor.h>
+
+#include <vector>
+
+using namespace c1_recognizer::syntax_tree;
+
+namespace
+{
+class reachability_walker : public static_visitor<reachability_walker>
+{
+  public:
+    reachability_walker(semantic_info &_info) : info(_info) {}
+
+    // Walks the bodies of `entry` and of all the functions it reaches.
+    void walk_from(int32_t entry)
+    {
+        reach_function(entry);
+        while (!functions.empty())
+        {
+            auto function = functions.back();
+            functions.pop_back();
+            visit(*function->body);
+        }
+    }
+
+    void visit(var_def_stmt_syntax &node)
+    {
+        for (auto init : node.initializers)
+            reach(*init);
+    }
+
+    void visit(assign_stmt_syntax &node)
+    {
+        reach(*node.target);
+        reach(*node.value);
+    }
+
+    void visit(func_call_stmt_syntax &node) { reach_function(node.slot); }
+
+    void visit(block_syntax &node)
+    {
+        for (auto stmt : node.body)
+            dispatch(*stmt);
+    }
+
+    void visit(if_stmt_syntax &node)
+    {
+        reach(*node.pred->lhs);
+        reach(*node.pred->rhs);
+        dispatch(*node.then_body);
+        if (node.else_body)
+            dispatch(*node.else_body);
+    }
+
+    void visit(while_stmt_syntax &node)
+    {
+        reach(*node.pred->lhs);
+        reach(*node.pred->rhs);
+        dispatch(*node.body);
+    }
+
+    void visit(empty_stmt_syntax &) {}
+
+  private:
+    // Marks the variables `root` reads or assigns. Operands are kept on a stack, as expressions may nest deeply.
+    void reach(expr_syntax &root)
+    {
+        pending.push_back(&root);
+        while (!pending.empty())
+        {
+            auto expr = pending.back();
+            pending.pop_back();
+            if (expr->is_constant)
+                continue;
+            switch (expr->kind)
+            {
+            case node_kind::binop:
+                pending.push_back(static_cast<binop_expr_syntax *>(expr)->rhs);
+                pending.push_back(static_cast<binop_expr_syntax *>(expr)->lhs);
+                break;
+            case node_kind::unaryop:
+                pending.push_back(static_cast<unaryop_expr_syntax *>(expr)->rhs);
+                break;
+            case node_kind::lval:
+            {
+                auto &lval = static_cast<lval_syntax &>(*expr);
+                auto &variable = info.variables[lval.slot];
+                variable.reachable = true;
+                if (variable.is_array)
+                    pending.push_back(lval.array_index);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    void reach_function(int32_t slot)
+    {
+        auto &function = info.functions[slot];
+        if (function.reachable)
+            return;
+        function.reachable = true;
+        if (function.definition)
+            functions.push_back(function.definition);
+    }
+
+    semantic_info &info;
+    std::vector<ptr<func_def_syntax>> functions; // Reached but not walked yet
+    std::vector<ptr<expr_syntax>> pending;
+};
+}
+
+reachability_statistics c1_recognizer::syntax_tree::find_reachable(semantic_info &info, symbol entry)
+{
+    int32_t entry_slot = -1;
+    for (size_t i = 0; i < info.functions.size(); ++i)
+        if (info.functions[i].name == entry && info.functions[i].definition)
+            entry_slot = static_cast<int32_t>(i);
+
+    for (auto &function : info.functions)
+        function.reachable = entry_slot < 0;
+    for (auto &variable : info.variables)
+        variable.reachable = entry_slot < 0 || !variable.is_global;
+    if (entry_slot >= 0)
+    {
+        reachability_walker walker(info);
+        walker.walk_from(entry_slot);
+    }
+
+    reachability_statistics statistics;
+    for (auto &function : info.functions)
+    {
+        ++statistics.functions;
+        statistics.reachable_functions += function.reachable;
+    }
+    for (auto &variable : info.variables)
+        if (variable.is_global)
+        {
+            ++statistics.globals;
+            statistics.reachable_globals += variable.reachable;
+        }
+    return statistics;
+}
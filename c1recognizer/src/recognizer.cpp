@@ -3,8 +3,23 @@
 #include <C1Parser.h>
 #include <c1recognizer/recognizer.h>
 
-#include <c1recognizer/syntax_tree_builder.h>
+#include <c1recognizer/syntax_tree_listener.h>
+#include <c1recognizer/recursive_descent_parser.h>
+#include <c1recognizer/fast_lexer.h>
+#include <c1recognizer/compact_token.h>
+#include <c1recognizer/utf8_char_stream.h>
+#include <c1recognizer/sliding_token_stream.h>
 #include <c1recognizer/error_listener.h>
+#include <c1recognizer/parser_snapshot.h>
+#include <c1recognizer/large_stack.h>
+
+#include <atomic>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace c1_recognizer;
 using namespace syntax_tree;
@@ -12,42 +27,284 @@ using namespace syntax_tree;
 using namespace antlr4;
 using namespace antlrcpp;
 
-recognizer::recognizer(const std::string &input_string) : ast(nullptr)
+namespace
 {
-    input = new ANTLRInputStream(input_string);
-}
+std::atomic<size_t> sll_parses(0);
+std::atomic<size_t> ll_fallbacks(0);
 
-recognizer::recognizer(std::istream &input_stream) : ast(nullptr)
+// C1Lexer making tokens that hold their own text, rather than referring to the char stream for it.
+class copying_lexer : public C1Lexer
 {
-    input = new ANTLRInputStream(input_stream);
+  public:
+    copying_lexer(CharStream *input) : C1Lexer(input) { _factory = std::make_shared<CommonTokenFactory>(true); }
+
+    // The EOF token gets its text here: left empty, CommonToken::getText() would ask the unbuffered stream its size.
+    Token *emitEOF() override
+    {
+        auto input = static_cast<CharStream *>(getInputStream());
+        emit(_factory->create({this, input}, Token::EOF, "<EOF>", Token::DEFAULT_CHANNEL, input->index(),
+                              input->index() - 1, getLine(), getCharPositionInLine()));
+        return token.get();
+    }
+};
+
+// Parses a compilationUnit with C1Parser, reporting syntax errors to `err`. The syntax tree is built by listening to
+// the parser, which doesn't build a parse tree. Returns nullptr on syntax errors.
+std::shared_ptr<assembly> parse_compilation_unit(C1Parser &parser, TokenStream &tokens, bool two_stage, error_reporter &err)
+{
+    auto simulator = parser.getInterpreter<atn::ParserATNSimulator>();
+
+    error_listener listener(err);
+    parser.removeErrorListeners();
+    syntax_tree_listener builder;
+    parser.setBuildParseTree(false);
+    parser.addParseListener(&builder);
+
+    C1Parser::CompilationUnitContext *tree = nullptr;
+    try
+    {
+        if (two_stage)
+        {
+            ++sll_parses;
+            parser.setErrorHandler(std::make_shared<BailErrorStrategy>());
+            simulator->setPredictionMode(atn::PredictionMode::SLL);
+            try
+            {
+                tree = parser.compilationUnit();
+            }
+            catch (ParseCancellationException &)
+            {
+                // Either a real syntax error or an SLL misprediction; full LL tells which, and reports it.
+                ++ll_fallbacks;
+                tokens.seek(0);
+                parser.reset();
+            }
+        }
+
+        if (!tree)
+        {
+            parser.setErrorHandler(std::make_shared<DefaultErrorStrategy>());
+            simulator->setPredictionMode(atn::PredictionMode::LL);
+            parser.addErrorListener(&listener);
+
+            // Change the `exp` to the non-terminal name you want to examine as the top level symbol.
+            // It should be `compilationUnit` for final submission.
+            tree = parser.compilationUnit();
+            // auto tree = parser.exp();
+
+            parser.removeErrorListeners();
+        }
+    }
+    catch (stack_exhausted &e)
+    {
+        auto token = tokens.LT(1);
+        err.error(token->getLine(), token->getCharPositionInLine(), e.what());
+        parser.removeErrorListeners();
+        parser.removeParseListener(&builder);
+        parser.reset();
+        return nullptr;
+    }
+
+    parser.removeParseListener(&builder);
+    return listener.get_errors_count() > 0 ? nullptr : builder.get_syntax_tree();
+}
 }
 
-std::shared_ptr<syntax_tree::syntax_tree_node> recognizer::get_syntax_tree() { return ast; }
+// Lexer and parser objects kept across executions.
+struct recognizer::pipeline
+{
+    pipeline() : input(new utf8_char_stream(nullptr, nullptr)), lexer(input.get()), tokens(&lexer), parser_shard(nullptr)
+    {
+    }
+
+    // Frees the tokens and the rule contexts, which the syntax tree doesn't refer to.
+    void clear()
+    {
+        tokens.setTokenSource(tokens.getTokenSource());
+        if (parser)
+            parser->getTreeTracker().reset();
+    }
 
-recognizer::~recognizer()
+    // Gives `parser` a simulator predicting with `shard`, if any. The parser deletes the simulator it replaces.
+    static void use_dfa_shard(C1Parser &parser, parser_dfa_shard *shard)
+    {
+        if (shard)
+            parser.setInterpreter(shard->make_simulator(parser));
+    }
+
+    std::unique_ptr<utf8_char_stream> input;
+    // Tokens from C1Lexer are packed into an arena rather than allocated one by one.
+    compact_token_lexer<C1Lexer> lexer;
+    std::unique_ptr<fast_lexer> scanner;
+    CommonTokenStream tokens;
+    // Rebuilt whenever the DFA shard changes, since the parser deletes any simulator it is given.
+    std::unique_ptr<C1Parser> parser;
+    parser_dfa_shard *parser_shard;
+};
+
+struct recognizer::mapped_file
 {
-    delete input;
+    mapped_file(void *_data, size_t _size) : data(static_cast<const char *>(_data)), size(_size) {}
+    ~mapped_file() { munmap(const_cast<char *>(data), size); }
+
+    const char *data;
+    size_t size;
+};
+
+recognizer::recognizer(const std::string &input_string)
+    : ast(nullptr), source(input_string), stream(nullptr), streaming(false), start_line(1), start_column(0),
+      lexer(lexer_engine::antlr), engine(parser_engine::antlr), two_stage(false), shard(nullptr) {}
+
+recognizer::recognizer(std::istream &input_stream)
+    : ast(nullptr), stream(&input_stream), streaming(false), start_line(1), start_column(0),
+      lexer(lexer_engine::antlr), engine(parser_engine::antlr), two_stage(false), shard(nullptr) {}
+
+std::unique_ptr<recognizer> recognizer::from_file(const std::string &path)
+{
+    std::unique_ptr<recognizer> rcg(new recognizer(std::string()));
+    rcg->path = path;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return rcg;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        auto data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            rcg->mapped.reset(new mapped_file(data, info.st_size));
+            rcg->path.clear();
+        }
+    }
+    close(fd);
+
+    if (!rcg->mapped)
+    {
+        std::ifstream in(path);
+        if (in)
+        {
+            rcg->source.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            rcg->path.clear();
+        }
+    }
+    return rcg;
 }
 
-bool recognizer::execute(error_reporter &_err)
+void recognizer::reset(const std::string &input_string, size_t line, size_t column)
 {
-    C1Lexer lexer(input);
-    CommonTokenStream tokens(&lexer);
-    C1Parser parser(&tokens);
+    source = input_string;
+    start_line = line;
+    start_column = column;
+    mapped.reset();
+    path.clear();
+    stream = nullptr;
+    ast = nullptr;
+}
 
-    error_listener listener(_err);
-    parser.removeErrorListeners();
-    parser.addErrorListener(&listener);
+void recognizer::set_lexer_engine(lexer_engine _engine) { lexer = _engine; }
+
+void recognizer::set_parser_engine(parser_engine _engine) { engine = _engine; }
+
+void recognizer::set_two_stage_parsing(bool enabled) { two_stage = enabled; }
+
+void recognizer::set_streaming(bool enabled) { streaming = enabled; }
 
-    // Change the `exp` to the non-terminal name you want to examine as the top level symbol.
-    // It should be `compilationUnit` for final submission.
-    auto tree = parser.compilationUnit();
-    // auto tree = parser.exp();
+void recognizer::set_dfa_shard(parser_dfa_shard *_shard) { shard = _shard; }
 
-    if (listener.get_errors_count() > 0)
+recognizer::two_stage_counters recognizer::get_two_stage_counters() { return {sll_parses, ll_fallbacks}; }
+
+std::shared_ptr<syntax_tree::syntax_tree_node> recognizer::get_syntax_tree() { return ast; }
+
+recognizer::~recognizer() {}
+
+bool recognizer::execute(error_reporter &_err)
+{
+    // `path` is only kept while the file it names couldn't be read.
+    if (!path.empty())
+    {
+        _err.error(0, 0, "Cannot read input file '" + path + "'.");
         return false;
+    }
+    if (stream && streaming)
+        return execute_streaming(_err);
+    if (stream)
+    {
+        source.assign(std::istreambuf_iterator<char>(*stream), std::istreambuf_iterator<char>());
+        stream = nullptr;
+    }
 
-    syntax_tree_builder ast_builder(_err);
-    ast = ast_builder(tree);
+    if (!objects)
+        objects.reset(new pipeline);
+    auto &tokens = objects->tokens;
+
+    auto begin = mapped ? mapped->data : source.data();
+    auto end = begin + (mapped ? mapped->size : source.size());
+    if (lexer == lexer_engine::fast)
+    {
+        objects->scanner.reset(new fast_lexer(begin, end, _err));
+        objects->scanner->set_position(start_line, start_column);
+        tokens.setTokenSource(objects->scanner.get());
+    }
+    else
+    {
+        // The lexer rewinds its previous input when given a new one.
+        std::unique_ptr<utf8_char_stream> input(new utf8_char_stream(begin, end));
+        objects->lexer.setInputStream(input.get());
+        objects->lexer.setLine(start_line);
+        objects->lexer.setCharPositionInLine(start_column);
+        objects->input = std::move(input);
+        // Tokens of the previous execution were freed by setTokenSource, before the arena is reused.
+        tokens.setTokenSource(&objects->lexer);
+        objects->lexer.reset_tokens(begin);
+    }
+
+    if (engine == parser_engine::recursive_descent)
+    {
+        recursive_descent_parser parser(tokens, _err);
+        ast = parser();
+        objects->clear();
+        return parser.get_errors_count() == 0;
+    }
+
+    if (!objects->parser || shard != objects->parser_shard)
+    {
+        objects->parser.reset(new C1Parser(&tokens));
+        objects->parser_shard = shard;
+        pipeline::use_dfa_shard(*objects->parser, shard);
+    }
+    auto &parser = *objects->parser;
+    parser.setTokenStream(&tokens);
+
+    auto tree = parse_compilation_unit(parser, tokens, two_stage, _err);
+    if (tree)
+        ast = tree;
+    objects->clear();
+    return tree != nullptr;
+}
+
+bool recognizer::execute_streaming(error_reporter &_err)
+{
+    unbuffered_utf8_stream input(*stream);
+    // Token text must be copied while it is still buffered.
+    copying_lexer lexer(&input);
+    lexer.setLine(start_line);
+    lexer.setCharPositionInLine(start_column);
+
+    if (engine == parser_engine::recursive_descent)
+    {
+        sliding_token_stream tokens(&lexer);
+        recursive_descent_parser parser(tokens, _err);
+        ast = parser();
+        return parser.get_errors_count() == 0;
+    }
+
+    CommonTokenStream tokens(&lexer);
+    C1Parser parser(&tokens);
+    pipeline::use_dfa_shard(parser, shard);
+    auto tree = parse_compilation_unit(parser, tokens, two_stage, _err);
+    if (!tree)
+        return false;
+    ast = tree;
     return true;
 }
@@ -0,0 +1,181 @@
+#include <c1recognizer/recognizer_pool.h>
+#include <c1recognizer/parser_snapshot.h>
+#include <c1recognizer/top_level_scanner.h>
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <sstream>
+
+using namespace c1_recognizer;
+
+namespace
+{
+// Parts are at least this large, so that each is worth a job.
+const size_t min_part_size = 16384;
+}
+
+struct recognizer_pool::worker
+{
+    worker() : rcg(std::string()), pulled(false) {}
+
+    recognizer rcg;
+    parser_dfa_shard shard;
+    bool pulled; // Whether the shard has been seeded from the process-wide DFA, and hence needs pushing back.
+};
+
+recognizer_pool::recognizer_pool(size_t threads)
+    : lexer(lexer_engine::antlr), engine(parser_engine::antlr), two_stage(false), per_thread_dfa(false), batch(0),
+      running(0), stopping(false), sources(nullptr), starts(nullptr), results(nullptr), next_job(0)
+{
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i)
+        workers.emplace_back(new worker);
+    for (auto &w : workers)
+        this->threads.emplace_back(&recognizer_pool::run, this, std::ref(*w));
+}
+
+recognizer_pool::~recognizer_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    batch_started.notify_all();
+    for (auto &t : threads)
+        t.join();
+}
+
+void recognizer_pool::set_lexer_engine(lexer_engine _engine) { lexer = _engine; }
+
+void recognizer_pool::set_parser_engine(parser_engine _engine) { engine = _engine; }
+
+void recognizer_pool::set_two_stage_parsing(bool enabled) { two_stage = enabled; }
+
+void recognizer_pool::set_per_thread_dfa(bool enabled) { per_thread_dfa = enabled; }
+
+std::vector<parse_result> recognizer_pool::parse_all(const std::vector<std::string> &_sources)
+{
+    return run_batch(_sources, nullptr);
+}
+
+parse_result recognizer_pool::parse_split(const std::string &source)
+{
+    size_t min_size = std::max(source.size() / (workers.size() * 4), min_part_size);
+    std::vector<std::string> part_sources;
+    std::vector<position> part_starts{{1, 0}};
+    top_level_scanner scanner(source.data(), source.data() + source.size());
+    top_level_scanner::cut cut;
+    size_t part_begin = 0;
+    while (scanner.next(cut))
+        if (cut.offset - part_begin >= min_size)
+        {
+            part_sources.push_back(source.substr(part_begin, cut.offset - part_begin));
+            part_starts.emplace_back(cut.line, cut.column);
+            part_begin = cut.offset;
+        }
+    if (part_sources.empty())
+        return run_batch({source}, nullptr)[0];
+    part_sources.push_back(source.substr(part_begin));
+
+    auto part_results = run_batch(part_sources, &part_starts);
+
+    // The whole links to the definitions of the parts, so its context keeps theirs.
+    parse_result result;
+    auto context = std::make_shared<syntax_tree::ast_context>();
+    auto whole = context->make<syntax_tree::assembly>();
+    for (auto &part : part_results)
+    {
+        // Either the source has errors, or the scan cut it where it shouldn't; recognizing it whole tells which.
+        if (!part.ast)
+            return run_batch({source}, nullptr)[0];
+        auto defs = static_cast<syntax_tree::assembly *>(part.ast.get());
+        whole->global_defs.insert(whole->global_defs.end(), defs->global_defs.begin(), defs->global_defs.end());
+        context->keep(part.ast);
+        result.errors += part.errors;
+    }
+    // The whole starts where its first part does.
+    whole->line = part_results[0].ast->line;
+    whole->pos = part_results[0].ast->pos;
+    result.ast = std::shared_ptr<syntax_tree::syntax_tree_node>(context, whole);
+    return result;
+}
+
+std::vector<parse_result> recognizer_pool::run_batch(const std::vector<std::string> &_sources,
+                                                     const std::vector<position> *_starts)
+{
+    std::vector<parse_result> batch_results(_sources.size());
+    std::unique_lock<std::mutex> guard(lock);
+    sources = &_sources;
+    starts = _starts;
+    results = &batch_results;
+    next_job = 0;
+    running = workers.size();
+    ++batch;
+    batch_started.notify_all();
+    batch_finished.wait(guard, [this] { return running == 0; });
+    return batch_results;
+}
+
+void recognizer_pool::run(worker &self)
+{
+    size_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            batch_started.wait(guard, [&] { return stopping || batch != seen; });
+            if (stopping)
+                break;
+            seen = batch;
+        }
+
+        auto &rcg = self.rcg;
+        rcg.set_lexer_engine(lexer);
+        rcg.set_parser_engine(engine);
+        rcg.set_two_stage_parsing(two_stage);
+        bool sharded = per_thread_dfa && engine == parser_engine::antlr;
+        rcg.set_dfa_shard(sharded ? &self.shard : nullptr);
+        if (sharded && !self.pulled)
+        {
+            self.shard.pull();
+            self.pulled = true;
+        }
+
+        // Jobs are handed out one at a time, so that a few large sources don't leave the other workers idle.
+        for (size_t i = next_job++; i < sources->size(); i = next_job++)
+        {
+            std::ostringstream errors;
+            error_reporter reporter(errors);
+            auto &result = (*results)[i];
+            // A source the recognizer throws on, such as one with an out of range literal, fails alone; the next
+            // reset() starts the recognizer afresh.
+            try
+            {
+                if (starts)
+                    rcg.reset((*sources)[i], (*starts)[i].first, (*starts)[i].second);
+                else
+                    rcg.reset((*sources)[i]);
+                if (rcg.execute(reporter))
+                    result.ast = rcg.get_syntax_tree();
+            }
+            catch (std::exception &e)
+            {
+                result.ast = nullptr;
+                errors << "Recognizing failed: " << e.what() << std::endl;
+            }
+            catch (...)
+            {
+                result.ast = nullptr;
+                errors << "Recognizing failed." << std::endl;
+            }
+            result.errors = errors.str();
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--running == 0)
+            batch_finished.notify_one();
+    }
+
+    if (self.pulled)
+        self.shard.push();
+}
@@ -0,0 +1,521 @@
+#include <c1recognizer/recursive_descent_parser.h>
+#include <c1recognizer/fast_lexer.h>
+#include <c1recognizer/large_stack.h>
+
+#include <antlr4-runtime.h>
+#include <C1Lexer.h>
+
+using namespace c1_recognizer;
+using namespace c1_recognizer::syntax_tree;
+
+using namespace antlr4;
+
+namespace
+{
+// Thrown on the first syntax error to unwind back to operator().
+struct syntax_error_exception
+{
+};
+
+// Display names of token types, in the same form ANTLR uses in its messages.
+const char *token_names[] = {"<INVALID>", "','", "';'", "'='", "'['", "']'", "'{'", "'}'", "'('", "')'", "'if'",
+                             "'else'", "'while'", "'const'", "'=='", "'!='", "'<'", "'>'", "'<='", "'>='", "'+'",
+                             "'-'", "'*'", "'/'", "'%'", "'int'", "'float'", "'void'", "Identifier", "FloatConst",
+                             "IntConst"};
+
+std::string token_display(Token *token)
+{
+    if (token->getType() == Token::EOF)
+        return "<EOF>";
+    return token->getText();
+}
+}
+
+recursive_descent_parser::recursive_descent_parser(TokenStream &_tokens, error_reporter &_err)
+    : tokens(_tokens), err(_err), count(0), context(nullptr) {}
+
+int recursive_descent_parser::get_errors_count() { return count; }
+
+std::shared_ptr<syntax_tree_node> recursive_descent_parser::operator()()
+{
+    auto owner = std::make_shared<ast_context>();
+    context = owner.get();
+    auto result = context->make<assembly>();
+    try
+    {
+        compilation_unit(*result);
+    }
+    catch (syntax_error_exception &)
+    {
+        return nullptr;
+    }
+    catch (stack_exhausted &e)
+    {
+        auto token = tokens.LT(1);
+        err.error(token->getLine(), token->getCharPositionInLine(), e.what());
+        count++;
+        return nullptr;
+    }
+    return std::shared_ptr<syntax_tree_node>(owner, result);
+}
+
+void recursive_descent_parser::compilation_unit(assembly &result)
+{
+    result.line = tokens.LT(1)->getLine();
+    result.pos = tokens.LT(1)->getCharPositionInLine();
+    do
+    {
+        switch (tokens.LA(1))
+        {
+        case C1Lexer::Const:
+        case C1Lexer::Int:
+        case C1Lexer::Float:
+        {
+            ptr_list<var_def_stmt_syntax> defs;
+            decl(defs);
+            for (auto &def : defs)
+                result.global_defs.push_back(def);
+            break;
+        }
+        case C1Lexer::Void:
+            result.global_defs.push_back(funcdef());
+            break;
+        default:
+            syntax_error("{'const', 'int', 'float', 'void'}");
+        }
+    } while (tokens.LA(1) == C1Lexer::Const || tokens.LA(1) == C1Lexer::Int || tokens.LA(1) == C1Lexer::Float ||
+             tokens.LA(1) == C1Lexer::Void);
+    match(Token::EOF);
+}
+
+void recursive_descent_parser::decl(ptr_list<var_def_stmt_syntax> &result)
+{
+    bool is_constant = tokens.LA(1) == C1Lexer::Const;
+    if (is_constant)
+        tokens.consume();
+
+    bool is_int;
+    if (tokens.LA(1) == C1Lexer::Int)
+        is_int = true;
+    else if (tokens.LA(1) == C1Lexer::Float)
+        is_int = false;
+    else
+        syntax_error("{'int', 'float'}");
+    tokens.consume();
+
+    while (true)
+    {
+        auto def = is_constant ? constdef() : vardef();
+        def->is_int = is_int;
+        result.push_back(def);
+        if (tokens.LA(1) != C1Lexer::Comma)
+            break;
+        tokens.consume();
+    }
+    match(C1Lexer::SemiColon);
+}
+
+ptr<var_def_stmt_syntax> recursive_descent_parser::constdef()
+{
+    auto result = context->make<var_def_stmt_syntax>();
+    auto id = match(C1Lexer::Identifier);
+    result->is_constant = true;
+    result->name = intern(id->getText());
+    result->line = id->getLine();
+    result->pos = id->getCharPositionInLine();
+    if (tokens.LA(1) == C1Lexer::LeftBracket)
+        array_initializers(*result);
+    else
+    {
+        match(C1Lexer::Assign);
+        result->initializers.push_back(exp(0).node);
+    }
+    return result;
+}
+
+ptr<var_def_stmt_syntax> recursive_descent_parser::vardef()
+{
+    auto result = context->make<var_def_stmt_syntax>();
+    auto id = match(C1Lexer::Identifier);
+    result->is_constant = false;
+    result->name = intern(id->getText());
+    result->line = id->getLine();
+    result->pos = id->getCharPositionInLine();
+    if (tokens.LA(1) == C1Lexer::LeftBracket)
+        array_initializers(*result);
+    else if (tokens.LA(1) == C1Lexer::Assign)
+    {
+        tokens.consume();
+        result->initializers.push_back(exp(0).node);
+    }
+    return result;
+}
+
+// Parses `'[' exp? ']' ('=' '{' exp (',' exp)* '}')?`. The initializer list is only optional for variables, and
+// the length is only optional along with an initializer list.
+void recursive_descent_parser::array_initializers(var_def_stmt_syntax &result)
+{
+    match(C1Lexer::LeftBracket);
+    if (starts_exp(tokens.LA(1)))
+        result.array_length = exp(0).node;
+    // Tokens may be gone by the end of the initializer list, see sliding_token_stream.
+    auto right_bracket = match(C1Lexer::RightBracket);
+    int line = right_bracket->getLine();
+    int pos = right_bracket->getCharPositionInLine();
+
+    if (!result.is_constant && result.array_length && tokens.LA(1) != C1Lexer::Assign)
+        return;
+    match(C1Lexer::Assign);
+    match(C1Lexer::LeftBrace);
+    while (true)
+    {
+        // A lone number is packed straight away, so that it never takes a node.
+        auto next = tokens.LA(2);
+        if ((tokens.LA(1) == C1Lexer::IntConst || tokens.LA(1) == C1Lexer::FloatConst) &&
+            (next == C1Lexer::Comma || next == C1Lexer::RightBrace))
+            result.add_initializer(*context, decode_number());
+        else
+            result.add_initializer(*context, exp(0).node);
+        if (tokens.LA(1) != C1Lexer::Comma)
+            break;
+        tokens.consume();
+    }
+    match(C1Lexer::RightBrace);
+
+    if (!result.array_length)
+    {
+        auto len = context->make<literal_syntax>();
+        len->is_int = true;
+        len->intConst = result.initializers_count();
+        len->line = line;
+        len->pos = pos;
+        result.array_length = len;
+    }
+}
+
+ptr<func_def_syntax> recursive_descent_parser::funcdef()
+{
+    auto result = context->make<func_def_syntax>();
+    auto void_token = match(C1Lexer::Void);
+    result->line = void_token->getLine();
+    result->pos = void_token->getCharPositionInLine();
+    result->name = intern(match(C1Lexer::Identifier)->getText());
+    match(C1Lexer::LeftParen);
+    match(C1Lexer::RightParen);
+    result->body = block();
+    return result;
+}
+
+ptr<block_syntax> recursive_descent_parser::block()
+{
+    auto result = context->make<block_syntax>();
+    auto left_brace = match(C1Lexer::LeftBrace);
+    result->line = left_brace->getLine();
+    result->pos = left_brace->getCharPositionInLine();
+    while (true)
+    {
+        switch (tokens.LA(1))
+        {
+        case C1Lexer::Const:
+        case C1Lexer::Int:
+        case C1Lexer::Float:
+        {
+            ptr_list<var_def_stmt_syntax> defs;
+            decl(defs);
+            for (auto &def : defs)
+                result->body.push_back(def);
+            break;
+        }
+        case C1Lexer::SemiColon:
+        case C1Lexer::LeftBrace:
+        case C1Lexer::If:
+        case C1Lexer::While:
+        case C1Lexer::Identifier:
+            result->body.push_back(stmt());
+            break;
+        default:
+            match(C1Lexer::RightBrace);
+            return result;
+        }
+    }
+}
+
+ptr<stmt_syntax> recursive_descent_parser::stmt()
+{
+    check_stack();
+    auto start = tokens.LT(1);
+    int line = start->getLine();
+    int pos = start->getCharPositionInLine();
+    switch (start->getType())
+    {
+    case C1Lexer::Identifier:
+        if (tokens.LA(2) == C1Lexer::LeftParen)
+        {
+            auto result = context->make<func_call_stmt_syntax>();
+            result->name = intern(start->getText());
+            result->line = line;
+            result->pos = pos;
+            tokens.consume();
+            tokens.consume();
+            match(C1Lexer::RightParen);
+            match(C1Lexer::SemiColon);
+            return result;
+        }
+        else
+        {
+            auto result = context->make<assign_stmt_syntax>();
+            result->line = line;
+            result->pos = pos;
+            result->target = lval();
+            match(C1Lexer::Assign);
+            result->value = exp(0).node;
+            match(C1Lexer::SemiColon);
+            return result;
+        }
+    case C1Lexer::LeftBrace:
+        return block();
+    case C1Lexer::If:
+    {
+        auto result = context->make<if_stmt_syntax>();
+        result->line = line;
+        result->pos = pos;
+        tokens.consume();
+        match(C1Lexer::LeftParen);
+        result->pred = cond();
+        match(C1Lexer::RightParen);
+        result->then_body = stmt();
+        // `else` always binds to the innermost `if`.
+        if (tokens.LA(1) == C1Lexer::Else)
+        {
+            tokens.consume();
+            result->else_body = stmt();
+        }
+        return result;
+    }
+    case C1Lexer::While:
+    {
+        auto result = context->make<while_stmt_syntax>();
+        result->line = line;
+        result->pos = pos;
+        tokens.consume();
+        match(C1Lexer::LeftParen);
+        result->pred = cond();
+        match(C1Lexer::RightParen);
+        result->body = stmt();
+        return result;
+    }
+    case C1Lexer::SemiColon:
+    {
+        auto result = context->make<empty_stmt_syntax>();
+        result->line = line;
+        result->pos = pos;
+        tokens.consume();
+        return result;
+    }
+    default:
+        syntax_error("{';', '{', 'if', 'while', Identifier}");
+    }
+}
+
+ptr<lval_syntax> recursive_descent_parser::lval()
+{
+    auto result = context->make<lval_syntax>();
+    auto id = match(C1Lexer::Identifier);
+    result->line = id->getLine();
+    result->pos = id->getCharPositionInLine();
+    result->name = intern(id->getText());
+    if (tokens.LA(1) == C1Lexer::LeftBracket)
+    {
+        tokens.consume();
+        result->array_index = exp(0).node;
+        match(C1Lexer::RightBracket);
+    }
+    return result;
+}
+
+ptr<cond_syntax> recursive_descent_parser::cond()
+{
+    auto result = context->make<cond_syntax>();
+    auto lhs = exp(0);
+    result->line = lhs.line;
+    result->pos = lhs.pos;
+    result->lhs = lhs.node;
+    switch (tokens.LA(1))
+    {
+    case C1Lexer::Equal:
+        result->op = relop::equal;
+        break;
+    case C1Lexer::NonEqual:
+        result->op = relop::non_equal;
+        break;
+    case C1Lexer::Less:
+        result->op = relop::less;
+        break;
+    case C1Lexer::LessEqual:
+        result->op = relop::less_equal;
+        break;
+    case C1Lexer::Greater:
+        result->op = relop::greater;
+        break;
+    case C1Lexer::GreaterEqual:
+        result->op = relop::greater_equal;
+        break;
+    default:
+        syntax_error("{'==', '!=', '<', '>', '<=', '>='}");
+    }
+    tokens.consume();
+    result->rhs = exp(0).node;
+    return result;
+}
+
+// Precedence climbing over the levels C1Parser uses for its left-recursive `exp`:
+// unary `+`/`-` at 6, `*`/`/`/`%` at 5 and binary `+`/`-` at 4, all binary operators being left associative.
+// An operator is only taken if its level is no lower than `precedence`.
+recursive_descent_parser::expr_result recursive_descent_parser::exp(int precedence)
+{
+    check_stack();
+    auto start = tokens.LT(1);
+    expr_result result;
+    result.line = start->getLine();
+    result.pos = start->getCharPositionInLine();
+
+    switch (start->getType())
+    {
+    case C1Lexer::Plus:
+    case C1Lexer::Minus:
+    {
+        auto unary = context->make<unaryop_expr_syntax>();
+        unary->line = result.line;
+        unary->pos = result.pos;
+        unary->op = start->getType() == C1Lexer::Plus ? unaryop::plus : unaryop::minus;
+        tokens.consume();
+        unary->rhs = exp(6).node;
+        result.node = unary;
+        break;
+    }
+    case C1Lexer::LeftParen:
+        // Parentheses produce no node; however the enclosing binop still starts from `(`.
+        tokens.consume();
+        result.node = exp(0).node;
+        match(C1Lexer::RightParen);
+        break;
+    case C1Lexer::Identifier:
+        result.node = lval();
+        break;
+    case C1Lexer::IntConst:
+    case C1Lexer::FloatConst:
+        result.node = number();
+        break;
+    default:
+        syntax_error("{'+', '-', '(', Identifier, FloatConst, IntConst}");
+    }
+
+    while (true)
+    {
+        auto type = tokens.LA(1);
+        int level;
+        if (type == C1Lexer::Multiply || type == C1Lexer::Divide || type == C1Lexer::Modulo)
+            level = 5;
+        else if (type == C1Lexer::Plus || type == C1Lexer::Minus)
+            level = 4;
+        else
+            break;
+        if (level < precedence)
+            break;
+
+        auto binop_result = context->make<binop_expr_syntax>();
+        binop_result->line = result.line;
+        binop_result->pos = result.pos;
+        switch (type)
+        {
+        case C1Lexer::Plus:
+            binop_result->op = binop::plus;
+            break;
+        case C1Lexer::Minus:
+            binop_result->op = binop::minus;
+            break;
+        case C1Lexer::Multiply:
+            binop_result->op = binop::multiply;
+            break;
+        case C1Lexer::Divide:
+            binop_result->op = binop::divide;
+            break;
+        default:
+            binop_result->op = binop::modulo;
+            break;
+        }
+        tokens.consume();
+        binop_result->lhs = result.node;
+        binop_result->rhs = exp(level + 1).node;
+        result.node = binop_result;
+    }
+    return result;
+}
+
+ptr<literal_syntax> recursive_descent_parser::number()
+{
+    return context->make<literal_syntax>(decode_number());
+}
+
+literal_syntax recursive_descent_parser::decode_number()
+{
+    auto token = tokens.LT(1);
+    literal_syntax result;
+    result.line = token->getLine();
+    result.pos = token->getCharPositionInLine();
+    // fast_lexer has already decoded the literal.
+    auto literal = dynamic_cast<literal_token *>(token);
+    if (literal && literal->has_value)
+    {
+        result.is_int = token->getType() == C1Lexer::IntConst;
+        if (result.is_int)
+            result.intConst = literal->int_value;
+        else
+            result.floatConst = literal->float_value;
+        tokens.consume();
+        return result;
+    }
+    auto text = token->getText();
+    if (token->getType() == C1Lexer::IntConst)
+    {
+        result.is_int = true;
+        if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) // Hexadecimal
+            result.intConst = std::stoi(text, nullptr, 16);
+        else if (text[0] == '0') // Octal
+            result.intConst = std::stoi(text, nullptr, 8);
+        else // Decimal
+            result.intConst = std::stoi(text, nullptr, 10);
+    }
+    else
+    {
+        result.is_int = false;
+        result.floatConst = std::stod(text);
+    }
+    tokens.consume();
+    return result;
+}
+
+bool recursive_descent_parser::starts_exp(size_t type)
+{
+    return type == C1Lexer::Plus || type == C1Lexer::Minus || type == C1Lexer::LeftParen ||
+           type == C1Lexer::Identifier || type == C1Lexer::IntConst || type == C1Lexer::FloatConst;
+}
+
+Token *recursive_descent_parser::match(size_t type)
+{
+    auto token = tokens.LT(1);
+    if (token->getType() != type)
+        syntax_error(type == Token::EOF ? "<EOF>" : token_names[type]);
+    if (type != Token::EOF)
+        tokens.consume();
+    return token;
+}
+
+void recursive_descent_parser::syntax_error(const std::string &expecting)
+{
+    auto token = tokens.LT(1);
+    err.error(token->getLine(), token->getCharPositionInLine(),
+              "mismatched input '" + token_display(token) + "' expecting " + expecting);
+    count++;
+    throw syntax_error_exception();
+}
@@ -0,0 +1,458 @@
+#include <c1recognizer/semantic_analysis.h>
+#include <c1recognizer/static_visitor.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace c1_recognizer;
+using namespace c1_recognizer::syntax_tree;
+
+int32_t semantic_info::predeclare_variable(symbol name, value_type type, bool is_constant, bool is_array)
+{
+    variables.push_back({name, type, is_constant, is_array, true, 0, false, 0, nullptr});
+    return static_cast<int32_t>(variables.size() - 1);
+}
+
+int32_t semantic_info::predeclare_function(symbol name)
+{
+    functions.push_back({name, nullptr});
+    return static_cast<int32_t>(functions.size() - 1);
+}
+
+namespace
+{
+// Type both operands are converted to: float if either is.
+value_type common_type(value_type lhs, value_type rhs)
+{
+    if (lhs == value_type::unknown || rhs == value_type::unknown)
+        return value_type::unknown;
+    return lhs == value_type::int_type && rhs == value_type::int_type ? value_type::int_type : value_type::float_type;
+}
+
+// Computes `lhs op rhs` as the generated code would, wrapping around on overflow. Returns false where that has no
+// value: a division by zero, or of the smallest int by -1.
+bool fold(binop op, int32_t lhs, int32_t rhs, int32_t &result)
+{
+    uint32_t l = lhs, r = rhs;
+    switch (op)
+    {
+    case binop::plus:
+        result = static_cast<int32_t>(l + r);
+        return true;
+    case binop::minus:
+        result = static_cast<int32_t>(l - r);
+        return true;
+    case binop::multiply:
+        result = static_cast<int32_t>(l * r);
+        return true;
+    default:
+        if (rhs == 0 || (lhs == INT32_MIN && rhs == -1))
+            return false;
+        result = op == binop::divide ? lhs / rhs : lhs % rhs;
+        return true;
+    }
+}
+
+// Converts the constant `value` of type `from` to `to` as the generated code would. Returns false where that has no
+// value: a float out of the range of int.
+bool convert(double value, value_type from, value_type to, double &result)
+{
+    if (from == value_type::float_type && to == value_type::int_type)
+    {
+        if (!(value > INT32_MIN - 1.0 && value < INT32_MAX + 1.0))
+            return false;
+        value = static_cast<int32_t>(value);
+    }
+    result = value;
+    return true;
+}
+
+// Value of element `index` of the constant array `variable`, if its initializers make it a constant.
+bool element_value(const variable_info &variable, double index, double &value)
+{
+    auto definition = variable.definition;
+    if (!definition || index < 0 || index >= variable.array_length)
+        return false;
+    auto i = static_cast<size_t>(index);
+    auto &literals = definition->literal_initializers;
+    if (i < literals.size())
+        return literals.is_int ? convert(literals.ints[i], value_type::int_type, variable.type, value)
+                               : convert(literals.floats[i], value_type::float_type, variable.type, value);
+    if (i < definition->initializers.size())
+    {
+        auto init = definition->initializers[i];
+        return init->is_constant && convert(init->constant, init->type, variable.type, value);
+    }
+    // Elements past the initializers are zero, except in local arrays with none, which are left uninitialized.
+    if (!variable.is_global && definition->initializers_count() == 0)
+        return false;
+    value = 0;
+    return true;
+}
+
+double fold(binop op, double lhs, double rhs)
+{
+    switch (op)
+    {
+    case binop::plus:
+        return lhs + rhs;
+    case binop::minus:
+        return lhs - rhs;
+    case binop::multiply:
+        return lhs * rhs;
+    default:
+        return lhs / rhs;
+    }
+}
+
+// Variables visible by name. Each name maps to the innermost of the variables it names, which links to the one it
+// shadows; leaving a scope undoes, innermost first, the definitions logged since entering it. Lookups are then one
+// hash lookup however deep the scope, and scopes allocate nothing.
+class scoped_variables
+{
+  public:
+    void enter() { scope_starts.push_back(log.size()); }
+
+    void leave()
+    {
+        for (auto start = scope_starts.back(); log.size() > start; log.pop_back())
+            innermost[log.back().name] = log.back().shadowed;
+        scope_starts.pop_back();
+    }
+
+    // Defines `name` as `slot` in the innermost scope; false if it already names a variable there.
+    bool define(symbol name, int32_t slot)
+    {
+        auto &entry = innermost.emplace(name, -1).first->second;
+        if (entry >= static_cast<int32_t>(scope_starts.back()))
+            return false;
+        log.push_back({name, slot, entry});
+        entry = static_cast<int32_t>(log.size() - 1);
+        return true;
+    }
+
+    // Slot of the variable `name` refers to, or -1.
+    int32_t find(symbol name) const
+    {
+        auto found = innermost.find(name);
+        return found == innermost.end() || found->second < 0 ? -1 : log[found->second].slot;
+    }
+
+  private:
+    struct definition
+    {
+        symbol name;
+        int32_t slot;
+        int32_t shadowed; // Index in `log` of the definition it hides, -1 if none
+    };
+
+    std::unordered_map<symbol, int32_t> innermost; // Index in `log`, -1 once all definitions are undone
+    std::vector<definition> log;
+    std::vector<size_t> scope_starts;
+};
+
+class semantic_analyzer : public static_visitor<semantic_analyzer>
+{
+  public:
+    bool failed = false;
+
+    semantic_analyzer(semantic_info &_info, error_reporter &_err) : info(_info), err(_err)
+    {
+        // Predeclared names share the scope of global definitions, which can't redefine them.
+        scopes.enter();
+        for (size_t i = 0; i < info.variables.size(); ++i)
+            scopes.define(info.variables[i].name, static_cast<int32_t>(i));
+        for (size_t i = 0; i < info.functions.size(); ++i)
+            functions[info.functions[i].name] = static_cast<int32_t>(i);
+    }
+
+    void visit(assembly &node)
+    {
+        for (auto def : node.global_defs)
+            dispatch(*def);
+    }
+
+    void visit(func_def_syntax &node)
+    {
+        if (functions.count(node.name))
+        {
+            error(node, "Function named '" + spelling(node.name) + "' already exists");
+            return;
+        }
+        // Declared before its body, which may call it.
+        node.slot = static_cast<int32_t>(info.functions.size());
+        info.functions.push_back({node.name, &node});
+        functions[node.name] = node.slot;
+
+        in_function = true;
+        visit(*node.body);
+        in_function = false;
+    }
+
+    void visit(cond_syntax &node)
+    {
+        dispatch(*node.lhs);
+        dispatch(*node.rhs);
+        node.operand_type = common_type(node.lhs->type, node.rhs->type);
+        converted(*node.lhs, node.operand_type);
+        converted(*node.rhs, node.operand_type);
+    }
+
+    void visit(binop_expr_syntax &node)
+    {
+        // Left operands are analyzed iteratively, so that a long chain like `a + a + ... + a` doesn't recurse once per
+        // operator.
+        std::vector<binop_expr_syntax *> chain{&node};
+        while (chain.back()->lhs->kind == node_kind::binop)
+            chain.push_back(static_cast<binop_expr_syntax *>(chain.back()->lhs));
+        dispatch(*chain.back()->lhs);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+            apply(**it);
+    }
+
+    void visit(unaryop_expr_syntax &node)
+    {
+        dispatch(*node.rhs);
+        node.type = node.rhs->type;
+        node.is_constant = node.rhs->is_constant;
+        if (!node.is_constant || node.op == unaryop::plus)
+            node.constant = node.rhs->constant;
+        else if (node.type == value_type::int_type)
+            node.constant = static_cast<int32_t>(0u - static_cast<uint32_t>(int32_t(node.rhs->constant)));
+        else
+            node.constant = -node.rhs->constant;
+    }
+
+    void visit(lval_syntax &node) { resolve(node, false); }
+
+    void visit(literal_syntax &node)
+    {
+        node.type = node.is_int ? value_type::int_type : value_type::float_type;
+        node.is_constant = true;
+        node.constant = node.is_int ? node.intConst : node.floatConst;
+    }
+
+    void visit(var_def_stmt_syntax &node)
+    {
+        auto type = node.is_int ? value_type::int_type : value_type::float_type;
+        int32_t length = 0;
+        if (node.array_length)
+        {
+            expect_constant(*node.array_length);
+            if (node.array_length->type == value_type::float_type)
+            {
+                error(node, "Array length must be an integer");
+                return;
+            }
+            if (!node.array_length->is_constant)
+                return;
+            length = static_cast<int32_t>(node.array_length->constant);
+            if (length < 0)
+            {
+                error(node, "Array length must not be negative");
+                return;
+            }
+            if (static_cast<size_t>(length) < node.initializers_count())
+            {
+                error(node, "Array length shorter than the initializer list");
+                return;
+            }
+        }
+
+        // Initializers are analyzed before the variable is declared, so they refer to any variable it hides.
+        for (auto init : node.initializers)
+        {
+            if (in_function)
+                dispatch(*init);
+            else
+                expect_constant(*init);
+            converted(*init, type);
+        }
+        if (node.literal_initializers.is_int != node.is_int)
+            info.conversions += node.literal_initializers.size();
+
+        // The value of a constant scalar, which its reads are replaced with. Local ones without an initializer have
+        // none.
+        bool has_value = false;
+        double value = 0;
+        if (node.is_constant && !node.array_length)
+        {
+            if (node.initializers.empty())
+                has_value = !in_function;
+            else if (node.initializers[0]->is_constant)
+                has_value = convert(node.initializers[0]->constant, node.initializers[0]->type, type, value);
+        }
+
+        auto slot = static_cast<int32_t>(info.variables.size());
+        if (!scopes.define(node.name, slot))
+        {
+            error(node, "Variable named '" + spelling(node.name) + "' already exists");
+            return;
+        }
+        info.variables.push_back({node.name, type, node.is_constant, node.array_length != nullptr, !in_function,
+                                  length, has_value, value, &node});
+        node.slot = slot;
+    }
+
+    void visit(assign_stmt_syntax &node)
+    {
+        dispatch(*node.value);
+        resolve(*node.target, true);
+        converted(*node.value, node.target->type);
+    }
+
+    void visit(func_call_stmt_syntax &node)
+    {
+        auto found = functions.find(node.name);
+        if (found == functions.end())
+            error(node, "No function named '" + spelling(node.name) + "'");
+        else
+            node.slot = found->second;
+    }
+
+    void visit(block_syntax &node)
+    {
+        scopes.enter();
+        for (auto stmt : node.body)
+            dispatch(*stmt);
+        scopes.leave();
+    }
+
+    void visit(if_stmt_syntax &node)
+    {
+        visit(*node.pred);
+        dispatch(*node.then_body);
+        if (node.else_body)
+            dispatch(*node.else_body);
+    }
+
+    void visit(while_stmt_syntax &node)
+    {
+        visit(*node.pred);
+        dispatch(*node.body);
+    }
+
+    void visit(empty_stmt_syntax &) {}
+
+  private:
+    // Types the binary operator `node`, whose left operand is analyzed already, and folds it if both are constant.
+    void apply(binop_expr_syntax &node)
+    {
+        dispatch(*node.rhs);
+        node.type = common_type(node.lhs->type, node.rhs->type);
+        node.is_constant = false;
+        if (node.type == value_type::unknown)
+            return;
+        if (node.op == binop::modulo && node.type == value_type::float_type)
+        {
+            error(node, "Modulo operator not supported on float");
+            node.type = value_type::unknown;
+            return;
+        }
+        converted(*node.lhs, node.type);
+        converted(*node.rhs, node.type);
+        if (!node.lhs->is_constant || !node.rhs->is_constant)
+            return;
+
+        if (node.type == value_type::float_type)
+        {
+            node.is_constant = true;
+            node.constant = fold(node.op, node.lhs->constant, node.rhs->constant);
+            return;
+        }
+        int32_t result;
+        node.is_constant = fold(node.op, static_cast<int32_t>(node.lhs->constant),
+                                static_cast<int32_t>(node.rhs->constant), result);
+        if (node.is_constant)
+            node.constant = result;
+        else if (constant_expected)
+            error(node, "Division by zero or overflow in a constant expression");
+    }
+
+    // Resolves the variable `node` reads, or assigns if `assigned`.
+    void resolve(lval_syntax &node, bool assigned)
+    {
+        node.type = value_type::unknown;
+        node.is_constant = false;
+        auto slot = scopes.find(node.name);
+        if (slot < 0)
+        {
+            error(node, "Unable to access '" + spelling(node.name) + "' in this context");
+            return;
+        }
+        if (assigned && info.variables[slot].is_constant)
+        {
+            error(node, "const value can't be assigned");
+            return;
+        }
+        // An index on a variable that isn't an array is ignored.
+        if (info.variables[slot].is_array)
+        {
+            if (!node.array_index)
+            {
+                error(node, "Expected index but not found");
+                return;
+            }
+            dispatch(*node.array_index);
+            if (node.array_index->type == value_type::float_type)
+            {
+                error(node, "Array index must be an integer");
+                return;
+            }
+        }
+        auto &variable = info.variables[slot];
+        node.slot = slot;
+        node.type = variable.type;
+
+        // Reads of constants are replaced with their values where known, and constant expressions may only read those.
+        bool replaced = !assigned && variable.is_constant;
+        if (replaced && !variable.is_array)
+        {
+            node.is_constant = variable.has_value;
+            node.constant = variable.value;
+        }
+        else if (replaced && node.array_index->is_constant)
+            node.is_constant = element_value(variable, node.array_index->constant, node.constant);
+        // An index that isn't constant is reported already.
+        if (constant_expected && !node.is_constant && (!variable.is_array || node.array_index->is_constant))
+            error(node, "Expected a constexpr but found a left value");
+    }
+
+    // Analyzes `node` where only constant expressions are allowed.
+    void expect_constant(expr_syntax &node)
+    {
+        constant_expected = true;
+        dispatch(node);
+        constant_expected = false;
+    }
+
+    // Counts the conversion of `node` to `type` if there is one.
+    void converted(expr_syntax &node, value_type type)
+    {
+        if (node.type != value_type::unknown && type != value_type::unknown && node.type != type)
+            ++info.conversions;
+    }
+
+    void error(syntax_tree_node &node, const std::string &message)
+    {
+        failed = true;
+        err.error(node.line, node.pos, message);
+    }
+
+    semantic_info &info;
+    error_reporter &err;
+    bool in_function = false;
+    bool constant_expected = false;
+    scoped_variables scopes;
+    std::unordered_map<symbol, int32_t> functions;
+};
+}
+
+bool c1_recognizer::syntax_tree::analyze_semantics(assembly &root, semantic_info &info, error_reporter &err)
+{
+    semantic_analyzer analyzer(info, err);
+    analyzer.visit(root);
+    return !analyzer.failed;
+}
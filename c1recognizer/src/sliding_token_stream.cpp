@@ -0,0 +1,128 @@
+#include <c1recognizer/sliding_token_stream.h>
+
+#include <Exceptions.h>
+#include <RuleContext.h>
+#include <WritableToken.h>
+#include <misc/Interval.h>
+
+#include <algorithm>
+
+using namespace c1_recognizer;
+using namespace antlr4;
+
+sliding_token_stream::sliding_token_stream(TokenSource *_source) : source(_source), start(0), p(0), markers(0) {}
+
+bool sliding_token_stream::available(size_t index)
+{
+    while (start + window.size() <= index)
+    {
+        if (!window.empty() && window.back()->getType() == Token::EOF)
+            return false;
+        auto token = source->nextToken();
+        if (token->getChannel() != Token::DEFAULT_CHANNEL)
+            continue;
+        if (auto writable = dynamic_cast<WritableToken *>(token.get()))
+            writable->setTokenIndex(start + window.size());
+        window.push_back(std::move(token));
+    }
+    return true;
+}
+
+Token *sliding_token_stream::LT(ssize_t k)
+{
+    if (k == 0)
+        return nullptr;
+    if (k < 0)
+    {
+        if (static_cast<size_t>(-k) > p || p - static_cast<size_t>(-k) < start)
+            return nullptr;
+        return window[p + k - start].get();
+    }
+    auto index = p + k - 1;
+    if (!available(index))
+        return window.back().get(); // EOF
+    return window[index - start].get();
+}
+
+Token *sliding_token_stream::get(size_t index) const
+{
+    if (index < start || index >= start + window.size())
+        throw IndexOutOfBoundsException("token index " + std::to_string(index) + " is not buffered");
+    return window[index - start].get();
+}
+
+TokenSource *sliding_token_stream::getTokenSource() const { return source; }
+
+std::string sliding_token_stream::getText(const misc::Interval &interval)
+{
+    if (interval.a < 0 || interval.b < interval.a)
+        return "";
+    std::string text;
+    for (size_t i = interval.a; i <= static_cast<size_t>(interval.b) && available(i); ++i)
+    {
+        auto token = get(i);
+        if (token->getType() == Token::EOF)
+            break;
+        text += token->getText();
+    }
+    return text;
+}
+
+std::string sliding_token_stream::getText()
+{
+    return window.empty() ? "" : getText(misc::Interval(start, start + window.size() - 1));
+}
+
+std::string sliding_token_stream::getText(RuleContext *ctx) { return getText(ctx->getSourceInterval()); }
+
+std::string sliding_token_stream::getText(Token *start, Token *stop)
+{
+    if (!start || !stop)
+        return "";
+    return getText(misc::Interval(start->getTokenIndex(), stop->getTokenIndex()));
+}
+
+void sliding_token_stream::consume()
+{
+    if (LA(1) == Token::EOF)
+        throw IllegalStateException("cannot consume EOF");
+    ++p;
+    // Keep the token just consumed, since parsers commonly look at it right after matching it.
+    while (markers == 0 && start + 1 < p)
+    {
+        window.pop_front();
+        ++start;
+    }
+}
+
+size_t sliding_token_stream::LA(ssize_t i)
+{
+    auto token = LT(i);
+    return token ? token->getType() : Token::INVALID_TYPE;
+}
+
+ssize_t sliding_token_stream::mark() { return -static_cast<ssize_t>(++markers); }
+
+void sliding_token_stream::release(ssize_t marker)
+{
+    if (marker != -static_cast<ssize_t>(markers))
+        throw IllegalStateException("release() called with an invalid marker.");
+    --markers;
+}
+
+size_t sliding_token_stream::index() { return p; }
+
+void sliding_token_stream::seek(size_t index)
+{
+    if (index < start)
+        throw IllegalArgumentException("cannot seek to token " + std::to_string(index) + ", it is no longer buffered");
+    available(index);
+    p = std::min(index, start + window.size() - 1);
+}
+
+size_t sliding_token_stream::size()
+{
+    throw UnsupportedOperationException("Sliding token stream cannot know its size");
+}
+
+std::string sliding_token_stream::getSourceName() const { return source->getSourceName(); }
@@ -0,0 +1,144 @@
+#include <c1recognizer/symbol_table.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace c1_recognizer::syntax_tree;
+
+namespace
+{
+// Open-addressed hash index from spellings to symbols. A slot holds the upper half of the spelling's hash and the
+// symbol plus one, 0 being empty; slots are only ever filled, so readers may probe without the lock.
+struct symbol_index
+{
+    explicit symbol_index(size_t capacity) : mask(capacity - 1), slots(new std::atomic<uint64_t>[capacity]())
+    {
+    }
+    size_t mask;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+};
+
+// Spellings are stored in chunks of growing size that never move: chunk k holds symbols [base * (2^k - 1),
+// base * (2^(k+1) - 1)), so 23 of them cover all 32-bit symbols.
+constexpr size_t chunk_base_bits = 10;
+constexpr size_t chunk_base = size_t(1) << chunk_base_bits;
+constexpr size_t chunks_count = 23;
+
+struct symbol_table
+{
+    // Taken only to add an identifier; lookups of those already interned and spelling() take no lock.
+    std::mutex mutex;
+    std::atomic<symbol_index *> index{nullptr};
+    // Indexes outgrown while readers may still be probing them; kept, as they take less than the current one.
+    std::vector<std::unique_ptr<symbol_index>> indexes;
+    std::atomic<std::string *> chunks[chunks_count] = {};
+    std::atomic<size_t> count{0};
+};
+
+symbol_table &table()
+{
+    // Never destroyed, so that trees released while the process exits may still be read.
+    static auto t = new symbol_table;
+    return *t;
+}
+
+// Chunk holding the spelling of `name`, and its offset there.
+size_t chunk_of(size_t name, size_t &offset)
+{
+    size_t m = name + chunk_base;
+    size_t k = 0;
+    while (m >> (k + chunk_base_bits + 1))
+        ++k;
+    offset = m - (chunk_base << k);
+    return k;
+}
+
+std::string &spelling_slot(symbol_table &t, size_t name)
+{
+    size_t offset;
+    auto k = chunk_of(name, offset);
+    return t.chunks[k].load(std::memory_order_acquire)[offset];
+}
+
+// Symbol of `spelling` with hash `hash` in `index`, or UINT64_MAX if it is not there.
+uint64_t find(symbol_table &t, const symbol_index &index, const std::string &spelling, size_t hash)
+{
+    auto tag = static_cast<uint64_t>(hash >> 32) << 32;
+    for (auto i = hash & index.mask;; i = (i + 1) & index.mask)
+    {
+        auto slot = index.slots[i].load(std::memory_order_acquire);
+        if (!slot)
+            return UINT64_MAX;
+        if ((slot & 0xffffffff00000000) == tag && spelling_slot(t, (slot & 0xffffffff) - 1) == spelling)
+            return (slot & 0xffffffff) - 1;
+    }
+}
+
+void insert(symbol_index &index, uint64_t name, size_t hash)
+{
+    auto i = hash & index.mask;
+    while (index.slots[i].load(std::memory_order_relaxed))
+        i = (i + 1) & index.mask;
+    index.slots[i].store((static_cast<uint64_t>(hash >> 32) << 32) | (name + 1), std::memory_order_release);
+}
+}
+
+symbol c1_recognizer::syntax_tree::intern(const std::string &spelling)
+{
+    auto &t = table();
+    auto hash = std::hash<std::string>()(spelling);
+    // Nearly every token names an identifier seen before.
+    if (auto index = t.index.load(std::memory_order_acquire))
+    {
+        auto found = find(t, *index, spelling, hash);
+        if (found != UINT64_MAX)
+            return static_cast<symbol>(found);
+    }
+
+    std::lock_guard<std::mutex> lock(t.mutex);
+    auto index = t.index.load(std::memory_order_relaxed);
+    if (index)
+    {
+        auto found = find(t, *index, spelling, hash);
+        if (found != UINT64_MAX)
+            return static_cast<symbol>(found);
+    }
+    auto name = t.count.load(std::memory_order_relaxed);
+    if (name > UINT32_MAX)
+        throw std::length_error("too many identifiers for 32-bit symbols");
+
+    size_t offset;
+    auto k = chunk_of(name, offset);
+    if (offset == 0)
+        t.chunks[k].store(new std::string[chunk_base << k], std::memory_order_release);
+    spelling_slot(t, name) = spelling;
+
+    // Kept at most half full; a grown index is filled before it is published.
+    if (!index || (name + 1) * 2 > index->mask + 1)
+    {
+        auto grown = new symbol_index(index ? (index->mask + 1) * 2 : chunk_base);
+        std::hash<std::string> hasher;
+        for (size_t i = 0; i < name; ++i)
+            insert(*grown, i, hasher(spelling_slot(t, i)));
+        t.indexes.emplace_back(grown);
+        index = grown;
+    }
+    insert(*index, name, hash);
+    t.index.store(index, std::memory_order_release);
+    t.count.store(name + 1, std::memory_order_release);
+    return static_cast<symbol>(name);
+}
+
+const std::string &c1_recognizer::syntax_tree::spelling(symbol name)
+{
+    return spelling_slot(table(), name);
+}
+
+size_t c1_recognizer::syntax_tree::symbols_count()
+{
+    return table().count.load(std::memory_order_acquire);
+}
@@ -1,19 +1,85 @@
 
 #include <c1recognizer/syntax_tree.h>
+#include <c1recognizer/large_stack.h>
 
 using namespace c1_recognizer::syntax_tree;
 
+// Visitors recurse into children through accept(); the nodes that nest check the stack for them.
 void assembly::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
 void func_def_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
 void cond_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
-void binop_expr_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
-void unaryop_expr_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
-void lval_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
+void binop_expr_syntax::accept(syntax_tree_visitor &visitor) { check_stack(); visitor.visit(*this); }
+void unaryop_expr_syntax::accept(syntax_tree_visitor &visitor) { check_stack(); visitor.visit(*this); }
+void lval_syntax::accept(syntax_tree_visitor &visitor) { check_stack(); visitor.visit(*this); }
 void literal_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
 void var_def_stmt_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
 void assign_stmt_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
 void func_call_stmt_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
-void block_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
-void if_stmt_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
-void while_stmt_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
+void block_syntax::accept(syntax_tree_visitor &visitor) { check_stack(); visitor.visit(*this); }
+void if_stmt_syntax::accept(syntax_tree_visitor &visitor) { check_stack(); visitor.visit(*this); }
+void while_stmt_syntax::accept(syntax_tree_visitor &visitor) { check_stack(); visitor.visit(*this); }
 void empty_stmt_syntax::accept(syntax_tree_visitor &visitor) { visitor.visit(*this); }
+
+bool literal_list::add(const literal_syntax &literal)
+{
+    if (empty())
+        is_int = literal.is_int;
+    else if (literal.is_int != is_int)
+        return false;
+    if (is_int)
+        ints.push_back(literal.intConst);
+    else
+        floats.push_back(literal.floatConst);
+    positions.push_back({literal.line, literal.pos});
+    return true;
+}
+
+literal_syntax literal_list::at(size_t i) const
+{
+    literal_syntax result;
+    result.line = positions[i].line;
+    result.pos = positions[i].pos;
+    result.is_int = is_int;
+    if (is_int)
+        result.intConst = ints[i];
+    else
+        result.floatConst = floats[i];
+    return result;
+}
+
+void literal_list::unpack(ast_context &context, ptr_list<expr_syntax> &nodes)
+{
+    for (size_t i = 0; i < size(); ++i)
+        nodes.push_back(context.make<literal_syntax>(at(i)));
+    clear();
+}
+
+void literal_list::clear()
+{
+    is_int = true;
+    ints.clear();
+    floats.clear();
+    positions.clear();
+}
+
+void var_def_stmt_syntax::add_initializer(ast_context &context, ptr<expr_syntax> init)
+{
+    if (initializers.empty())
+    {
+        if (init && init->kind == node_kind::literal && literal_initializers.add(*static_cast<literal_syntax *>(init)))
+            return;
+        literal_initializers.unpack(context, initializers);
+    }
+    initializers.push_back(init);
+}
+
+void var_def_stmt_syntax::add_initializer(ast_context &context, const literal_syntax &literal)
+{
+    if (initializers.empty())
+    {
+        if (literal_initializers.add(literal))
+            return;
+        literal_initializers.unpack(context, initializers);
+    }
+    initializers.push_back(context.make<literal_syntax>(literal));
+}
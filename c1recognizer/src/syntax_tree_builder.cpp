@@ -9,7 +9,7 @@ syntax_tree_builder::syntax_tree_builder(error_reporter &_err) : err(_err) {}
 
 antlrcpp::Any syntax_tree_builder::visitCompilationUnit(C1Parser::CompilationUnitContext *ctx)
 {
-    auto result = new assembly;
+    auto result = context->make<assembly>();
     result->line = ctx->getStart()->getLine();
     result->pos = ctx->getStart()->getCharPositionInLine();
     for (auto def : ctx->children)
@@ -18,7 +18,7 @@ antlrcpp::Any syntax_tree_builder::visitCompilationUnit(C1Parser::CompilationUni
         {
             auto defs = visit(decl).as<ptr_list<var_def_stmt_syntax>>();
             for (auto def : defs)
-                result->global_defs.push_back(std::dynamic_pointer_cast<global_def_syntax>(def));
+                result->global_defs.push_back(def);
         }
         else if (auto funcdef = dynamic_cast<C1Parser::FuncdefContext *>(def))
             result->global_defs.push_back(ptr<global_def_syntax>(visit(funcdef).as<func_def_syntax *>()));
@@ -64,9 +64,9 @@ antlrcpp::Any syntax_tree_builder::visitConstdecl(C1Parser::ConstdeclContext *ct
 
 antlrcpp::Any syntax_tree_builder::visitConstdef(C1Parser::ConstdefContext *ctx)
 {
-    auto result = new var_def_stmt_syntax;
+    auto result = context->make<var_def_stmt_syntax>();
     result->is_constant = true;
-    result->name = ctx->Identifier()->getSymbol()->getText();
+    result->name = intern(ctx->Identifier()->getSymbol()->getText());
     result->line = ctx->getStart()->getLine();
     result->pos = ctx->getStart()->getCharPositionInLine();
     if (ctx->LeftBracket())
@@ -76,21 +76,21 @@ antlrcpp::Any syntax_tree_builder::visitConstdef(C1Parser::ConstdefContext *ctx)
         int init_start = 0;
         if (exps.size() == init_length)
         {
-            auto len = new literal_syntax;
+            auto len = context->make<literal_syntax>();
             len->is_int = true;
             len->intConst = init_length;
             len->line = ctx->RightBracket()->getSymbol()->getLine();
             len->pos = ctx->RightBracket()->getSymbol()->getCharPositionInLine();
-            result->array_length.reset(len);
+            result->array_length = len;
         }
         else if (exps.size() == init_length + 1)
         {
-            result->array_length.reset(visit(exps[0]).as<expr_syntax *>());
+            result->array_length = visit(exps[0]).as<expr_syntax *>();
             init_start = 1;
         }
         /*else*/ // Should never happen.
         for (int i = init_start; i < init_start + init_length; ++i)
-            result->initializers.push_back(ptr<expr_syntax>(visit(exps[i]).as<expr_syntax *>()));
+            result->add_initializer(*context, ptr<expr_syntax>(visit(exps[i]).as<expr_syntax *>()));
     }
     else
         result->initializers.push_back(ptr<expr_syntax>(visit(ctx->exp(0)).as<expr_syntax *>()));
@@ -116,9 +116,9 @@ antlrcpp::Any syntax_tree_builder::visitVardecl(C1Parser::VardeclContext *ctx)
 
 antlrcpp::Any syntax_tree_builder::visitVardef(C1Parser::VardefContext *ctx)
 {
-    auto result = new var_def_stmt_syntax;
+    auto result = context->make<var_def_stmt_syntax>();
     result->is_constant = false;
-    result->name = ctx->Identifier()->getSymbol()->getText();
+    result->name = intern(ctx->Identifier()->getSymbol()->getText());
     result->line = ctx->getStart()->getLine();
     result->pos = ctx->getStart()->getCharPositionInLine();
     if (ctx->LeftBracket())
@@ -130,24 +130,24 @@ antlrcpp::Any syntax_tree_builder::visitVardef(C1Parser::VardefContext *ctx)
             int init_start = 0;
             if (exps.size() == init_length)
             {
-                auto len = new literal_syntax;
+                auto len = context->make<literal_syntax>();
                 len->is_int = true;
                 len->intConst = init_length;
                 len->line = ctx->RightBracket()->getSymbol()->getLine();
                 len->pos = ctx->RightBracket()->getSymbol()->getCharPositionInLine();
-                result->array_length.reset(len);
+                result->array_length = len;
             }
             else if (exps.size() == init_length + 1)
             {
-                result->array_length.reset(visit(exps[0]).as<expr_syntax *>());
+                result->array_length = visit(exps[0]).as<expr_syntax *>();
                 init_start = 1;
             }
             /*else*/ // Should never happen.
             for (int i = init_start; i < init_start + init_length; ++i)
-                result->initializers.push_back(ptr<expr_syntax>(visit(exps[i]).as<expr_syntax *>()));
+                result->add_initializer(*context, ptr<expr_syntax>(visit(exps[i]).as<expr_syntax *>()));
         }
         else
-            result->array_length.reset(visit(ctx->exp(0)).as<expr_syntax *>());
+            result->array_length = visit(ctx->exp(0)).as<expr_syntax *>();
     }
     else if (ctx->Assign())
         result->initializers.push_back(ptr<expr_syntax>(visit(ctx->exp(0)).as<expr_syntax *>()));
@@ -156,17 +156,17 @@ antlrcpp::Any syntax_tree_builder::visitVardef(C1Parser::VardefContext *ctx)
 
 antlrcpp::Any syntax_tree_builder::visitFuncdef(C1Parser::FuncdefContext *ctx)
 {
-    auto result = new func_def_syntax;
-    result->name = ctx->Identifier()->getSymbol()->getText();
+    auto result = context->make<func_def_syntax>();
+    result->name = intern(ctx->Identifier()->getSymbol()->getText());
     result->line = ctx->getStart()->getLine();
     result->pos = ctx->getStart()->getCharPositionInLine();
-    result->body.reset(visit(ctx->block()).as<block_syntax *>());
+    result->body = visit(ctx->block()).as<block_syntax *>();
     return result;
 }
 
 antlrcpp::Any syntax_tree_builder::visitBlock(C1Parser::BlockContext *ctx)
 {
-    auto result = new block_syntax;
+    auto result = context->make<block_syntax>();
     result->line = ctx->getStart()->getLine();
     result->pos = ctx->getStart()->getCharPositionInLine();
     for (auto subtree : ctx->children)
@@ -176,7 +176,7 @@ antlrcpp::Any syntax_tree_builder::visitBlock(C1Parser::BlockContext *ctx)
         {
             auto defs = visit(decl).as<ptr_list<var_def_stmt_syntax>>();
             for (auto def : defs)
-                result->body.push_back(std::dynamic_pointer_cast<stmt_syntax>(def));
+                result->body.push_back(def);
         }
     return result;
 }
@@ -185,17 +185,17 @@ antlrcpp::Any syntax_tree_builder::visitStmt(C1Parser::StmtContext *ctx)
 {
     if (auto lval = ctx->lval())
     {
-        auto result = new assign_stmt_syntax;
+        auto result = context->make<assign_stmt_syntax>();
         result->line = ctx->getStart()->getLine();
         result->pos = ctx->getStart()->getCharPositionInLine();
-        result->target.reset(visit(lval).as<lval_syntax *>());
-        result->value.reset(visit(ctx->exp()).as<expr_syntax *>());
+        result->target = visit(lval).as<lval_syntax *>();
+        result->value = visit(ctx->exp()).as<expr_syntax *>();
         return static_cast<stmt_syntax *>(result);
     }
     else if (auto id = ctx->Identifier())
     {
-        auto result = new func_call_stmt_syntax;
-        result->name = id->getSymbol()->getText();
+        auto result = context->make<func_call_stmt_syntax>();
+        result->name = intern(id->getSymbol()->getText());
         result->line = ctx->getStart()->getLine();
         result->pos = ctx->getStart()->getCharPositionInLine();
         return static_cast<stmt_syntax *>(result);
@@ -204,28 +204,28 @@ antlrcpp::Any syntax_tree_builder::visitStmt(C1Parser::StmtContext *ctx)
         return static_cast<stmt_syntax *>(visit(block).as<block_syntax *>());
     else if (ctx->If())
     {
-        auto result = new if_stmt_syntax;
+        auto result = context->make<if_stmt_syntax>();
         result->line = ctx->getStart()->getLine();
         result->pos = ctx->getStart()->getCharPositionInLine();
-        result->pred.reset(visit(ctx->cond()).as<cond_syntax *>());
+        result->pred = visit(ctx->cond()).as<cond_syntax *>();
         auto stmts = ctx->stmt();
-        result->then_body.reset(visit(stmts[0]).as<stmt_syntax *>());
+        result->then_body = visit(stmts[0]).as<stmt_syntax *>();
         if (stmts.size() > 1)
-            result->else_body.reset(visit(stmts[1]).as<stmt_syntax *>());
+            result->else_body = visit(stmts[1]).as<stmt_syntax *>();
         return static_cast<stmt_syntax *>(result);
     }
     else if (ctx->While())
     {
-        auto result = new while_stmt_syntax;
+        auto result = context->make<while_stmt_syntax>();
         result->line = ctx->getStart()->getLine();
         result->pos = ctx->getStart()->getCharPositionInLine();
-        result->pred.reset(visit(ctx->cond()).as<cond_syntax *>());
-        result->body.reset(visit(ctx->stmt(0)).as<stmt_syntax *>());
+        result->pred = visit(ctx->cond()).as<cond_syntax *>();
+        result->body = visit(ctx->stmt(0)).as<stmt_syntax *>();
         return static_cast<stmt_syntax *>(result);
     }
     else
     {
-        auto result = new empty_stmt_syntax;
+        auto result = context->make<empty_stmt_syntax>();
         result->line = ctx->getStart()->getLine();
         result->pos = ctx->getStart()->getCharPositionInLine();
         return static_cast<stmt_syntax *>(result);
@@ -234,21 +234,21 @@ antlrcpp::Any syntax_tree_builder::visitStmt(C1Parser::StmtContext *ctx)
 
 antlrcpp::Any syntax_tree_builder::visitLval(C1Parser::LvalContext *ctx)
 {
-    auto result = new lval_syntax;
+    auto result = context->make<lval_syntax>();
     result->line = ctx->getStart()->getLine();
     result->pos = ctx->getStart()->getCharPositionInLine();
-    result->name = ctx->Identifier()->getSymbol()->getText();
+    result->name = intern(ctx->Identifier()->getSymbol()->getText());
     if (auto e = ctx->exp())
-        result->array_index.reset(visit(e).as<expr_syntax *>());
+        result->array_index = visit(e).as<expr_syntax *>();
     return result;
 }
 
 antlrcpp::Any syntax_tree_builder::visitCond(C1Parser::CondContext *ctx)
 {
-    auto result = new cond_syntax;
+    auto result = context->make<cond_syntax>();
     result->line = ctx->getStart()->getLine();
     result->pos = ctx->getStart()->getCharPositionInLine();
-    result->lhs.reset(visit(ctx->exp(0)).as<expr_syntax *>());
+    result->lhs = visit(ctx->exp(0)).as<expr_syntax *>();
     if (ctx->Equal())
         result->op = relop::equal;
     if (ctx->NonEqual())
@@ -261,7 +261,7 @@ antlrcpp::Any syntax_tree_builder::visitCond(C1Parser::CondContext *ctx)
         result->op = relop::greater;
     if (ctx->GreaterEqual())
         result->op = relop::greater_equal;
-    result->rhs.reset(visit(ctx->exp(1)).as<expr_syntax *>());
+    result->rhs = visit(ctx->exp(1)).as<expr_syntax *>();
     return result;
 }
 
@@ -276,17 +276,17 @@ antlrcpp::Any syntax_tree_builder::visitExp(C1Parser::ExpContext *ctx)
     // Two sub-expressions presented: this indicates it's a expression of binary operator, aka `binop`.
     if (expressions.size() == 2)
     {
-        auto result = new binop_expr_syntax;
+        auto result = context->make<binop_expr_syntax>();
         // Set line and pos.
         result->line = ctx->getStart()->getLine();
         result->pos = ctx->getStart()->getCharPositionInLine();
         // visit(some context) is equivalent to calling corresponding visit method; dispatching is done automatically
         // by ANTLR4 runtime. For this case, it's equivalent to visitExp(expressions[0]).
-        // Use reset to set a new pointer to a std::shared_ptr object. DO NOT use assignment; it won't work.
+        // Children are plain pointers to nodes made in the same ast_context, see syntax_tree.h.
         // Use `.as<Type>()' to get value from antlrcpp::Any object; notice that this Type must match the type used in
         // constructing the Any object, which is constructed from (usually pointer to some derived class of
         // syntax_node, in this case) returning value of the visit call.
-        result->lhs.reset(visit(expressions[0]).as<expr_syntax *>());
+        result->lhs = visit(expressions[0]).as<expr_syntax *>();
         // Check if each token exists.
         // Returnd value of the calling will be nullptr (aka NULL in C) if it isn't there; otherwise non-null pointer.
         if (ctx->Plus())
@@ -299,20 +299,20 @@ antlrcpp::Any syntax_tree_builder::visitExp(C1Parser::ExpContext *ctx)
             result->op = binop::divide;
         if (ctx->Modulo())
             result->op = binop::modulo;
-        result->rhs.reset(visit(expressions[1]).as<expr_syntax *>());
+        result->rhs = visit(expressions[1]).as<expr_syntax *>();
         return static_cast<expr_syntax *>(result);
     }
     // Otherwise, if `+` or `-` presented, it'll be a `unaryop_expr_syntax`.
     if (ctx->Plus() || ctx->Minus())
     {
-        auto result = new unaryop_expr_syntax;
+        auto result = context->make<unaryop_expr_syntax>();
         result->line = ctx->getStart()->getLine();
         result->pos = ctx->getStart()->getCharPositionInLine();
         if (ctx->Plus())
             result->op = unaryop::plus;
         if (ctx->Minus())
             result->op = unaryop::minus;
-        result->rhs.reset(visit(expressions[0]).as<expr_syntax *>());
+        result->rhs = visit(expressions[0]).as<expr_syntax *>();
         return static_cast<expr_syntax *>(result);
     }
     // In the case that `(` exists as a child, this is an expression like `'(' expressions[0] ')'`.
@@ -331,7 +331,7 @@ antlrcpp::Any syntax_tree_builder::visitNumber(C1Parser::NumberContext *ctx)
 {
     if (auto intConst = ctx->IntConst())
     {
-        auto result = new literal_syntax;
+        auto result = context->make<literal_syntax>();
         result->is_int = true;
         result->line = intConst->getSymbol()->getLine();
         result->pos = intConst->getSymbol()->getCharPositionInLine();
@@ -349,7 +349,7 @@ antlrcpp::Any syntax_tree_builder::visitNumber(C1Parser::NumberContext *ctx)
     else
     {
         auto floatConst = ctx->FloatConst(); 
-        auto result = new literal_syntax;
+        auto result = context->make<literal_syntax>();
         result->is_int = false;
         result->line = floatConst->getSymbol()->getLine();
         result->pos = floatConst->getSymbol()->getCharPositionInLine();
@@ -359,42 +359,43 @@ antlrcpp::Any syntax_tree_builder::visitNumber(C1Parser::NumberContext *ctx)
     }
 }
 
-ptr<syntax_tree_node> syntax_tree_builder::operator()(antlr4::tree::ParseTree *ctx)
+std::shared_ptr<syntax_tree_node> syntax_tree_builder::operator()(antlr4::tree::ParseTree *ctx)
 {
+    context = std::make_shared<ast_context>();
     auto result = visit(ctx);
     if (result.is<syntax_tree_node *>())
-        return ptr<syntax_tree_node>(result.as<syntax_tree_node *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<syntax_tree_node *>());
     if (result.is<assembly *>())
-        return ptr<syntax_tree_node>(result.as<assembly *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<assembly *>());
     if (result.is<global_def_syntax *>())
-        return ptr<syntax_tree_node>(result.as<global_def_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<global_def_syntax *>());
     if (result.is<func_def_syntax *>())
-        return ptr<syntax_tree_node>(result.as<func_def_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<func_def_syntax *>());
     if (result.is<cond_syntax *>())
-        return ptr<syntax_tree_node>(result.as<cond_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<cond_syntax *>());
     if (result.is<expr_syntax *>())
-        return ptr<syntax_tree_node>(result.as<expr_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<expr_syntax *>());
     if (result.is<binop_expr_syntax *>())
-        return ptr<syntax_tree_node>(result.as<binop_expr_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<binop_expr_syntax *>());
     if (result.is<unaryop_expr_syntax *>())
-        return ptr<syntax_tree_node>(result.as<unaryop_expr_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<unaryop_expr_syntax *>());
     if (result.is<lval_syntax *>())
-        return ptr<syntax_tree_node>(result.as<lval_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<lval_syntax *>());
     if (result.is<literal_syntax *>())
-        return ptr<syntax_tree_node>(result.as<literal_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<literal_syntax *>());
     if (result.is<stmt_syntax *>())
-        return ptr<syntax_tree_node>(result.as<stmt_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<stmt_syntax *>());
     if (result.is<var_def_stmt_syntax *>())
-        return ptr<syntax_tree_node>(result.as<var_def_stmt_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<var_def_stmt_syntax *>());
     if (result.is<assign_stmt_syntax *>())
-        return ptr<syntax_tree_node>(result.as<assign_stmt_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<assign_stmt_syntax *>());
     if (result.is<func_call_stmt_syntax *>())
-        return ptr<syntax_tree_node>(result.as<func_call_stmt_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<func_call_stmt_syntax *>());
     if (result.is<block_syntax *>())
-        return ptr<syntax_tree_node>(result.as<block_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<block_syntax *>());
     if (result.is<if_stmt_syntax *>())
-        return ptr<syntax_tree_node>(result.as<if_stmt_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<if_stmt_syntax *>());
     if (result.is<while_stmt_syntax *>())
-        return ptr<syntax_tree_node>(result.as<while_stmt_syntax *>());
+        return std::shared_ptr<syntax_tree_node>(context, result.as<while_stmt_syntax *>());
     return nullptr;
 }
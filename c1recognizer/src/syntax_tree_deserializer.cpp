@@ -0,0 +1,674 @@
+#include <c1recognizer/syntax_tree_deserializer.h>
+
+#include <rapidjson/error/en.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/memorystream.h>
+#include <rapidjson/reader.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace c1_recognizer::syntax_tree;
+
+namespace
+{
+// Values of "type".
+enum class node_type : uint8_t
+{
+    assembly,
+    func_def,
+    cond,
+    binop,
+    unaryop,
+    lval,
+    literal,
+    var_def,
+    assign,
+    func_call,
+    block,
+    if_stmt,
+    while_stmt,
+    empty_stmt
+};
+
+// Keys of objects. "value" is a number in literals and an object in assignments; "body" is an array in blocks and an
+// object elsewhere.
+enum class field : uint8_t
+{
+    none,
+    type,
+    line,
+    pos,
+    name,
+    op,
+    is_int,
+    is_const,
+    value,
+    global_defs,
+    body,
+    lhs,
+    rhs,
+    array_index,
+    array_length,
+    array_initializers,
+    vardef_initializer,
+    target,
+    pred,
+    thenbody,
+    elsebody
+};
+
+template <typename T>
+struct named
+{
+    const char *name;
+    T value;
+};
+
+const named<node_type> node_types[] = {
+    {"assembly", node_type::assembly},
+    {"func_def_syntax", node_type::func_def},
+    {"cond_syntax", node_type::cond},
+    {"binop_expr_syntax", node_type::binop},
+    {"unaryop_expr_syntax", node_type::unaryop},
+    {"lval_syntax", node_type::lval},
+    {"literal_syntax", node_type::literal},
+    {"var_def_stmt_syntax", node_type::var_def},
+    {"assign_stmt_syntax", node_type::assign},
+    {"func_call_stmt_syntax", node_type::func_call},
+    {"block_syntax", node_type::block},
+    {"if_stmt_syntax", node_type::if_stmt},
+    {"while_stmt_syntax", node_type::while_stmt},
+    {"empty_stmt_syntax", node_type::empty_stmt}};
+
+const named<field> fields[] = {{"type", field::type},
+                               {"line", field::line},
+                               {"pos", field::pos},
+                               {"name", field::name},
+                               {"op", field::op},
+                               {"is_int", field::is_int},
+                               {"is_const", field::is_const},
+                               {"value", field::value},
+                               {"global_defs", field::global_defs},
+                               {"body", field::body},
+                               {"lhs", field::lhs},
+                               {"rhs", field::rhs},
+                               {"array_index", field::array_index},
+                               {"array_length", field::array_length},
+                               {"array_initializers", field::array_initializers},
+                               {"vardef_initializer", field::vardef_initializer},
+                               {"target", field::target},
+                               {"pred", field::pred},
+                               {"thenbody", field::thenbody},
+                               {"elsebody", field::elsebody}};
+
+// Operators by their value in relop, and in binop and unaryop, which agree on the names they share.
+const char *const relop_names[] = {"equal", "non_equal", "less", "less_equal", "greater", "greater_equal"};
+const char *const arith_names[] = {"plus", "minus", "multiply", "divide", "modulo"};
+
+bool spelled(const char *name, const char *str, size_t length)
+{
+    return std::strlen(name) == length && std::memcmp(name, str, length) == 0;
+}
+
+template <typename T, size_t N>
+bool find(const named<T> (&table)[N], const char *str, size_t length, T &found)
+{
+    for (auto &entry : table)
+        if (spelled(entry.name, str, length))
+        {
+            found = entry.value;
+            return true;
+        }
+    return false;
+}
+
+template <size_t N>
+int find_op(const char *const (&names)[N], const char *str, size_t length)
+{
+    for (size_t i = 0; i < N; ++i)
+        if (spelled(names[i], str, length))
+            return static_cast<int>(i);
+    return -1;
+}
+
+uint32_t bit(field key) { return uint32_t(1) << static_cast<int>(key); }
+
+// A finished object: its node, or a literal kept by value until it is known whether it is packed.
+struct value
+{
+    node_type type;
+    void *node; // Of the class `type` names; nullptr for literals
+    int line;
+    int pos;
+    bool is_int;
+    int int_const;
+    double float_const;
+};
+
+// A finished object waiting for the end of the one holding it, under `key`; `listed` if it is in an array there.
+struct child
+{
+    field key;
+    bool listed;
+    value content;
+};
+
+// An object being read. Its scalars are kept here; its children, as they end, on a stack shared by all open objects
+// from `children_begin` on.
+struct frame
+{
+    size_t children_begin;
+    uint32_t seen = 0; // Bits of the keys read so far
+    field key = field::none;
+    bool in_array = false;
+    bool has_type = false;
+    node_type type = node_type::assembly;
+    int line = 0;
+    int pos = 0;
+    symbol name = 0;
+    int op = -1;
+    bool relational = false;
+    bool is_int = false;
+    bool is_const = false;
+    bool has_int = false;
+    bool has_float = false;
+    int int_const = 0;
+    double float_const = 0;
+};
+
+struct bad_tree
+{
+    std::string message;
+};
+
+// Receives the SAX events of rapidjson::Reader. Nodes are made as their objects end, so children are always made
+// before their parents, and kept on explicit stacks rather than the call stack.
+class tree_handler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, tree_handler>
+{
+  public:
+    tree_handler() : owner(std::make_shared<ast_context>()), context(*owner) {}
+
+    bool StartObject()
+    {
+        if (!frames.empty() && !holds_objects(frames.back().key))
+            return fail("unexpected object");
+        frames.emplace_back();
+        frames.back().children_begin = children.size();
+        return true;
+    }
+
+    bool Key(const char *str, rapidjson::SizeType length, bool)
+    {
+        auto &f = frames.back();
+        if (!find(fields, str, length, f.key))
+            return fail("unknown key '" + std::string(str, length) + "'");
+        if (f.seen & bit(f.key))
+            return fail("duplicate key '" + std::string(str, length) + "'");
+        f.seen |= bit(f.key);
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType)
+    {
+        value made;
+        try
+        {
+            made = make(frames.back());
+        }
+        catch (bad_tree &e)
+        {
+            return fail(e.message);
+        }
+        children.resize(frames.back().children_begin);
+        frames.pop_back();
+        if (frames.empty())
+        {
+            if (made.type != node_type::assembly)
+                return fail("root is not an assembly");
+            result = std::shared_ptr<assembly>(owner, static_cast<assembly *>(made.node));
+        }
+        else
+            children.push_back({frames.back().key, frames.back().in_array, made});
+        return true;
+    }
+
+    bool StartArray()
+    {
+        if (frames.empty() || frames.back().in_array ||
+            (frames.back().key != field::global_defs && frames.back().key != field::body &&
+             frames.back().key != field::array_initializers))
+            return fail("unexpected array");
+        frames.back().in_array = true;
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType)
+    {
+        frames.back().in_array = false;
+        return true;
+    }
+
+    bool String(const char *str, rapidjson::SizeType length, bool)
+    {
+        if (frames.empty() || frames.back().in_array)
+            return fail("unexpected string");
+        auto &f = frames.back();
+        switch (f.key)
+        {
+        case field::type:
+            f.has_type = find(node_types, str, length, f.type);
+            return f.has_type || fail("unknown type '" + std::string(str, length) + "'");
+        case field::name:
+            f.name = intern(std::string(str, length));
+            return true;
+        case field::op:
+            f.op = find_op(relop_names, str, length);
+            f.relational = f.op >= 0;
+            if (!f.relational)
+                f.op = find_op(arith_names, str, length);
+            return f.op >= 0 || fail("unknown operator '" + std::string(str, length) + "'");
+        default:
+            return fail("unexpected string");
+        }
+    }
+
+    bool Bool(bool b)
+    {
+        if (frames.empty() || frames.back().in_array)
+            return fail("unexpected boolean");
+        auto &f = frames.back();
+        if (f.key == field::is_int)
+            f.is_int = b;
+        else if (f.key == field::is_const)
+            f.is_const = b;
+        else
+            return fail("unexpected boolean");
+        return true;
+    }
+
+    bool Int(int i) { return integer(i); }
+    bool Uint(unsigned u) { return integer(u); }
+    bool Int64(int64_t i) { return integer(i); }
+    bool Uint64(uint64_t u) { return integer(u > INT64_MAX ? INT64_MAX : static_cast<int64_t>(u)); }
+
+    bool Double(double d)
+    {
+        if (frames.empty() || frames.back().in_array || frames.back().key != field::value)
+            return fail("unexpected number");
+        frames.back().has_float = true;
+        frames.back().float_const = d;
+        return true;
+    }
+
+    bool Null() { return fail("unexpected null"); }
+
+    std::shared_ptr<assembly> result;
+    std::string problem;
+
+  private:
+    static bool holds_objects(field key) { return key >= field::value; }
+
+    bool fail(const std::string &message)
+    {
+        problem = message;
+        return false;
+    }
+
+    bool integer(int64_t i)
+    {
+        if (frames.empty() || frames.back().in_array)
+            return fail("unexpected number");
+        auto &f = frames.back();
+        if (i < INT_MIN || i > INT_MAX)
+            return fail("number out of range");
+        if (f.key == field::line)
+            f.line = static_cast<int>(i);
+        else if (f.key == field::pos)
+            f.pos = static_cast<int>(i);
+        else if (f.key == field::value)
+        {
+            f.has_int = true;
+            f.int_const = static_cast<int>(i);
+        }
+        else
+            return fail("unexpected number");
+        return true;
+    }
+
+    // Makes the node of the object `f` ends, from its scalars and the children it holds.
+    value make(frame &f)
+    {
+        if (!f.has_type)
+            throw bad_tree{"object without a type"};
+        begin = children.data() + f.children_begin;
+        end = children.data() + children.size();
+        allowed = bit(field::type) | bit(field::line) | bit(field::pos);
+        value result = {f.type, nullptr, f.line, f.pos, false, 0, 0};
+        switch (f.type)
+        {
+        case node_type::assembly:
+        {
+            auto node = located<assembly>(f);
+            for_each_listed(field::global_defs, [&](const value &v) { node->global_defs.push_back(global_def(v)); });
+            result.node = node;
+            break;
+        }
+        case node_type::func_def:
+        {
+            auto node = located<func_def_syntax>(f);
+            node->name = name(f);
+            node->body = block(single(field::body));
+            result.node = node;
+            break;
+        }
+        case node_type::cond:
+        {
+            auto node = located<cond_syntax>(f);
+            node->op = static_cast<relop>(op(f, true, static_cast<int>(relop::greater_equal)));
+            node->lhs = expression(single(field::lhs));
+            node->rhs = expression(single(field::rhs));
+            result.node = node;
+            break;
+        }
+        case node_type::binop:
+        {
+            auto node = located<binop_expr_syntax>(f);
+            node->op = static_cast<binop>(op(f, false, static_cast<int>(binop::modulo)));
+            node->lhs = expression(single(field::lhs));
+            node->rhs = expression(single(field::rhs));
+            result.node = node;
+            break;
+        }
+        case node_type::unaryop:
+        {
+            auto node = located<unaryop_expr_syntax>(f);
+            node->op = static_cast<unaryop>(op(f, false, static_cast<int>(unaryop::minus)));
+            node->rhs = expression(single(field::rhs));
+            result.node = node;
+            break;
+        }
+        case node_type::lval:
+        {
+            auto node = located<lval_syntax>(f);
+            node->name = name(f);
+            if (auto index = optional(field::array_index))
+                node->array_index = expression(*index);
+            result.node = node;
+            break;
+        }
+        case node_type::literal:
+            // Made into a node only once it is known not to be packed.
+            required(f, field::is_int);
+            required(f, field::value);
+            if (f.has_float && f.is_int)
+                throw bad_tree{"float value of an int literal"};
+            if (!f.has_int && !f.has_float)
+                throw bad_tree{"literal without a number"};
+            result.is_int = f.is_int;
+            result.int_const = f.is_int ? f.int_const : 0;
+            result.float_const = f.is_int ? 0 : f.has_float ? f.float_const : f.int_const;
+            break;
+        case node_type::var_def:
+            result.node = var_def(f);
+            break;
+        case node_type::assign:
+        {
+            auto node = located<assign_stmt_syntax>(f);
+            auto &target = single(field::target);
+            if (target.type != node_type::lval)
+                throw bad_tree{"assignment target is not an lval"};
+            node->target = static_cast<lval_syntax *>(target.node);
+            node->value = expression(single(field::value));
+            result.node = node;
+            break;
+        }
+        case node_type::func_call:
+        {
+            auto node = located<func_call_stmt_syntax>(f);
+            node->name = name(f);
+            result.node = node;
+            break;
+        }
+        case node_type::block:
+        {
+            auto node = located<block_syntax>(f);
+            for_each_listed(field::body, [&](const value &v) { node->body.push_back(statement(v)); });
+            result.node = node;
+            break;
+        }
+        case node_type::if_stmt:
+        {
+            auto node = located<if_stmt_syntax>(f);
+            node->pred = condition(single(field::pred));
+            node->then_body = statement(single(field::thenbody));
+            if (auto else_body = optional(field::elsebody))
+                node->else_body = statement(*else_body);
+            result.node = node;
+            break;
+        }
+        case node_type::while_stmt:
+        {
+            auto node = located<while_stmt_syntax>(f);
+            node->pred = condition(single(field::pred));
+            node->body = statement(single(field::body));
+            result.node = node;
+            break;
+        }
+        case node_type::empty_stmt:
+            result.node = located<empty_stmt_syntax>(f);
+            break;
+        }
+        if (f.seen & ~allowed)
+            throw bad_tree{"unexpected key"};
+        return result;
+    }
+
+    // Initializers of arrays are packed as var_def_stmt_syntax::add_initializer() would, without making nodes for
+    // the packed literals.
+    ptr<var_def_stmt_syntax> var_def(frame &f)
+    {
+        auto node = located<var_def_stmt_syntax>(f);
+        node->name = name(f);
+        required(f, field::is_const);
+        required(f, field::is_int);
+        node->is_constant = f.is_const;
+        node->is_int = f.is_int;
+        if (auto length = optional(field::array_length))
+        {
+            node->array_length = expression(*length);
+            for_each_listed(field::array_initializers, [&](const value &v) {
+                if (node->initializers.empty() && v.type == node_type::literal &&
+                    node->literal_initializers.add(literal_of(v)))
+                    return;
+                node->literal_initializers.unpack(context, node->initializers);
+                node->initializers.push_back(expression(v));
+            });
+        }
+        else if (auto init = optional(field::vardef_initializer))
+            node->initializers.push_back(expression(*init));
+        return node;
+    }
+
+    template <typename T>
+    T *located(const frame &f)
+    {
+        auto node = context.make<T>();
+        node->line = f.line;
+        node->pos = f.pos;
+        return node;
+    }
+
+    void required(const frame &f, field key)
+    {
+        if (!(f.seen & bit(key)))
+            throw bad_tree{"missing key '" + std::string(fields[static_cast<int>(key) - 1].name) + "'"};
+        allowed |= bit(key);
+    }
+
+    symbol name(const frame &f)
+    {
+        required(f, field::name);
+        return f.name;
+    }
+
+    int op(const frame &f, bool relational, int last)
+    {
+        required(f, field::op);
+        if (f.relational != relational || f.op > last)
+            throw bad_tree{"operator of another kind"};
+        return f.op;
+    }
+
+    // The child under `key`, or nullptr.
+    const value *optional(field key)
+    {
+        allowed |= bit(key);
+        for (auto c = begin; c != end; ++c)
+            if (c->key == key)
+            {
+                if (c->listed)
+                    throw bad_tree{"unexpected array"};
+                return &c->content;
+            }
+        return nullptr;
+    }
+
+    const value &single(field key)
+    {
+        if (auto found = optional(key))
+            return *found;
+        throw bad_tree{"missing key '" + std::string(fields[static_cast<int>(key) - 1].name) + "'"};
+    }
+
+    // Calls `f` on the children in the array under `key`, which may be missing for an empty list.
+    template <typename F>
+    void for_each_listed(field key, F f)
+    {
+        allowed |= bit(key);
+        for (auto c = begin; c != end; ++c)
+            if (c->key == key)
+            {
+                if (!c->listed)
+                    throw bad_tree{"expected an array"};
+                f(c->content);
+            }
+    }
+
+    static literal_syntax literal_of(const value &v)
+    {
+        literal_syntax literal;
+        literal.line = v.line;
+        literal.pos = v.pos;
+        literal.is_int = v.is_int;
+        literal.intConst = v.int_const;
+        literal.floatConst = v.float_const;
+        return literal;
+    }
+
+    ptr<expr_syntax> expression(const value &v)
+    {
+        switch (v.type)
+        {
+        case node_type::binop:
+            return static_cast<binop_expr_syntax *>(v.node);
+        case node_type::unaryop:
+            return static_cast<unaryop_expr_syntax *>(v.node);
+        case node_type::lval:
+            return static_cast<lval_syntax *>(v.node);
+        case node_type::literal:
+            return context.make<literal_syntax>(literal_of(v));
+        default:
+            throw bad_tree{"expected an expression"};
+        }
+    }
+
+    ptr<stmt_syntax> statement(const value &v)
+    {
+        switch (v.type)
+        {
+        case node_type::var_def:
+            return static_cast<var_def_stmt_syntax *>(v.node);
+        case node_type::assign:
+            return static_cast<assign_stmt_syntax *>(v.node);
+        case node_type::func_call:
+            return static_cast<func_call_stmt_syntax *>(v.node);
+        case node_type::block:
+            return static_cast<block_syntax *>(v.node);
+        case node_type::if_stmt:
+            return static_cast<if_stmt_syntax *>(v.node);
+        case node_type::while_stmt:
+            return static_cast<while_stmt_syntax *>(v.node);
+        case node_type::empty_stmt:
+            return static_cast<empty_stmt_syntax *>(v.node);
+        default:
+            throw bad_tree{"expected a statement"};
+        }
+    }
+
+    ptr<global_def_syntax> global_def(const value &v)
+    {
+        if (v.type == node_type::func_def)
+            return static_cast<func_def_syntax *>(v.node);
+        if (v.type == node_type::var_def)
+            return static_cast<var_def_stmt_syntax *>(v.node);
+        throw bad_tree{"expected a global definition"};
+    }
+
+    ptr<block_syntax> block(const value &v)
+    {
+        if (v.type != node_type::block)
+            throw bad_tree{"expected a block"};
+        return static_cast<block_syntax *>(v.node);
+    }
+
+    ptr<cond_syntax> condition(const value &v)
+    {
+        if (v.type != node_type::cond)
+            throw bad_tree{"expected a condition"};
+        return static_cast<cond_syntax *>(v.node);
+    }
+
+    std::shared_ptr<ast_context> owner;
+    ast_context &context;
+    std::vector<frame> frames;
+    std::vector<child> children;
+    // Children of the object being made, and the keys it may have.
+    const child *begin;
+    const child *end;
+    uint32_t allowed;
+};
+
+// Iterative parsing keeps the call stack flat however deep the JSON nests.
+template <typename Stream>
+std::shared_ptr<assembly> parse(Stream &stream, std::string &error)
+{
+    tree_handler handler;
+    rapidjson::Reader reader;
+    auto outcome = reader.Parse<rapidjson::kParseIterativeFlag>(stream, handler);
+    if (outcome.IsError())
+    {
+        auto message = outcome.Code() == rapidjson::kParseErrorTermination ? handler.problem
+                                                                            : rapidjson::GetParseError_En(outcome.Code());
+        error = "Error at offset " + std::to_string(outcome.Offset()) + ": " + message;
+        return nullptr;
+    }
+    error.clear();
+    return handler.result;
+}
+}
+
+std::shared_ptr<assembly> syntax_tree_deserializer::deserialize(std::istream &in)
+{
+    char buffer[1 << 16];
+    rapidjson::IStreamWrapper stream(in, buffer, sizeof(buffer));
+    return parse(stream, error);
+}
+
+std::shared_ptr<assembly> syntax_tree_deserializer::deserialize(const char *json, size_t size)
+{
+    rapidjson::MemoryStream stream(json, size);
+    return parse(stream, error);
+}
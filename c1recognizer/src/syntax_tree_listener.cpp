@@ -0,0 +1,463 @@
+#include <c1recognizer/syntax_tree_listener.h>
+#include <c1recognizer/large_stack.h>
+
+#include <C1Parser.h>
+
+#include <string>
+
+using namespace c1_recognizer;
+using namespace c1_recognizer::syntax_tree;
+using namespace antlr4;
+
+syntax_tree_listener::syntax_tree_listener() : packing(false), has_pending_literal(false), pending_index(0) {}
+
+template <typename T>
+ptr<T> syntax_tree_listener::pop(std::vector<ptr<T>> &stack, size_t base)
+{
+    if (stack.size() <= base)
+        return nullptr;
+    auto result = stack.back();
+    stack.pop_back();
+    return result;
+}
+
+void syntax_tree_listener::visitTerminal(tree::TerminalNode *node)
+{
+    auto token = node->getSymbol();
+    tokens.push_back(token);
+    // Commas and '}' of a variable definition only end its initializers.
+    auto type = token->getType();
+    if (packing && !frames.empty() &&
+        (frames.back().rule == C1Parser::RuleConstdef || frames.back().rule == C1Parser::RuleVardef) &&
+        (type == C1Parser::Comma || type == C1Parser::RightBrace))
+        pack_initializer(frames.back());
+    else
+        make_pending_literal();
+}
+
+// Tokens skipped by error recovery belong to no rule.
+void syntax_tree_listener::visitErrorNode(tree::ErrorNode *) {}
+
+void syntax_tree_listener::enterEveryRule(ParserRuleContext *ctx)
+{
+    // C1Parser recurses once per rule entered.
+    check_stack();
+    auto rule = ctx->getRuleIndex();
+    // A new parse, possibly after the SLL pass of a two-stage parse bailed out halfway.
+    if (rule == C1Parser::RuleCompilationUnit)
+    {
+        frames.clear();
+        tokens.clear();
+        exprs.clear();
+        lvals.clear();
+        conds.clear();
+        stmts.clear();
+        blocks.clear();
+        defs.clear();
+        globals.clear();
+        context = std::make_shared<ast_context>();
+        result = nullptr;
+        error = nullptr;
+        packing = false;
+        has_pending_literal = false;
+    }
+    make_pending_literal();
+    if (rule == C1Parser::RuleConstdef || rule == C1Parser::RuleVardef)
+    {
+        packed.clear();
+        packing = true;
+    }
+    frames.push_back({rule, tokens.size(), exprs.size(), lvals.size(), stmts.size(), defs.size()});
+}
+
+void syntax_tree_listener::exitEveryRule(ParserRuleContext *ctx)
+{
+    if (frames.empty())
+        return;
+    auto f = frames.back();
+    auto start = ctx->getStart();
+    // Only an exp that is the number alone passes it on untouched.
+    if (f.rule != C1Parser::RuleExp || tokens.size() != f.tokens)
+        make_pending_literal();
+
+    try
+    {
+        switch (f.rule)
+        {
+        case C1Parser::RuleCompilationUnit:
+            exit_compilation_unit(f, start);
+            break;
+        case C1Parser::RuleDecl:
+            exit_decl(f);
+            break;
+        case C1Parser::RuleConstdecl:
+        case C1Parser::RuleVardecl:
+            exit_type_decl(f);
+            break;
+        case C1Parser::RuleConstdef:
+            exit_var_def(f, start, true);
+            break;
+        case C1Parser::RuleVardef:
+            exit_var_def(f, start, false);
+            break;
+        case C1Parser::RuleFuncdef:
+            exit_funcdef(f, start);
+            break;
+        case C1Parser::RuleBlock:
+            exit_block(f, start);
+            break;
+        case C1Parser::RuleStmt:
+            exit_stmt(f, start);
+            break;
+        case C1Parser::RuleLval:
+            exit_lval(f, start);
+            break;
+        case C1Parser::RuleCond:
+            exit_cond(f, start);
+            break;
+        case C1Parser::RuleExp:
+            exit_exp(f, start);
+            break;
+        case C1Parser::RuleNumber:
+            exit_number(f);
+            break;
+        }
+    }
+    catch (...)
+    {
+        if (!error)
+            error = std::current_exception();
+    }
+
+    tokens.resize(f.tokens);
+    frames.pop_back();
+}
+
+std::shared_ptr<assembly> syntax_tree_listener::get_syntax_tree()
+{
+    if (error)
+        std::rethrow_exception(error);
+    if (!result)
+        return nullptr;
+    return std::shared_ptr<assembly>(context, result);
+}
+
+void syntax_tree_listener::exit_compilation_unit(const frame &, Token *start)
+{
+    result = context->make<assembly>();
+    result->line = start->getLine();
+    result->pos = start->getCharPositionInLine();
+    result->global_defs = std::move(globals);
+    globals.clear();
+}
+
+void syntax_tree_listener::exit_decl(const frame &f)
+{
+    // Declarations are global definitions at the top level, and statements in blocks.
+    bool in_block = frames.size() > 1 && frames[frames.size() - 2].rule == C1Parser::RuleBlock;
+    for (auto i = f.defs; i < defs.size(); ++i)
+        if (in_block)
+            stmts.push_back(defs[i]);
+        else
+            globals.push_back(defs[i]);
+    defs.resize(f.defs);
+}
+
+void syntax_tree_listener::exit_type_decl(const frame &f)
+{
+    bool is_int = find_token(f, C1Parser::Int) != nullptr;
+    for (auto i = f.defs; i < defs.size(); ++i)
+        defs[i]->is_int = is_int;
+}
+
+void syntax_tree_listener::exit_var_def(const frame &f, Token *start, bool is_constant)
+{
+    auto result = context->make<var_def_stmt_syntax>();
+    result->is_constant = is_constant;
+    if (auto id = find_token(f, C1Parser::Identifier))
+        result->name = intern(id->getText());
+    result->line = start->getLine();
+    result->pos = start->getCharPositionInLine();
+
+    std::vector<ptr<expr_syntax>> exps(exprs.begin() + f.exprs, exprs.end());
+    exprs.resize(f.exprs);
+    if (packing)
+        std::swap(result->literal_initializers, packed);
+    packing = false;
+    auto right_bracket = find_token(f, C1Parser::RightBracket);
+    bool has_initializers = find_token(f, C1Parser::Assign) != nullptr;
+    if (right_bracket && has_initializers)
+    {
+        size_t init_length = count_tokens(f, C1Parser::Comma) + 1;
+        size_t init_start = 0;
+        size_t listed = exps.size() + result->literal_initializers.size();
+        if (listed == init_length)
+        {
+            auto len = context->make<literal_syntax>();
+            len->is_int = true;
+            len->intConst = init_length;
+            len->line = right_bracket->getLine();
+            len->pos = right_bracket->getCharPositionInLine();
+            result->array_length = len;
+        }
+        else if (listed == init_length + 1)
+        {
+            result->array_length = exps[0];
+            init_start = 1;
+        }
+        for (auto i = init_start; i < init_start + init_length && i < exps.size(); ++i)
+            result->initializers.push_back(exps[i]);
+    }
+    else if (right_bracket)
+        result->array_length = exps.empty() ? nullptr : exps[0];
+    else if (has_initializers && !exps.empty())
+        result->initializers.push_back(exps[0]);
+    defs.push_back(result);
+}
+
+void syntax_tree_listener::exit_funcdef(const frame &f, Token *start)
+{
+    auto result = context->make<func_def_syntax>();
+    if (auto id = find_token(f, C1Parser::Identifier))
+        result->name = intern(id->getText());
+    result->line = start->getLine();
+    result->pos = start->getCharPositionInLine();
+    result->body = pop(blocks);
+    globals.push_back(result);
+}
+
+void syntax_tree_listener::exit_block(const frame &f, Token *start)
+{
+    auto result = context->make<block_syntax>();
+    result->line = start->getLine();
+    result->pos = start->getCharPositionInLine();
+    result->body.assign(stmts.begin() + f.stmts, stmts.end());
+    stmts.resize(f.stmts);
+    blocks.push_back(result);
+}
+
+void syntax_tree_listener::exit_stmt(const frame &f, Token *start)
+{
+    ptr<stmt_syntax> stmt;
+    if (find_token(f, C1Parser::If))
+    {
+        auto result = context->make<if_stmt_syntax>();
+        result->pred = pop(conds);
+        if (stmts.size() > f.stmts + 1)
+            result->else_body = pop(stmts, f.stmts);
+        result->then_body = pop(stmts, f.stmts);
+        stmt = result;
+    }
+    else if (find_token(f, C1Parser::While))
+    {
+        auto result = context->make<while_stmt_syntax>();
+        result->pred = pop(conds);
+        result->body = pop(stmts, f.stmts);
+        stmt = result;
+    }
+    else if (find_token(f, C1Parser::Assign))
+    {
+        auto result = context->make<assign_stmt_syntax>();
+        result->target = pop(lvals, f.lvals);
+        result->value = pop(exprs, f.exprs);
+        stmt = result;
+    }
+    else if (auto id = find_token(f, C1Parser::Identifier))
+    {
+        auto result = context->make<func_call_stmt_syntax>();
+        result->name = intern(id->getText());
+        stmt = result;
+    }
+    // A block is the only statement without terminals of its own.
+    else if (tokens.size() == f.tokens)
+    {
+        stmts.push_back(pop(blocks));
+        return;
+    }
+    else
+        stmt = context->make<empty_stmt_syntax>();
+    stmt->line = start->getLine();
+    stmt->pos = start->getCharPositionInLine();
+    stmts.push_back(stmt);
+}
+
+void syntax_tree_listener::exit_lval(const frame &f, Token *start)
+{
+    auto result = context->make<lval_syntax>();
+    result->line = start->getLine();
+    result->pos = start->getCharPositionInLine();
+    if (auto id = find_token(f, C1Parser::Identifier))
+        result->name = intern(id->getText());
+    if (find_token(f, C1Parser::LeftBracket))
+        result->array_index = pop(exprs, f.exprs);
+    lvals.push_back(result);
+}
+
+void syntax_tree_listener::exit_cond(const frame &f, Token *start)
+{
+    auto result = context->make<cond_syntax>();
+    result->line = start->getLine();
+    result->pos = start->getCharPositionInLine();
+    result->rhs = pop(exprs, f.exprs);
+    result->lhs = pop(exprs, f.exprs);
+    for (auto i = f.tokens; i < tokens.size(); ++i)
+        switch (tokens[i]->getType())
+        {
+        case C1Parser::Equal:
+            result->op = relop::equal;
+            break;
+        case C1Parser::NonEqual:
+            result->op = relop::non_equal;
+            break;
+        case C1Parser::Less:
+            result->op = relop::less;
+            break;
+        case C1Parser::LessEqual:
+            result->op = relop::less_equal;
+            break;
+        case C1Parser::Greater:
+            result->op = relop::greater;
+            break;
+        case C1Parser::GreaterEqual:
+            result->op = relop::greater_equal;
+            break;
+        }
+    conds.push_back(result);
+}
+
+// A left-recursive exp is entered again for each binary operator, after the parser exits the context of the left
+// operand; the left operand is therefore below this rule's part of the stack. Unary operators are the first token of
+// their context, whereas binary ones follow their left operand.
+void syntax_tree_listener::exit_exp(const frame &f, Token *start)
+{
+    if (tokens.size() == f.tokens)
+    {
+        // An lval or a number, the latter already being an expression.
+        if (lvals.size() > f.lvals)
+            exprs.push_back(pop(lvals));
+        return;
+    }
+
+    auto op = tokens[f.tokens];
+    if (op->getType() == C1Parser::LeftParen)
+        return;
+    if (op == start)
+    {
+        auto result = context->make<unaryop_expr_syntax>();
+        result->line = start->getLine();
+        result->pos = start->getCharPositionInLine();
+        result->op = op->getType() == C1Parser::Plus ? unaryop::plus : unaryop::minus;
+        result->rhs = pop(exprs, f.exprs);
+        exprs.push_back(result);
+        return;
+    }
+
+    auto result = context->make<binop_expr_syntax>();
+    result->line = start->getLine();
+    result->pos = start->getCharPositionInLine();
+    switch (op->getType())
+    {
+    case C1Parser::Plus:
+        result->op = binop::plus;
+        break;
+    case C1Parser::Minus:
+        result->op = binop::minus;
+        break;
+    case C1Parser::Multiply:
+        result->op = binop::multiply;
+        break;
+    case C1Parser::Divide:
+        result->op = binop::divide;
+        break;
+    case C1Parser::Modulo:
+        result->op = binop::modulo;
+        break;
+    }
+    result->rhs = pop(exprs, f.exprs);
+    result->lhs = pop(exprs);
+    exprs.push_back(result);
+}
+
+void syntax_tree_listener::exit_number(const frame &f)
+{
+    if (tokens.size() == f.tokens)
+    {
+        exprs.push_back(nullptr);
+        return;
+    }
+    auto token = tokens[f.tokens];
+    literal_syntax result;
+    result.line = token->getLine();
+    result.pos = token->getCharPositionInLine();
+    auto text = token->getText();
+    if (token->getType() == C1Parser::IntConst)
+    {
+        result.is_int = true;
+        if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) // Hexadecimal
+            result.intConst = std::stoi(text, nullptr, 16);
+        else if (text[0] == '0') // Octal
+            result.intConst = std::stoi(text, nullptr, 8);
+        else // Decimal
+            result.intConst = std::stoi(text, nullptr, 10);
+    }
+    else
+    {
+        result.is_int = false;
+        result.floatConst = std::stod(text);
+    }
+    if (!packing)
+    {
+        exprs.push_back(context->make<literal_syntax>(result));
+        return;
+    }
+    pending_literal = result;
+    has_pending_literal = true;
+    pending_index = exprs.size();
+    exprs.push_back(nullptr);
+}
+
+void syntax_tree_listener::pack_initializer(const frame &f)
+{
+    // The initializer is on top, above the array length if any.
+    if (has_pending_literal && pending_index + 1 == exprs.size() && pending_index >= f.exprs &&
+        packed.add(pending_literal))
+    {
+        exprs.pop_back();
+        has_pending_literal = false;
+        return;
+    }
+    make_pending_literal();
+    ptr<expr_syntax> init;
+    if (exprs.size() > f.exprs)
+        init = pop(exprs);
+    packed.unpack(*context, exprs);
+    if (init)
+        exprs.push_back(init);
+    packing = false;
+}
+
+void syntax_tree_listener::make_pending_literal()
+{
+    if (!has_pending_literal)
+        return;
+    has_pending_literal = false;
+    if (pending_index < exprs.size())
+        exprs[pending_index] = context->make<literal_syntax>(pending_literal);
+}
+
+Token *syntax_tree_listener::find_token(const frame &f, size_t type)
+{
+    for (auto i = f.tokens; i < tokens.size(); ++i)
+        if (tokens[i]->getType() == type)
+            return tokens[i];
+    return nullptr;
+}
+
+size_t syntax_tree_listener::count_tokens(const frame &f, size_t type)
+{
+    size_t count = 0;
+    for (auto i = f.tokens; i < tokens.size(); ++i)
+        if (tokens[i]->getType() == type)
+            ++count;
+    return count;
+}
@@ -0,0 +1,103 @@
+#include <c1recognizer/top_level_scanner.h>
+
+using namespace c1_recognizer;
+
+top_level_scanner::top_level_scanner(const char *_begin, const char *_end, size_t _line, size_t _column)
+    : begin(_begin), cur(_begin), end(_end), line(_line), line_start(_begin), line_start_column(_column), depth(0),
+      in_body(false), last(0) {}
+
+bool top_level_scanner::next(cut &result)
+{
+    bool found = false;
+    for (; cur < end; ++cur)
+    {
+        char c = *cur;
+        if (c == '\n')
+        {
+            new_line(cur);
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r' || (c == '/' && skip_comment()))
+            continue;
+        // Code follows the cut found; it's scanned on the next call.
+        if (found)
+            return true;
+
+        bool ends_definition = false;
+        if (c == '{')
+        {
+            if (depth == 0)
+                in_body = last == ')';
+            ++depth;
+        }
+        else if (c == '}' && depth > 0)
+            ends_definition = --depth == 0 && in_body;
+        else if (c == ';')
+            ends_definition = depth == 0;
+        last = c;
+
+        if (ends_definition)
+        {
+            result = {static_cast<size_t>(cur + 1 - begin), line, column_at(cur + 1)};
+            found = true;
+        }
+    }
+    return false;
+}
+
+bool top_level_scanner::skip_comment()
+{
+    const char *p = cur + 1;
+    if (p < end && *p == '*')
+    {
+        // An unterminated comment runs to the end.
+        for (++p; p + 1 < end && !(p[0] == '*' && p[1] == '/'); ++p)
+            if (*p == '\n')
+                new_line(p);
+        cur = p + 1 < end ? p + 1 : end - 1;
+        return true;
+    }
+
+    // '/\' newline '/' starts a line comment too.
+    if (p < end && *p == '\\')
+    {
+        const char *q = p + 1;
+        if (q < end && *q == '\r')
+            ++q;
+        if (!(q + 1 < end && q[0] == '\n' && q[1] == '/'))
+            return false;
+        new_line(q);
+        p = q + 1;
+    }
+    else if (!(p < end && *p == '/'))
+        return false;
+
+    // A backslash escapes the newline after it.
+    for (++p; p < end && *p != '\n'; ++p)
+        if (*p == '\\')
+        {
+            if (p + 1 < end && p[1] == '\r')
+                ++p;
+            if (p + 1 < end && p[1] == '\n')
+                new_line(++p);
+        }
+    if (p < end)
+        new_line(p);
+    cur = p < end ? p : end - 1;
+    return true;
+}
+
+void top_level_scanner::new_line(const char *p)
+{
+    ++line;
+    line_start = p + 1;
+    line_start_column = 0;
+}
+
+size_t top_level_scanner::column_at(const char *p) const
+{
+    size_t column = line_start_column;
+    for (auto q = line_start; q < p; ++q)
+        column += (static_cast<unsigned char>(*q) & 0xC0) != 0x80;
+    return column;
+}
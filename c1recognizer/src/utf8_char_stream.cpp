@@ -0,0 +1,234 @@
+#include <c1recognizer/utf8_char_stream.h>
+
+#include <Exceptions.h>
+#include <misc/Interval.h>
+
+#include <algorithm>
+
+using namespace c1_recognizer;
+using namespace antlr4;
+
+namespace
+{
+const size_t replacement_character = 0xFFFD;
+const size_t chunk_size = 4096;
+
+inline bool is_continuation_byte(char c) { return (static_cast<unsigned char>(c) & 0xC0) == 0x80; }
+
+// A code point spans its lead byte and the continuation bytes after it; ASCII never has any.
+const char *next_code_point(const char *p, const char *end)
+{
+    if (static_cast<unsigned char>(*p) < 0x80)
+        return p + 1;
+    ++p;
+    while (p < end && is_continuation_byte(*p))
+        ++p;
+    return p;
+}
+
+const char *previous_code_point(const char *begin, const char *p)
+{
+    --p;
+    while (p > begin && is_continuation_byte(*p) && static_cast<unsigned char>(p[-1]) >= 0x80)
+        --p;
+    return p;
+}
+
+size_t decode(const char *p, const char *end)
+{
+    auto lead = static_cast<unsigned char>(*p);
+    size_t length = end - p;
+    size_t value;
+    if (lead < 0x80)
+        return lead;
+    if ((lead & 0xE0) == 0xC0 && length == 2)
+        value = lead & 0x1F;
+    else if ((lead & 0xF0) == 0xE0 && length == 3)
+        value = lead & 0x0F;
+    else if ((lead & 0xF8) == 0xF0 && length == 4)
+        value = lead & 0x07;
+    else
+        return replacement_character;
+    for (++p; p < end; ++p)
+        value = (value << 6) | (*p & 0x3F);
+    return value;
+}
+
+std::string source_name(const std::string &name) { return name.empty() ? IntStream::UNKNOWN_SOURCE_NAME : name; }
+}
+
+utf8_char_stream::utf8_char_stream(const char *_begin, const char *_end, const std::string &_name)
+    : begin(_begin), end(_end), cur(_begin), name(_name) {}
+
+void utf8_char_stream::consume()
+{
+    if (cur >= end)
+        throw IllegalStateException("cannot consume EOF");
+    cur = next_code_point(cur, end);
+}
+
+size_t utf8_char_stream::LA(ssize_t i)
+{
+    if (i == 0)
+        return 0; // Undefined.
+    auto p = cur;
+    if (i > 0)
+    {
+        for (; i > 1 && p < end; --i)
+            p = next_code_point(p, end);
+        if (p >= end)
+            return EOF;
+    }
+    else
+        for (; i < 0; ++i)
+        {
+            if (p == begin)
+                return EOF;
+            p = previous_code_point(begin, p);
+        }
+    return decode(p, next_code_point(p, end));
+}
+
+// The whole text is at hand, so marks need no bookkeeping.
+ssize_t utf8_char_stream::mark() { return -1; }
+
+void utf8_char_stream::release(ssize_t) {}
+
+size_t utf8_char_stream::index() { return cur - begin; }
+
+void utf8_char_stream::seek(size_t index) { cur = begin + std::min(index, size()); }
+
+size_t utf8_char_stream::size() { return end - begin; }
+
+std::string utf8_char_stream::getText(const misc::Interval &interval)
+{
+    if (interval.a < 0 || interval.b < interval.a || static_cast<size_t>(interval.a) >= size())
+        return "";
+    // The stop index may be the lead byte of a code point, when the lexer reports the character it failed at.
+    auto stop = begin + std::min(static_cast<size_t>(interval.b), size() - 1) + 1;
+    while (stop < end && is_continuation_byte(*stop))
+        ++stop;
+    return std::string(begin + interval.a, stop);
+}
+
+std::string utf8_char_stream::getSourceName() const { return source_name(name); }
+
+std::string utf8_char_stream::toString() const { return std::string(begin, end); }
+
+unbuffered_utf8_stream::unbuffered_utf8_stream(std::istream &_input, const std::string &_name)
+    : input(_input), name(_name), start(0), p(0), markers(0), previous(EOF), previous_at_start(EOF), at_end(false) {}
+
+bool unbuffered_utf8_stream::fill()
+{
+    if (at_end)
+        return false;
+    auto size = buffer.size();
+    buffer.resize(size + chunk_size);
+    input.read(&buffer[size], chunk_size);
+    buffer.resize(size + input.gcount());
+    at_end = buffer.size() == size;
+    return !at_end;
+}
+
+bool unbuffered_utf8_stream::available(size_t offset)
+{
+    while (offset >= buffer.size())
+        if (!fill())
+            return false;
+    return true;
+}
+
+size_t unbuffered_utf8_stream::code_point_end(size_t offset)
+{
+    if (static_cast<unsigned char>(buffer[offset]) < 0x80)
+        return offset + 1;
+    ++offset;
+    while (available(offset) && is_continuation_byte(buffer[offset]))
+        ++offset;
+    return offset;
+}
+
+void unbuffered_utf8_stream::consume()
+{
+    if (!available(p))
+        throw IllegalStateException("cannot consume EOF");
+    auto next = code_point_end(p);
+    previous = decode(&buffer[p], &buffer[0] + next);
+    p = next;
+
+    // Drop what has been consumed once nothing can seek back to it, a chunk at a time.
+    if (markers == 0 && p >= chunk_size)
+    {
+        buffer.erase(0, p);
+        start += p;
+        p = 0;
+        previous_at_start = previous;
+    }
+}
+
+size_t unbuffered_utf8_stream::LA(ssize_t i)
+{
+    if (i == 0)
+        return 0; // Undefined.
+    if (i == -1)
+        return previous;
+    if (i < 0)
+        throw UnsupportedOperationException("Only LA(-1) is supported by an unbuffered stream.");
+    auto offset = p;
+    for (; i > 1 && available(offset); --i)
+        offset = code_point_end(offset);
+    if (!available(offset))
+        return EOF;
+    auto next = code_point_end(offset);
+    return decode(&buffer[offset], &buffer[0] + next);
+}
+
+ssize_t unbuffered_utf8_stream::mark() { return -static_cast<ssize_t>(++markers); }
+
+void unbuffered_utf8_stream::release(ssize_t marker)
+{
+    if (marker != -static_cast<ssize_t>(markers))
+        throw IllegalStateException("release() called with an invalid marker.");
+    --markers;
+}
+
+size_t unbuffered_utf8_stream::index() { return start + p; }
+
+void unbuffered_utf8_stream::seek(size_t index)
+{
+    if (index < start)
+        throw IllegalArgumentException("cannot seek to index " + std::to_string(index) + ", it is no longer buffered");
+    auto offset = index - start;
+    available(offset);
+    p = std::min(offset, buffer.size());
+    if (p == 0)
+        previous = previous_at_start;
+    else
+    {
+        auto first = previous_code_point(buffer.data(), buffer.data() + p);
+        previous = decode(first, buffer.data() + p);
+    }
+}
+
+size_t unbuffered_utf8_stream::size() { throw UnsupportedOperationException("Unbuffered stream cannot know its size"); }
+
+std::string unbuffered_utf8_stream::getText(const misc::Interval &interval)
+{
+    if (interval.a < 0 || interval.b < interval.a)
+        return "";
+    size_t a = interval.a, b = interval.b;
+    if (a < start)
+        throw UnsupportedOperationException("interval " + interval.toString() + " is no longer buffered");
+    if (!available(a - start))
+        return "";
+    size_t stop = b - start + 1;
+    available(stop);
+    stop = std::min(stop, buffer.size());
+    while (available(stop) && is_continuation_byte(buffer[stop]))
+        ++stop;
+    return buffer.substr(a - start, stop - (a - start));
+}
+
+std::string unbuffered_utf8_stream::getSourceName() const { return source_name(name); }
+
+std::string unbuffered_utf8_stream::toString() const { return buffer; }
@@ -0,0 +1,1686 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <antlr4-runtime.h>
+#include <C1Lexer.h>
+#include <C1Parser.h>
+
+#include <c1recognizer/recognizer.h>
+#include <c1recognizer/ast_cache.h>
+#include <c1recognizer/incremental_recognizer.h>
+#include <c1recognizer/large_stack.h>
+#include <c1recognizer/parser_snapshot.h>
+#include <c1recognizer/recognizer_pool.h>
+#include <c1recognizer/semantic_analysis.h>
+#include <c1recognizer/static_visitor.h>
+#include <c1recognizer/compact_token.h>
+#include <c1recognizer/expression_sharing.h>
+#include <c1recognizer/flat_syntax_tree.h>
+#include <c1recognizer/syntax_tree_builder.h>
+#include <c1recognizer/syntax_tree_deserializer.h>
+#include <c1recognizer/syntax_tree_listener.h>
+#include <c1recognizer/utf8_char_stream.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "syntax_tree_serializer.hpp"
+
+using namespace c1_recognizer;
+using namespace std::literals::string_literals;
+
+// Heap allocations made by the whole process, for the lexing, tables and ownership modes.
+std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    if (auto p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+namespace
+{
+using bench_clock = std::chrono::steady_clock;
+
+double microseconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+}
+
+// Heap in use, including the chunks large enough to be mapped on their own.
+size_t heap_in_use()
+{
+    auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0 : values[values.size() / 2];
+}
+
+// Times snapshot loading and the first parse in a freshly forked child, so that every run starts from the DFA state
+// of a new process. The parent never parses, hence children inherit an empty DFA.
+bool time_first_parse(const std::string &source, const std::string &snapshot, double &load, double &parse)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    auto child = fork();
+    if (child < 0)
+        return false;
+    if (child == 0)
+    {
+        close(fds[0]);
+        double times[2] = {0, 0};
+        auto start = bench_clock::now();
+        if (!snapshot.empty() && !load_parser_snapshot(snapshot))
+            _exit(1);
+        times[0] = microseconds_since(start);
+
+        start = bench_clock::now();
+        recognizer rcg(source);
+        error_reporter reporter(std::cerr);
+        if (!rcg.execute(reporter))
+            _exit(1);
+        times[1] = microseconds_since(start);
+
+        _exit(write(fds[1], times, sizeof(times)) == sizeof(times) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    double times[2];
+    bool received = read(fds[0], times, sizeof(times)) == sizeof(times);
+    close(fds[0]);
+    int status;
+    waitpid(child, &status, 0);
+    if (!received || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return false;
+    load = times[0];
+    parse = times[1];
+    return true;
+}
+
+int startup(const std::string &source, const std::string &snapshot, int runs)
+{
+    std::vector<double> cold, loads, warm;
+    for (int i = 0; i < runs; ++i)
+    {
+        double load, parse;
+        if (!time_first_parse(source, "", load, parse))
+        {
+            std::cerr << "Parsing failed." << std::endl;
+            return 1;
+        }
+        cold.push_back(parse);
+        if (snapshot.empty())
+            continue;
+        if (!time_first_parse(source, snapshot, load, parse))
+        {
+            std::cerr << "Cannot load parser snapshot '" << snapshot << "'." << std::endl;
+            return 1;
+        }
+        loads.push_back(load);
+        warm.push_back(parse);
+    }
+
+    std::cout << "Median of " << runs << " fresh processes:" << std::endl;
+    std::cout << "  cold     parse " << median(cold) << " us" << std::endl;
+    if (!snapshot.empty())
+        std::cout << "  snapshot load " << median(loads) << " us + parse " << median(warm) << " us" << std::endl;
+    return 0;
+}
+
+// Peak RSS in KiB of a freshly forked child running `run`, as the kernel accounts it to the child alone.
+template <typename F>
+bool peak_rss(F run, long &kib)
+{
+    auto child = fork();
+    if (child < 0)
+        return false;
+    if (child == 0)
+        _exit(run() ? 0 : 1);
+
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return false;
+    kib = usage.ru_maxrss;
+    return true;
+}
+
+// Compares peak memory of the ways recognizer can take its input. The parent never reads the input itself, so that
+// children don't inherit it.
+int memory(const std::string &path, parser_engine engine)
+{
+    auto recognize = [&](std::function<recognizer *()> make, bool streaming) {
+        return [=] {
+            std::unique_ptr<recognizer> rcg(make());
+            rcg->set_parser_engine(engine);
+            rcg->set_streaming(streaming);
+            error_reporter reporter(std::cerr);
+            return rcg->execute(reporter);
+        };
+    };
+    std::ifstream in;
+    auto from_stream = [&] {
+        in.open(path);
+        return new recognizer(in);
+    };
+    auto from_file = [&] { return recognizer::from_file(path).release(); };
+
+    long idle, read, mapped, streamed;
+    if (!peak_rss([] { return true; }, idle) || !peak_rss(recognize(from_stream, false), read) ||
+        !peak_rss(recognize(from_file, false), mapped) || !peak_rss(recognize(from_stream, true), streamed))
+    {
+        std::cerr << "Parsing failed." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Peak RSS, including " << idle << " KiB before parsing:" << std::endl;
+    std::cout << "  istream   " << read << " KiB" << std::endl;
+    std::cout << "  mmap      " << mapped << " KiB" << std::endl;
+    std::cout << "  streaming " << streamed << " KiB" << std::endl;
+    return 0;
+}
+
+// Lexes `source` into a CommonTokenStream with `Lexer`, reporting the heap allocations of one run and the median time.
+template <typename Lexer, typename Prepare>
+void time_lexing(const std::string &name, const std::string &source, int runs, Prepare prepare)
+{
+    std::vector<double> times;
+    size_t count = 0, allocated = 0;
+    for (int i = 0; i < runs; ++i)
+    {
+        utf8_char_stream input(source.data(), source.data() + source.size());
+        Lexer lexer(&input);
+        prepare(lexer);
+        antlr4::CommonTokenStream tokens(&lexer);
+
+        size_t before = allocations;
+        auto start = bench_clock::now();
+        tokens.fill();
+        times.push_back(microseconds_since(start));
+        allocated = allocations - before;
+        count = tokens.size();
+    }
+    double time = median(times);
+    std::cout << "  " << name << count << " tokens, " << allocated << " allocations, " << time / 1000 << " ms, "
+              << source.size() / time << " MB/s" << std::endl;
+}
+
+// Compares C1Lexer making a heap-allocated CommonToken per token with C1Lexer making compact_tokens in an arena.
+int lexing(const std::string &source, int runs)
+{
+    std::cout << "Median of " << runs << " runs over " << source.size() << " bytes:" << std::endl;
+    time_lexing<C1Lexer>("CommonToken   ", source, runs, [](C1Lexer &) {});
+    time_lexing<compact_token_lexer<C1Lexer>>("compact_token ", source, runs, [&](compact_token_lexer<C1Lexer> &lexer) {
+        lexer.reset_tokens(source.data());
+    });
+    return 0;
+}
+
+// Parses `source` with C1Parser, building the syntax tree either from the parse tree with syntax_tree_builder, or with
+// syntax_tree_listener while parsing.
+bool build_syntax_tree(const std::string &source, bool listen)
+{
+    utf8_char_stream input(source.data(), source.data() + source.size());
+    compact_token_lexer<C1Lexer> lexer(&input);
+    lexer.reset_tokens(source.data());
+    antlr4::CommonTokenStream tokens(&lexer);
+    C1Parser parser(&tokens);
+
+    std::shared_ptr<syntax_tree::syntax_tree_node> ast;
+    if (listen)
+    {
+        syntax_tree::syntax_tree_listener builder;
+        parser.setBuildParseTree(false);
+        parser.addParseListener(&builder);
+        parser.compilationUnit();
+        parser.removeParseListener(&builder);
+        ast = builder.get_syntax_tree();
+    }
+    else
+    {
+        auto tree = parser.compilationUnit();
+        error_reporter reporter(std::cerr);
+        syntax_tree::syntax_tree_builder builder(reporter);
+        ast = builder(tree);
+    }
+    return ast && parser.getNumberOfSyntaxErrors() == 0;
+}
+
+// Compares building the syntax tree from a parse tree with building it from parse events, in time and peak memory.
+int building(const std::string &source, int runs)
+{
+    long idle, visited, listened;
+    if (!peak_rss([] { return true; }, idle) || !peak_rss([&] { return build_syntax_tree(source, false); }, visited) ||
+        !peak_rss([&] { return build_syntax_tree(source, true); }, listened))
+    {
+        std::cerr << "Parsing failed." << std::endl;
+        return 1;
+    }
+
+    // The first parse warms up the DFA for both.
+    build_syntax_tree(source, false);
+    std::vector<double> visit_times, listen_times;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = bench_clock::now();
+        build_syntax_tree(source, false);
+        visit_times.push_back(microseconds_since(start));
+        start = bench_clock::now();
+        build_syntax_tree(source, true);
+        listen_times.push_back(microseconds_since(start));
+    }
+
+    std::cout << "Median of " << runs << " runs over " << source.size() << " bytes, peak RSS including " << idle
+              << " KiB before parsing:" << std::endl;
+    std::cout << "  parse tree + syntax_tree_builder " << median(visit_times) / 1000 << " ms, " << visited << " KiB"
+              << std::endl;
+    std::cout << "  syntax_tree_listener             " << median(listen_times) / 1000 << " ms, " << listened << " KiB"
+              << std::endl;
+    return 0;
+}
+
+// Times edits in the middle of `source` with incremental_recognizer, against recognizing the whole source again. Each
+// edit adds an empty statement before a function's closing brace, and the next removes it again: first on the same
+// line, then on a line of its own, which moves every node after it.
+int editing(const std::string &source, int runs, lexer_engine lexer, parser_engine engine)
+{
+    auto brace = source.find("\n}", source.size() / 2);
+    if (brace == std::string::npos)
+    {
+        std::cerr << "No function to edit." << std::endl;
+        return 1;
+    }
+
+    error_reporter err(std::cerr);
+    incremental_recognizer incremental;
+    incremental.set_lexer_engine(lexer);
+    incremental.set_parser_engine(engine);
+    recognizer whole(source);
+    whole.set_lexer_engine(lexer);
+    whole.set_parser_engine(engine);
+    if (!incremental.parse(source, err) || !whole.execute(err))
+        return 1;
+
+    auto time_edits = [&](const std::string &inserted) {
+        auto start = bench_clock::now();
+        bool parsed = incremental.edit(brace, 0, inserted, err) && incremental.edit(brace, inserted.size(), "", err);
+        return parsed ? microseconds_since(start) / 2 : -1;
+    };
+    // Whole parses free and allocate a whole tree, so they are timed apart; the first edit warms up the caches.
+    std::vector<double> whole_times, same_line_times, new_line_times;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = bench_clock::now();
+        whole.reset(source);
+        whole.execute(err);
+        whole_times.push_back(microseconds_since(start));
+    }
+    time_edits(";");
+    for (int i = 0; i < runs; ++i)
+    {
+        same_line_times.push_back(time_edits(";"));
+        new_line_times.push_back(time_edits("\n;"));
+        if (same_line_times.back() < 0 || new_line_times.back() < 0)
+            return 1;
+    }
+
+    std::cout << "Median of " << runs << " runs over " << source.size() << " bytes:" << std::endl;
+    std::cout << "  whole source      " << median(whole_times) / 1000 << " ms" << std::endl;
+    std::cout << "  edit on a line    " << median(same_line_times) / 1000 << " ms" << std::endl;
+    std::cout << "  edit adding lines " << median(new_line_times) / 1000 << " ms" << std::endl;
+    return 0;
+}
+
+// Recognizes sources nested ever deeper, to show that time and memory grow linearly with depth: a sum of n terms,
+// which nests n binop_expr_syntax through their left operands, and n nested blocks. Each source is made and recognized
+// in a forked child, so that every size starts from a fresh heap; recognizing runs on a stack sized by stack_size_for,
+// and the syntax tree is destroyed on the child's main stack.
+int nesting(lexer_engine lexer, parser_engine engine)
+{
+    auto sum = [](size_t n) {
+        std::string source = "int a;\nvoid main()\n{\n    a = a";
+        for (size_t i = 1; i < n; ++i)
+            source += " + a";
+        return source + ";\n}\n";
+    };
+    auto blocks = [](size_t n) { return "void main()\n" + std::string(n, '{') + std::string(n, '}') + "\n"; };
+
+    // Time taken by the child, or a negative value if it failed.
+    auto time_in_child = [&](const std::function<std::string(size_t)> &make, size_t n, long &kib) {
+        int fds[2];
+        if (pipe(fds) != 0)
+            return -1.0;
+        auto child = fork();
+        if (child < 0)
+            return -1.0;
+        if (child == 0)
+        {
+            close(fds[0]);
+            auto source = make(n);
+            auto start = bench_clock::now();
+            bool parsed;
+            {
+                recognizer rcg(source);
+                rcg.set_lexer_engine(lexer);
+                rcg.set_parser_engine(engine);
+                error_reporter reporter(std::cerr);
+                run_with_stack(stack_size_for(source.size()), [&] { parsed = rcg.execute(reporter); });
+            }
+            double time = microseconds_since(start);
+            _exit(parsed && write(fds[1], &time, sizeof(time)) == sizeof(time) ? 0 : 1);
+        }
+
+        close(fds[1]);
+        double time;
+        bool received = read(fds[0], &time, sizeof(time)) == sizeof(time);
+        close(fds[0]);
+        int status;
+        struct rusage usage;
+        if (wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !received)
+            return -1.0;
+        kib = usage.ru_maxrss;
+        return time;
+    };
+
+    struct shape
+    {
+        const char *name;
+        std::function<std::string(size_t)> make;
+        size_t smallest;
+    };
+    std::cout << "Recognizing and destroying, in time and peak RSS:" << std::endl;
+    for (auto &s : {shape{"terms of a sum", sum, 125000}, shape{"nested blocks", blocks, 12500}})
+        for (size_t n = s.smallest; n <= s.smallest * 8; n *= 2)
+        {
+            long kib;
+            double time = time_in_child(s.make, n, kib);
+            if (time < 0)
+            {
+                std::cerr << "Parsing failed." << std::endl;
+                return 1;
+            }
+            std::cout << "  " << n << " " << s.name << ": " << time / 1000 << " ms, " << time * 1000 / n
+                      << " ns each, " << kib << " KiB" << std::endl;
+        }
+    return 0;
+}
+
+// Recognizes `source` again and again, reporting the heap allocations made by one execution, and the median times to
+// recognize it, building the syntax tree, and to destroy the tree.
+int ownership(const std::string &source, int runs, lexer_engine lexer, parser_engine engine)
+{
+    recognizer rcg(source);
+    rcg.set_lexer_engine(lexer);
+    rcg.set_parser_engine(engine);
+    error_reporter reporter(std::cerr);
+    std::vector<double> builds, teardowns;
+    size_t allocated = 0;
+    // The first execution warms up the DFA.
+    for (int i = 0; i <= runs; ++i)
+    {
+        rcg.reset(source);
+        allocated = allocations;
+        auto start = bench_clock::now();
+        if (!rcg.execute(reporter))
+        {
+            std::cerr << "Parsing failed." << std::endl;
+            return 1;
+        }
+        auto ast = rcg.get_syntax_tree();
+        double build = microseconds_since(start);
+        allocated = allocations - allocated;
+
+        rcg.reset(std::string());
+        start = bench_clock::now();
+        ast = nullptr;
+        if (i > 0)
+        {
+            teardowns.push_back(microseconds_since(start));
+            builds.push_back(build);
+        }
+    }
+    std::cout << "Median of " << runs << " runs over " << source.size() << " bytes: " << allocated
+              << " allocations, built in " << median(builds) / 1000 << " ms, destroyed in "
+              << median(teardowns) / 1000 << " ms" << std::endl;
+    return 0;
+}
+
+// Recognizes tables `int t[] = {...}` of n literals, reporting the time, the heap allocations made, and the heap the
+// syntax tree takes: with the literals packed, as recognized, and with them unpacked into literal_syntax nodes.
+int tables(lexer_engine lexer, parser_engine engine)
+{
+    std::cout << "Recognizing tables, in time, allocations, and heap taken by the syntax tree packed / as nodes:"
+              << std::endl;
+    for (size_t n = 250000; n <= 2000000; n *= 2)
+    {
+        std::string source = "int t[] = {";
+        for (size_t i = 0; i < n; ++i)
+            source += (i == 0 ? "" : ", ") + std::to_string(i * 7919 % 1000003);
+        source += "};\n";
+
+        size_t heap = heap_in_use();
+        size_t allocated = allocations;
+        auto start = bench_clock::now();
+        std::shared_ptr<syntax_tree::assembly> ast;
+        {
+            recognizer rcg(source);
+            rcg.set_lexer_engine(lexer);
+            rcg.set_parser_engine(engine);
+            error_reporter reporter(std::cerr);
+            if (!rcg.execute(reporter))
+            {
+                std::cerr << "Parsing failed." << std::endl;
+                return 1;
+            }
+            ast = std::static_pointer_cast<syntax_tree::assembly>(rcg.get_syntax_tree());
+        }
+        double time = microseconds_since(start);
+        allocated = allocations - allocated;
+        size_t packed = heap_in_use() - heap;
+
+        auto &def = dynamic_cast<syntax_tree::var_def_stmt_syntax &>(*ast->global_defs[0]);
+        syntax_tree::ast_context unpacked;
+        def.literal_initializers.unpack(unpacked, def.initializers);
+        def.literal_initializers = syntax_tree::literal_list();
+        size_t nodes = heap_in_use() - heap;
+
+        std::cout << "  " << n << " literals: " << time / 1000 << " ms, " << double(allocated) / n
+                  << " allocations each, " << packed / 1024 << " / " << nodes / 1024 << " KiB" << std::endl;
+    }
+    return 0;
+}
+
+// Hardware event counted around a region of code, if the kernel lets us count it.
+class event_counter
+{
+  public:
+    event_counter(uint32_t type, uint64_t config)
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~event_counter()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool available() const { return fd >= 0; }
+    void start()
+    {
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+        return count;
+    }
+
+  private:
+    int fd;
+};
+
+// Checksum of a syntax tree, summing for each node its line and kind, and the values of int literals, as a pass
+// reading every node would. Computed over the nodes through syntax_tree_visitor, and over flat_syntax_tree nodes.
+using flat_kind = syntax_tree::flat_syntax_tree::kind;
+
+uint64_t node_sum(int line, flat_kind k) { return static_cast<uint64_t>(line) * 16 + static_cast<uint64_t>(k); }
+
+struct checksum_visitor : syntax_tree::syntax_tree_visitor
+{
+    uint64_t sum = 0;
+
+    void visit(syntax_tree::assembly &node) override
+    {
+        for (auto def : node.global_defs)
+            def->accept(*this);
+    }
+    void visit(syntax_tree::func_def_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::func_def);
+        node.body->accept(*this);
+    }
+    void visit(syntax_tree::cond_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::cond);
+        node.lhs->accept(*this);
+        node.rhs->accept(*this);
+    }
+    void visit(syntax_tree::binop_expr_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::binop);
+        node.lhs->accept(*this);
+        node.rhs->accept(*this);
+    }
+    void visit(syntax_tree::unaryop_expr_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::unaryop);
+        node.rhs->accept(*this);
+    }
+    void visit(syntax_tree::lval_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::lval);
+        if (node.array_index)
+            node.array_index->accept(*this);
+    }
+    void visit(syntax_tree::literal_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::literal) + (node.is_int ? static_cast<uint32_t>(node.intConst) : 0);
+    }
+    void visit(syntax_tree::var_def_stmt_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::var_def);
+        if (node.array_length)
+            node.array_length->accept(*this);
+        for (auto init : node.initializers)
+            init->accept(*this);
+        auto &packed = node.literal_initializers;
+        for (size_t i = 0; i < packed.size(); ++i)
+            sum += node_sum(packed.positions[i].line, flat_kind::literal) +
+                   (packed.is_int ? static_cast<uint32_t>(packed.ints[i]) : 0);
+    }
+    void visit(syntax_tree::assign_stmt_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::assign);
+        node.target->accept(*this);
+        node.value->accept(*this);
+    }
+    void visit(syntax_tree::func_call_stmt_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::func_call);
+    }
+    void visit(syntax_tree::block_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::block);
+        for (auto stmt : node.body)
+            stmt->accept(*this);
+    }
+    void visit(syntax_tree::if_stmt_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::if_stmt);
+        node.pred->accept(*this);
+        node.then_body->accept(*this);
+        if (node.else_body)
+            node.else_body->accept(*this);
+    }
+    void visit(syntax_tree::while_stmt_syntax &node) override
+    {
+        sum += node_sum(node.line, flat_kind::while_stmt);
+        node.pred->accept(*this);
+        node.body->accept(*this);
+    }
+    void visit(syntax_tree::empty_stmt_syntax &node) override { sum += node_sum(node.line, flat_kind::empty_stmt); }
+};
+
+// The same pass over a flat_syntax_tree, recursing through dispatch() as assembly_builder-style passes would.
+struct checksum_pass
+{
+    using index = syntax_tree::flat_syntax_tree::index;
+    const syntax_tree::flat_syntax_tree &tree;
+    uint64_t sum = 0;
+
+    void walk(index node)
+    {
+        if (node != tree.none)
+            tree.dispatch(node, *this);
+    }
+    void add(index node) { sum += node_sum(tree.get_location(node).line, tree.get_kind(node)); }
+
+    void visit_func_def(index node)
+    {
+        add(node);
+        walk(tree.get_body(node));
+    }
+    void visit_cond(index node)
+    {
+        add(node);
+        walk(tree.get_lhs(node));
+        walk(tree.get_rhs(node));
+    }
+    void visit_binop(index node) { visit_cond(node); }
+    void visit_unaryop(index node)
+    {
+        add(node);
+        walk(tree.get_rhs(node));
+    }
+    void visit_lval(index node)
+    {
+        add(node);
+        walk(tree.get_array_index(node));
+    }
+    void visit_literal(index node)
+    {
+        add(node);
+        if (tree.is_int(node))
+            sum += static_cast<uint32_t>(tree.get_int(node));
+    }
+    void visit_var_def(index node)
+    {
+        add(node);
+        walk(tree.get_array_length(node));
+        for (auto init : tree.get_initializers(node))
+            walk(init);
+    }
+    void visit_assign(index node)
+    {
+        add(node);
+        walk(tree.get_target(node));
+        walk(tree.get_value(node));
+    }
+    void visit_func_call(index node) { add(node); }
+    void visit_block(index node)
+    {
+        add(node);
+        for (auto stmt : tree.get_statements(node))
+            walk(stmt);
+    }
+    void visit_if(index node)
+    {
+        add(node);
+        walk(tree.get_pred(node));
+        walk(tree.get_then(node));
+        walk(tree.get_else(node));
+    }
+    void visit_while(index node)
+    {
+        add(node);
+        walk(tree.get_pred(node));
+        walk(tree.get_body(node));
+    }
+    void visit_empty(index node) { add(node); }
+};
+
+// The same pass as checksum_visitor through static_visitor, returning the sums of subtrees instead of adding to a
+// member.
+struct checksum_walker : syntax_tree::static_visitor<checksum_walker>
+{
+    uint64_t visit(syntax_tree::assembly &node)
+    {
+        uint64_t sum = 0;
+        for (auto def : node.global_defs)
+            sum += dispatch(*def);
+        return sum;
+    }
+    uint64_t visit(syntax_tree::func_def_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::func_def) + visit(*node.body);
+    }
+    uint64_t visit(syntax_tree::cond_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::cond) + dispatch(*node.lhs) + dispatch(*node.rhs);
+    }
+    uint64_t visit(syntax_tree::binop_expr_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::binop) + dispatch(*node.lhs) + dispatch(*node.rhs);
+    }
+    uint64_t visit(syntax_tree::unaryop_expr_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::unaryop) + dispatch(*node.rhs);
+    }
+    uint64_t visit(syntax_tree::lval_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::lval) + (node.array_index ? dispatch(*node.array_index) : 0);
+    }
+    uint64_t visit(syntax_tree::literal_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::literal) + (node.is_int ? static_cast<uint32_t>(node.intConst) : 0);
+    }
+    uint64_t visit(syntax_tree::var_def_stmt_syntax &node)
+    {
+        uint64_t sum = node_sum(node.line, flat_kind::var_def);
+        if (node.array_length)
+            sum += dispatch(*node.array_length);
+        for (auto init : node.initializers)
+            sum += dispatch(*init);
+        auto &packed = node.literal_initializers;
+        for (size_t i = 0; i < packed.size(); ++i)
+            sum += node_sum(packed.positions[i].line, flat_kind::literal) +
+                   (packed.is_int ? static_cast<uint32_t>(packed.ints[i]) : 0);
+        return sum;
+    }
+    uint64_t visit(syntax_tree::assign_stmt_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::assign) + visit(*node.target) + dispatch(*node.value);
+    }
+    uint64_t visit(syntax_tree::func_call_stmt_syntax &node) { return node_sum(node.line, flat_kind::func_call); }
+    uint64_t visit(syntax_tree::block_syntax &node)
+    {
+        uint64_t sum = node_sum(node.line, flat_kind::block);
+        for (auto stmt : node.body)
+            sum += dispatch(*stmt);
+        return sum;
+    }
+    uint64_t visit(syntax_tree::if_stmt_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::if_stmt) + visit(*node.pred) + dispatch(*node.then_body) +
+               (node.else_body ? dispatch(*node.else_body) : 0);
+    }
+    uint64_t visit(syntax_tree::while_stmt_syntax &node)
+    {
+        return node_sum(node.line, flat_kind::while_stmt) + visit(*node.pred) + dispatch(*node.body);
+    }
+    uint64_t visit(syntax_tree::empty_stmt_syntax &node) { return node_sum(node.line, flat_kind::empty_stmt); }
+};
+
+// Times the same pass over all nodes of the syntax tree of `source`, through syntax_tree_visitor (accept() then
+// visit(), both virtual) and through static_visitor.
+int dispatching(const std::string &source, int runs, lexer_engine lexer, parser_engine engine)
+{
+    std::shared_ptr<syntax_tree::assembly> ast;
+    int result = 0;
+    run_with_stack(stack_size_for(source.size()), [&] {
+        recognizer rcg(source);
+        rcg.set_lexer_engine(lexer);
+        rcg.set_parser_engine(engine);
+        error_reporter reporter(std::cerr);
+        if (!rcg.execute(reporter))
+        {
+            std::cerr << "Parsing failed." << std::endl;
+            result = 1;
+            return;
+        }
+        ast = std::static_pointer_cast<syntax_tree::assembly>(rcg.get_syntax_tree());
+
+        std::vector<double> virtual_times, static_times;
+        uint64_t virtual_sum = 0, static_sum = 0;
+        for (int i = 0; i < runs; ++i)
+        {
+            auto start = bench_clock::now();
+            checksum_visitor visitor;
+            ast->accept(visitor);
+            virtual_sum = visitor.sum;
+            virtual_times.push_back(microseconds_since(start));
+
+            start = bench_clock::now();
+            static_sum = checksum_walker().visit(*ast);
+            static_times.push_back(microseconds_since(start));
+        }
+        std::cout << "Median of " << runs << " walks over " << source.size() << " bytes:" << std::endl
+                  << "  syntax_tree_visitor " << median(virtual_times) / 1000 << " ms, checksum " << virtual_sum
+                  << std::endl
+                  << "  static_visitor      " << median(static_times) / 1000 << " ms, checksum " << static_sum
+                  << std::endl;
+        if (virtual_sum != static_sum)
+        {
+            std::cerr << "Checksums differ." << std::endl;
+            result = 1;
+        }
+    });
+    return result;
+}
+
+// Recognizes `source`, copies its syntax tree to a flat_syntax_tree, and times the same pass over all nodes, walking
+// the nodes through syntax_tree_visitor, the flat tree through dispatch(), and the flat tree by a linear scan. Cache
+// misses of each walk are reported where the kernel lets us count them.
+int flattening(const std::string &source, int runs, lexer_engine lexer, parser_engine engine)
+{
+    std::shared_ptr<syntax_tree::assembly> ast;
+    std::unique_ptr<syntax_tree::flat_syntax_tree> flat;
+    double convert = 0;
+    size_t heap = 0;
+    int result = 0;
+    run_with_stack(stack_size_for(source.size()), [&] {
+        recognizer rcg(source);
+        rcg.set_lexer_engine(lexer);
+        rcg.set_parser_engine(engine);
+        error_reporter reporter(std::cerr);
+        if (!rcg.execute(reporter))
+        {
+            std::cerr << "Parsing failed." << std::endl;
+            result = 1;
+            return;
+        }
+        ast = std::static_pointer_cast<syntax_tree::assembly>(rcg.get_syntax_tree());
+        heap = heap_in_use();
+        auto start = bench_clock::now();
+        flat.reset(new syntax_tree::flat_syntax_tree(*ast));
+        convert = microseconds_since(start);
+        heap = heap_in_use() - heap;
+    });
+    if (result != 0)
+        return result;
+    std::cout << flat->size() << " nodes, flattened in " << convert / 1000 << " ms to " << double(heap) / flat->size()
+              << " bytes per node" << std::endl;
+
+    struct walk
+    {
+        const char *name;
+        std::function<uint64_t()> run;
+    };
+    std::vector<walk> walks{{"nodes, virtual accept", [&] {
+                                 checksum_visitor visitor;
+                                 ast->accept(visitor);
+                                 return visitor.sum;
+                             }},
+                            {"flat, dispatch", [&] {
+                                 checksum_pass pass{*flat};
+                                 for (auto def : flat->get_global_defs())
+                                     pass.walk(def);
+                                 return pass.sum;
+                             }},
+                            {"flat, linear scan", [&] {
+                                 uint64_t sum = 0;
+                                 for (syntax_tree::flat_syntax_tree::index i = 0; i < flat->size(); ++i)
+                                 {
+                                     sum += node_sum(flat->get_location(i).line, flat->get_kind(i));
+                                     if (flat->get_kind(i) == flat_kind::literal && flat->is_int(i))
+                                         sum += static_cast<uint32_t>(flat->get_int(i));
+                                 }
+                                 return sum;
+                             }}};
+
+    std::cout << "Median of " << runs << " walks, checksum, L1D read misses, LLC misses:" << std::endl;
+    event_counter l1d(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    event_counter llc(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    uint64_t expected = 0;
+    for (auto &w : walks)
+    {
+        std::vector<double> times;
+        std::vector<double> l1d_misses, llc_misses;
+        uint64_t sum = 0;
+        run_with_stack(stack_size_for(source.size()), [&] {
+            for (int i = 0; i < runs; ++i)
+            {
+                l1d.start();
+                llc.start();
+                auto start = bench_clock::now();
+                sum = w.run();
+                times.push_back(microseconds_since(start));
+                llc_misses.push_back(llc.stop());
+                l1d_misses.push_back(l1d.stop());
+            }
+        });
+        if (&w == &walks[0])
+            expected = sum;
+        std::cout << "  " << w.name << ": " << median(times) / 1000 << " ms, " << sum;
+        if (sum != expected)
+            result = 1;
+        std::cout << ", " << (l1d.available() ? std::to_string(uint64_t(median(l1d_misses))) : "unavailable"s)
+                  << ", " << (llc.available() ? std::to_string(uint64_t(median(llc_misses))) : "unavailable"s)
+                  << std::endl;
+    }
+    if (result != 0)
+        std::cerr << "Checksums differ." << std::endl;
+    return result;
+}
+
+// Identifier-heavy source: `functions` functions, each defining `variables` variables with long names and assigning
+// them expressions of the others.
+std::string identifier_heavy_source(int functions, int variables)
+{
+    std::string source;
+    for (int f = 0; f < functions; ++f)
+    {
+        auto name = [&](int v) { return "accumulated_value_" + std::to_string(f) + "_" + std::to_string(v); };
+        source += "void function_number_" + std::to_string(f) + "()\n{\n";
+        for (int v = 0; v < variables; ++v)
+            source += "    int " + name(v) + " = " + std::to_string(v) + ";\n";
+        for (int v = 0; v < variables; ++v)
+            source += "    " + name(v) + " = " + name((v + 1) % variables) + " + " + name((v + 7) % variables) +
+                      " * " + name((v + 13) % variables) + ";\n";
+        source += "}\n";
+    }
+    return source;
+}
+
+// Resolves every name of a syntax tree through a chain of scopes keyed by `Key`, as assembly_builder does, counting
+// the names found.
+template <typename Key, typename MakeKey>
+struct name_resolver : syntax_tree::syntax_tree_visitor
+{
+    MakeKey make_key;
+    std::deque<std::unordered_map<Key, int>> scopes;
+    size_t found = 0;
+
+    name_resolver(MakeKey _make_key) : make_key(_make_key) {}
+
+    void visit(syntax_tree::assembly &node) override
+    {
+        scopes.emplace_front();
+        for (auto def : node.global_defs)
+            def->accept(*this);
+        scopes.pop_front();
+    }
+    void visit(syntax_tree::func_def_syntax &node) override
+    {
+        scopes.front()[make_key(node.name)] = 0;
+        node.body->accept(*this);
+    }
+    void visit(syntax_tree::cond_syntax &node) override
+    {
+        node.lhs->accept(*this);
+        node.rhs->accept(*this);
+    }
+    void visit(syntax_tree::binop_expr_syntax &node) override
+    {
+        node.lhs->accept(*this);
+        node.rhs->accept(*this);
+    }
+    void visit(syntax_tree::unaryop_expr_syntax &node) override { node.rhs->accept(*this); }
+    void visit(syntax_tree::lval_syntax &node) override
+    {
+        auto key = make_key(node.name);
+        for (auto &scope : scopes)
+            if (scope.find(key) != scope.end())
+            {
+                ++found;
+                break;
+            }
+        if (node.array_index)
+            node.array_index->accept(*this);
+    }
+    void visit(syntax_tree::literal_syntax &) override {}
+    void visit(syntax_tree::var_def_stmt_syntax &node) override
+    {
+        if (node.array_length)
+            node.array_length->accept(*this);
+        for (auto init : node.initializers)
+            init->accept(*this);
+        scopes.front()[make_key(node.name)] = 0;
+    }
+    void visit(syntax_tree::assign_stmt_syntax &node) override
+    {
+        node.value->accept(*this);
+        node.target->accept(*this);
+    }
+    void visit(syntax_tree::func_call_stmt_syntax &node) override
+    {
+        auto key = make_key(node.name);
+        found += scopes.back().find(key) != scopes.back().end();
+    }
+    void visit(syntax_tree::block_syntax &node) override
+    {
+        scopes.emplace_front();
+        for (auto stmt : node.body)
+            stmt->accept(*this);
+        scopes.pop_front();
+    }
+    void visit(syntax_tree::if_stmt_syntax &node) override
+    {
+        node.pred->accept(*this);
+        node.then_body->accept(*this);
+        if (node.else_body)
+            node.else_body->accept(*this);
+    }
+    void visit(syntax_tree::while_stmt_syntax &node) override
+    {
+        node.pred->accept(*this);
+        node.body->accept(*this);
+    }
+    void visit(syntax_tree::empty_stmt_syntax &) override {}
+};
+
+template <typename Key, typename MakeKey>
+double time_resolving(syntax_tree::assembly &ast, int runs, MakeKey make_key, size_t &found)
+{
+    std::vector<double> times;
+    for (int i = 0; i < runs; ++i)
+    {
+        name_resolver<Key, MakeKey> resolver(make_key);
+        auto start = bench_clock::now();
+        ast.accept(resolver);
+        times.push_back(microseconds_since(start));
+        found = resolver.found;
+    }
+    return median(times);
+}
+
+// Recognizes identifier-heavy sources, reporting the heap taken by the syntax tree, the identifiers interned so far,
+// and the time to resolve all names through scopes keyed by their spellings, as before interning, and by symbols.
+int identifiers(int runs, lexer_engine lexer, parser_engine engine)
+{
+    std::cout << "Median of " << runs << " runs, tree heap, symbols, resolving names by spelling / by symbol:"
+              << std::endl;
+    for (int functions : {100, 400, 1600})
+    {
+        auto source = identifier_heavy_source(functions, 100);
+        std::shared_ptr<syntax_tree::assembly> ast;
+        {
+            recognizer rcg(source);
+            rcg.set_lexer_engine(lexer);
+            rcg.set_parser_engine(engine);
+            error_reporter reporter(std::cerr);
+            if (!rcg.execute(reporter))
+            {
+                std::cerr << "Parsing failed." << std::endl;
+                return 1;
+            }
+            ast = std::static_pointer_cast<syntax_tree::assembly>(rcg.get_syntax_tree());
+        }
+
+        size_t by_spelling = 0, by_symbol = 0;
+        double spelling_time = time_resolving<std::string>(
+            *ast, runs, [](syntax_tree::symbol name) { return syntax_tree::spelling(name); }, by_spelling);
+        double symbol_time = time_resolving<syntax_tree::symbol>(
+            *ast, runs, [](syntax_tree::symbol name) { return name; }, by_symbol);
+        if (by_spelling != by_symbol)
+        {
+            std::cerr << "Names resolved differ." << std::endl;
+            return 1;
+        }
+        // The interned spellings outlive the tree.
+        size_t heap = heap_in_use();
+        ast = nullptr;
+        heap -= heap_in_use();
+        std::cout << "  " << source.size() << " bytes, " << by_symbol << " names: " << heap / 1024 << " KiB, "
+                  << syntax_tree::symbols_count() << " symbols, " << spelling_time / 1000 << " / "
+                  << symbol_time / 1000 << " ms" << std::endl;
+    }
+    return 0;
+}
+
+// Bytes of the expression nodes reachable from `root`, counting nodes reached along several paths once.
+struct expression_bytes : syntax_tree::syntax_tree_visitor
+{
+    std::unordered_set<const syntax_tree::syntax_tree_node *> seen;
+    size_t bytes = 0;
+
+    // Counts `node` unless it was reached before.
+    bool first(syntax_tree::syntax_tree_node *node, size_t size)
+    {
+        if (!seen.insert(node).second)
+            return false;
+        bytes += size;
+        return true;
+    }
+    void visit(syntax_tree::assembly &node) override
+    {
+        for (auto def : node.global_defs)
+            def->accept(*this);
+    }
+    void visit(syntax_tree::func_def_syntax &node) override { node.body->accept(*this); }
+    void visit(syntax_tree::cond_syntax &node) override
+    {
+        node.lhs->accept(*this);
+        node.rhs->accept(*this);
+    }
+    void visit(syntax_tree::binop_expr_syntax &node) override
+    {
+        if (!first(&node, sizeof(node)))
+            return;
+        node.lhs->accept(*this);
+        node.rhs->accept(*this);
+    }
+    void visit(syntax_tree::unaryop_expr_syntax &node) override
+    {
+        if (!first(&node, sizeof(node)))
+            return;
+        node.rhs->accept(*this);
+    }
+    void visit(syntax_tree::lval_syntax &node) override
+    {
+        if (!first(&node, sizeof(node)))
+            return;
+        if (node.array_index)
+            node.array_index->accept(*this);
+    }
+    void visit(syntax_tree::literal_syntax &node) override { first(&node, sizeof(node)); }
+    void visit(syntax_tree::var_def_stmt_syntax &node) override
+    {
+        if (node.array_length)
+            node.array_length->accept(*this);
+        for (auto init : node.initializers)
+            init->accept(*this);
+    }
+    void visit(syntax_tree::assign_stmt_syntax &node) override
+    {
+        node.target->accept(*this);
+        node.value->accept(*this);
+    }
+    void visit(syntax_tree::func_call_stmt_syntax &) override {}
+    void visit(syntax_tree::block_syntax &node) override
+    {
+        for (auto stmt : node.body)
+            stmt->accept(*this);
+    }
+    void visit(syntax_tree::if_stmt_syntax &node) override
+    {
+        node.pred->accept(*this);
+        node.then_body->accept(*this);
+        if (node.else_body)
+            node.else_body->accept(*this);
+    }
+    void visit(syntax_tree::while_stmt_syntax &node) override
+    {
+        node.pred->accept(*this);
+        node.body->accept(*this);
+    }
+    void visit(syntax_tree::empty_stmt_syntax &) override {}
+};
+
+// Recognizes `source` and shares its expressions, reporting the sharing statistics, the time share_expressions()
+// takes, and the bytes of expression nodes reachable before and after.
+int sharing(const std::string &source, lexer_engine lexer, parser_engine engine)
+{
+    syntax_tree::sharing_statistics statistics;
+    size_t before = 0, after = 0;
+    double time = 0;
+    bool parsed = false;
+    run_with_stack(stack_size_for(source.size()), [&] {
+        recognizer rcg(source);
+        rcg.set_lexer_engine(lexer);
+        rcg.set_parser_engine(engine);
+        error_reporter reporter(std::cerr);
+        if (!(parsed = rcg.execute(reporter)))
+            return;
+        auto ast = std::static_pointer_cast<syntax_tree::assembly>(rcg.get_syntax_tree());
+        expression_bytes tree;
+        ast->accept(tree);
+        before = tree.bytes;
+        auto start = bench_clock::now();
+        statistics = syntax_tree::share_expressions(*ast);
+        time = microseconds_since(start);
+        expression_bytes dag;
+        ast->accept(dag);
+        after = dag.bytes;
+    });
+    if (!parsed)
+    {
+        std::cerr << "Parsing failed." << std::endl;
+        return 1;
+    }
+    std::cout << "Shared " << statistics.shared() << " of " << statistics.expressions << " expressions ("
+              << statistics.ratio() * 100 << "%) in " << time / 1000 << " ms; expression nodes reachable take "
+              << before / 1024 << " KiB before, " << after / 1024 << " KiB after" << std::endl;
+    return 0;
+}
+
+// Recognizes `source`, then analyzes its semantics again and again, with the variables and functions of c1i's runtime
+// predeclared, reporting the median times of both. Analysis needs no code generator, so checking sources costs only
+// this much more than recognizing them.
+int semantics(const std::string &source, int runs, lexer_engine lexer, parser_engine engine)
+{
+    bool parsed = false, analyzed = true;
+    std::vector<double> recognize_times, analyze_times;
+    syntax_tree::semantic_info info;
+    run_with_stack(stack_size_for(source.size()), [&] {
+        std::shared_ptr<syntax_tree::syntax_tree_node> ast;
+        for (int i = 0; i < runs; ++i)
+        {
+            auto start = bench_clock::now();
+            recognizer rcg(source);
+            rcg.set_lexer_engine(lexer);
+            rcg.set_parser_engine(engine);
+            error_reporter reporter(std::cerr);
+            if (!(parsed = rcg.execute(reporter)))
+                return;
+            ast = rcg.get_syntax_tree();
+            recognize_times.push_back(microseconds_since(start));
+        }
+
+        error_reporter reporter(std::cerr);
+        for (int i = 0; i < runs && analyzed; ++i)
+        {
+            auto start = bench_clock::now();
+            info = syntax_tree::semantic_info();
+            for (auto name : {"input_ivar", "output_ivar"})
+                info.predeclare_variable(syntax_tree::intern(name), syntax_tree::value_type::int_type, false, false);
+            for (auto name : {"input_fvar", "output_fvar"})
+                info.predeclare_variable(syntax_tree::intern(name), syntax_tree::value_type::float_type, false, false);
+            for (auto name : {"inputInt", "inputFloat", "outputInt", "outputFloat"})
+                info.predeclare_function(syntax_tree::intern(name));
+            analyzed = syntax_tree::analyze_semantics(static_cast<syntax_tree::assembly &>(*ast), info, reporter);
+            analyze_times.push_back(microseconds_since(start));
+        }
+    });
+    if (!parsed || !analyzed)
+    {
+        std::cerr << "Parsing or semantic analysis failed." << std::endl;
+        return 1;
+    }
+    std::cout << info.variables.size() << " variables, " << info.functions.size() << " functions, "
+              << info.conversions << " implicit conversions" << std::endl
+              << "Median of " << runs << " runs:" << std::endl
+              << "  recognize " << median(recognize_times) / 1000 << " ms" << std::endl
+              << "  analyze   " << median(analyze_times) / 1000 << " ms" << std::endl;
+    return 0;
+}
+
+// Analyzes functions of 10000 locals, the body of each then nesting blocks `depth` deep, every block defining a local
+// that shadows an outer one and reading locals of the outermost scope: the time to resolve names should not grow with
+// the number of locals or the depth of the scope they are found in.
+int scopes(int runs, lexer_engine lexer, parser_engine engine)
+{
+    const size_t locals = 10000;
+    std::cout << "Median of " << runs << " runs, analyzing " << locals << " locals nested n blocks deep:" << std::endl;
+    for (size_t depth : {10, 1000, 10000})
+    {
+        std::string source = "void main()\n{\n";
+        for (size_t i = 0; i < locals; ++i)
+            source += "    int v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+        for (size_t i = 0; i < depth; ++i)
+        {
+            auto shadowed = "v" + std::to_string(i % locals);
+            source += "{ int " + shadowed + " = v" + std::to_string(locals - 1) + " + v" +
+                      std::to_string((i + 1) % locals) + "; v0 = " + shadowed + ";\n";
+        }
+        source += std::string(depth, '}') + "\n}\n";
+
+        std::vector<double> times;
+        bool parsed = false, analyzed = true;
+        run_with_stack(stack_size_for(source.size()), [&] {
+            recognizer rcg(source);
+            rcg.set_lexer_engine(lexer);
+            rcg.set_parser_engine(engine);
+            error_reporter reporter(std::cerr);
+            if (!(parsed = rcg.execute(reporter)))
+                return;
+            auto ast = rcg.get_syntax_tree();
+            for (int i = 0; i < runs && analyzed; ++i)
+            {
+                syntax_tree::semantic_info info;
+                auto start = bench_clock::now();
+                analyzed = syntax_tree::analyze_semantics(static_cast<syntax_tree::assembly &>(*ast), info, reporter);
+                times.push_back(microseconds_since(start));
+            }
+        });
+        if (!parsed || !analyzed)
+        {
+            std::cerr << "Parsing or semantic analysis failed." << std::endl;
+            return 1;
+        }
+        std::cout << "  " << depth << " blocks: " << median(times) / 1000 << " ms" << std::endl;
+    }
+    return 0;
+}
+
+// Time `run` takes in a freshly forked child, which starts from the DFA state and page cache of the parent.
+template <typename F>
+bool time_in_child(F run, double &time)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    auto child = fork();
+    if (child < 0)
+        return false;
+    if (child == 0)
+    {
+        close(fds[0]);
+        auto start = bench_clock::now();
+        if (!run())
+            _exit(1);
+        double elapsed = microseconds_since(start);
+        _exit(write(fds[1], &elapsed, sizeof(elapsed)) == sizeof(elapsed) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    bool received = read(fds[0], &time, sizeof(time)) == sizeof(time);
+    close(fds[0]);
+    int status;
+    waitpid(child, &status, 0);
+    return received && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Compares the front end of a fresh process recognizing `source` with one looking its tree up in an ast_cache, as c1i
+// does with -ast-cache, and checks the cached tree against the recognized one. The cache is a temporary directory,
+// removed afterwards.
+int caching(const std::string &source, int runs, lexer_engine lexer, parser_engine engine)
+{
+    char directory[] = "/tmp/c1r_bench_cache.XXXXXX";
+    if (!mkdtemp(directory))
+    {
+        std::cerr << "Cannot make a temporary directory." << std::endl;
+        return 1;
+    }
+    syntax_tree::ast_cache cache(directory);
+    auto path = cache.path_for(source);
+    auto cleanup = [&] {
+        unlink(path.c_str());
+        rmdir(directory);
+    };
+
+    // Recognizing in a child keeps the DFA of this process, which the others inherit, empty.
+    auto prepare = [&] {
+        bool same = false;
+        run_with_stack(stack_size_for(source.size()), [&] {
+            recognizer rcg(source);
+            rcg.set_lexer_engine(lexer);
+            rcg.set_parser_engine(engine);
+            error_reporter reporter(std::cerr);
+            if (!rcg.execute(reporter))
+                return;
+            auto &ast = static_cast<syntax_tree::assembly &>(*rcg.get_syntax_tree());
+            if (!cache.store(source, ast))
+                return;
+            auto cached = cache.lookup(source);
+            same = cached && syntax_tree::write_ast_image(*cached) == syntax_tree::write_ast_image(ast);
+        });
+        return same;
+    };
+    double time;
+    struct stat image;
+    if (!time_in_child(prepare, time) || stat(path.c_str(), &image) != 0)
+    {
+        std::cerr << "Parsing or caching failed, or the cached tree differs." << std::endl;
+        cleanup();
+        return 1;
+    }
+
+    auto recognize = [&] {
+        bool parsed;
+        run_with_stack(stack_size_for(source.size()), [&] {
+            recognizer rcg(source);
+            rcg.set_lexer_engine(lexer);
+            rcg.set_parser_engine(engine);
+            error_reporter reporter(std::cerr);
+            parsed = rcg.execute(reporter);
+        });
+        return parsed;
+    };
+    auto look_up = [&] { return cache.lookup(source) != nullptr; };
+    std::vector<double> cold, cached, warm;
+    for (int i = 0; i < runs; ++i)
+    {
+        if (!time_in_child(recognize, time))
+            break;
+        cold.push_back(time);
+        if (!time_in_child(look_up, time))
+            break;
+        cached.push_back(time);
+        auto start = bench_clock::now();
+        look_up();
+        warm.push_back(microseconds_since(start));
+    }
+    cleanup();
+    if (cached.size() != static_cast<size_t>(runs))
+    {
+        std::cerr << "A child process failed." << std::endl;
+        return 1;
+    }
+
+    auto &statistics = cache.get_statistics();
+    std::cout << "Source " << source.size() << " bytes, image " << image.st_size << " bytes" << std::endl
+              << "Median of " << runs << " fresh processes:" << std::endl
+              << "  recognize " << median(cold) / 1000 << " ms" << std::endl
+              << "  cache hit " << median(cached) / 1000 << " ms, " << median(cold) / median(cached) << "x faster"
+              << std::endl
+              << "Median cache hit in this process: " << median(warm) / 1000 << " ms" << std::endl
+              << "Cache statistics of this process: " << statistics.hits << " hits, " << statistics.misses
+              << " misses, " << statistics.rejected << " rejected, " << statistics.stores << " stored" << std::endl;
+    return 0;
+}
+
+using compact_writer = rapidjson::Writer<rapidjson::StringBuffer>;
+using pretty_writer = rapidjson::PrettyWriter<rapidjson::StringBuffer>;
+
+template <typename Writer>
+std::string to_json(syntax_tree::syntax_tree_node &tree)
+{
+    rapidjson::StringBuffer buffer;
+    Writer writer(buffer);
+    syntax_tree::syntax_tree_serializer<Writer> serializer(writer);
+    serializer.serialize(tree);
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
+
+// Serializes the tree of `source` into JSON as c1r_test does, compact and pretty, and reads the compact JSON back with
+// a syntax_tree_deserializer, from memory and through an istream, checking that it serializes the same again.
+int json(const std::string &source, int runs, lexer_engine lexer, parser_engine engine)
+{
+    bool parsed = false, same = false;
+    std::string compact, pretty;
+    std::vector<double> compact_times, pretty_times, memory_times, stream_times;
+    run_with_stack(stack_size_for(source.size()), [&] {
+        recognizer rcg(source);
+        rcg.set_lexer_engine(lexer);
+        rcg.set_parser_engine(engine);
+        error_reporter reporter(std::cerr);
+        if (!(parsed = rcg.execute(reporter)))
+            return;
+        auto ast = rcg.get_syntax_tree();
+        for (int i = 0; i < runs; ++i)
+        {
+            auto start = bench_clock::now();
+            compact = to_json<compact_writer>(*ast);
+            compact_times.push_back(microseconds_since(start));
+            start = bench_clock::now();
+            pretty = to_json<pretty_writer>(*ast);
+            pretty_times.push_back(microseconds_since(start));
+        }
+
+        syntax_tree::syntax_tree_deserializer deserializer;
+        std::shared_ptr<syntax_tree::assembly> read;
+        for (int i = 0; i < runs; ++i)
+        {
+            auto start = bench_clock::now();
+            read = deserializer.deserialize(compact.data(), compact.size());
+            memory_times.push_back(microseconds_since(start));
+            if (!read)
+                break;
+            std::istringstream in(compact);
+            start = bench_clock::now();
+            read = deserializer.deserialize(in);
+            stream_times.push_back(microseconds_since(start));
+            if (!read)
+                break;
+        }
+        if (!read)
+            std::cerr << deserializer.get_error() << std::endl;
+        else
+            same = to_json<compact_writer>(*read) == compact;
+    });
+    if (!parsed || !same)
+    {
+        std::cerr << "Parsing failed, or the tree read back differs." << std::endl;
+        return 1;
+    }
+
+    auto rate = [](size_t bytes, const std::vector<double> &times) { return bytes / median(times); };
+    std::cout << "JSON " << compact.size() << " bytes compact, " << pretty.size() << " bytes pretty" << std::endl
+              << "Median of " << runs << " runs:" << std::endl
+              << "  write compact       " << median(compact_times) / 1000 << " ms, "
+              << rate(compact.size(), compact_times) << " MB/s" << std::endl
+              << "  write pretty        " << median(pretty_times) / 1000 << " ms, " << rate(pretty.size(), pretty_times)
+              << " MB/s" << std::endl
+              << "  read from memory    " << median(memory_times) / 1000 << " ms, "
+              << rate(compact.size(), memory_times) << " MB/s" << std::endl
+              << "  read from istream   " << median(stream_times) / 1000 << " ms, "
+              << rate(compact.size(), stream_times) << " MB/s" << std::endl;
+    return 0;
+}
+
+// Parses `sources` with pools of 1 to 32 threads. Each pool parses one batch to warm up its recognizers (and the DFA)
+// before the timed batches. With `split`, the sources are parsed one after another, each split across the pool.
+int scaling(const std::vector<std::string> &sources, int runs, lexer_engine lexer, parser_engine engine, bool two_stage,
+            bool per_thread_dfa, bool split)
+{
+    size_t bytes = 0;
+    for (auto &source : sources)
+        bytes += source.size();
+
+    double single = 0;
+    std::cout << "Median of " << runs << " batches of " << sources.size() << " sources, " << bytes << " bytes:"
+              << std::endl;
+    for (size_t threads : {1, 2, 4, 8, 16, 32})
+    {
+        recognizer_pool pool(threads);
+        pool.set_lexer_engine(lexer);
+        pool.set_parser_engine(engine);
+        pool.set_two_stage_parsing(two_stage);
+        pool.set_per_thread_dfa(per_thread_dfa);
+        auto parse = [&]() {
+            if (!split)
+                return pool.parse_all(sources);
+            std::vector<parse_result> results;
+            for (auto &source : sources)
+                results.push_back(pool.parse_split(source));
+            return results;
+        };
+        for (auto &result : parse())
+            if (!result.ast)
+            {
+                std::cerr << "Parsing failed:" << std::endl << result.errors;
+                return 1;
+            }
+
+        std::vector<double> times;
+        for (int i = 0; i < runs; ++i)
+        {
+            auto start = bench_clock::now();
+            parse();
+            times.push_back(microseconds_since(start));
+        }
+        double time = median(times);
+        if (threads == 1)
+            single = time;
+        std::cout << "  " << threads << " threads: " << time / 1000 << " ms, " << bytes / time << " MB/s, speedup "
+                  << single / time << std::endl;
+    }
+    return 0;
+}
+}
+
+int main(int argc, char **argv)
+{
+    std::string mode, snapshot;
+    std::vector<std::string> inputs;
+    int runs = 20, copies = 1;
+    lexer_engine lexer = lexer_engine::antlr;
+    parser_engine engine = parser_engine::antlr;
+    bool two_stage = false, per_thread_dfa = false, split = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 10, "-snapshot=") == 0)
+            snapshot = arg.substr(10);
+        else if (arg.compare(0, 6, "-runs=") == 0)
+            runs = std::max(1, std::stoi(arg.substr(6)));
+        else if (arg.compare(0, 8, "-copies=") == 0)
+            copies = std::max(1, std::stoi(arg.substr(8)));
+        else if (arg == "-lexer=fast"s)
+            lexer = lexer_engine::fast;
+        else if (arg == "-parser=rd"s)
+            engine = parser_engine::recursive_descent;
+        else if (arg == "-two-stage"s)
+            two_stage = true;
+        else if (arg == "-per-thread-dfa"s)
+            per_thread_dfa = true;
+        else if (arg == "-split"s)
+            split = true;
+        else if (mode.empty())
+            mode = arg;
+        else
+            inputs.push_back(arg);
+    }
+
+    if (mode == "memory"s && inputs.size() == 1)
+        return memory(inputs[0], engine);
+
+    std::vector<std::string> sources;
+    for (auto &input : inputs)
+    {
+        std::ifstream in(input);
+        sources.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    if (mode == "startup"s && sources.size() == 1)
+        return startup(sources[0], snapshot, runs);
+    if (mode == "lexing"s && sources.size() == 1)
+        return lexing(sources[0], runs);
+    if (mode == "building"s && sources.size() == 1)
+        return building(sources[0], runs);
+    if (mode == "nesting"s)
+        return nesting(lexer, engine);
+    if (mode == "ownership"s && sources.size() == 1)
+        return ownership(sources[0], runs, lexer, engine);
+    if (mode == "tables"s)
+        return tables(lexer, engine);
+    if (mode == "dispatch"s && sources.size() == 1)
+        return dispatching(sources[0], runs, lexer, engine);
+    if (mode == "sharing"s && sources.size() == 1)
+        return sharing(sources[0], lexer, engine);
+    if (mode == "semantics"s && sources.size() == 1)
+        return semantics(sources[0], runs, lexer, engine);
+    if (mode == "scopes"s)
+        return scopes(runs, lexer, engine);
+    if (mode == "cache"s && sources.size() == 1)
+        return caching(sources[0], runs, lexer, engine);
+    if (mode == "json"s && sources.size() == 1)
+        return json(sources[0], runs, lexer, engine);
+    if (mode == "identifiers"s)
+        return identifiers(runs, lexer, engine);
+    if (mode == "flat"s && sources.size() == 1)
+        return flattening(sources[0], runs, lexer, engine);
+    if (mode == "editing"s && sources.size() == 1)
+        return editing(sources[0], runs, lexer, engine);
+    if (mode == "threads"s && !sources.empty())
+    {
+        std::vector<std::string> corpus;
+        for (int i = 0; i < copies; ++i)
+            corpus.insert(corpus.end(), sources.begin(), sources.end());
+        return scaling(corpus, runs, lexer, engine, two_stage, per_thread_dfa, split);
+    }
+
+    std::cerr << "Usage: c1r_bench startup [-snapshot=<file>] [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench threads [-lexer=fast] [-parser=rd] [-two-stage] [-per-thread-dfa] [-split] "
+                 "[-copies=<n>] [-runs=<n>] <input>..."
+              << std::endl
+              << "       c1r_bench memory [-parser=rd] <input>" << std::endl
+              << "       c1r_bench lexing [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench building [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench editing [-lexer=fast] [-parser=rd] [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench nesting [-lexer=fast] [-parser=rd]" << std::endl
+              << "       c1r_bench tables [-lexer=fast] [-parser=rd]" << std::endl
+              << "       c1r_bench ownership [-lexer=fast] [-parser=rd] [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench flat [-lexer=fast] [-parser=rd] [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench identifiers [-lexer=fast] [-parser=rd] [-runs=<n>]" << std::endl
+              << "       c1r_bench sharing [-lexer=fast] [-parser=rd] <input>" << std::endl
+              << "       c1r_bench dispatch [-lexer=fast] [-parser=rd] [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench semantics [-lexer=fast] [-parser=rd] [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench scopes [-lexer=fast] [-parser=rd] [-runs=<n>]" << std::endl
+              << "       c1r_bench cache [-lexer=fast] [-parser=rd] [-runs=<n>] <input>" << std::endl
+              << "       c1r_bench json [-lexer=fast] [-parser=rd] [-runs=<n>] <input>" << std::endl;
+    return -1;
+}
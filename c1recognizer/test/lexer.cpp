@@ -1,15 +1,35 @@
 #include <iostream>
+#include <iterator>
+#include <string>
 
 #include "antlr4-runtime.h"
 #include "C1Lexer.h"
 
+#include <c1recognizer/fast_lexer.h>
+
 using namespace antlr4;
 
 int main(int argc, const char* argv[]) {
+    using namespace std::literals::string_literals;
+
+    bool fast = false;
+    for (int i = 1; i < argc; ++i)
+        if ("-lexer=antlr"s == argv[i])
+            fast = false;
+        else if ("-lexer=fast"s == argv[i])
+            fast = true;
+        else {
+            std::cerr << "Usage: c1r_lexer [-lexer=antlr|fast] < <input>." << std::endl;
+            return -1;
+        }
+
     //std::ifstream infile(argv[1]);
-    ANTLRInputStream input(std::cin);
+    std::string source(std::istreambuf_iterator<char>(std::cin), {});
+    c1_recognizer::error_reporter reporter(std::cerr);
+    ANTLRInputStream input(source);
     C1Lexer lexer(&input);
-    CommonTokenStream tokens(&lexer);
+    c1_recognizer::fast_lexer scanner(source.data(), source.data() + source.size(), reporter);
+    CommonTokenStream tokens(fast ? static_cast<TokenSource *>(&scanner) : &lexer);
 
     tokens.fill();
     for (auto token : tokens.getTokens()) {
@@ -17,4 +37,4 @@ int main(int argc, const char* argv[]) {
     }
 
     return 0;
-}
\ No newline at end of file
+}
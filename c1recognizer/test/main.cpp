@@ -1,13 +1,29 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <rapidjson/filewritestream.h>
 #include <rapidjson/prettywriter.h>
-#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
 
 #include <c1recognizer/recognizer.h>
+#include <c1recognizer/parser_snapshot.h>
+#include <c1recognizer/large_stack.h>
+#include <c1recognizer/syntax_tree_deserializer.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <sys/stat.h>
 
 #include "syntax_tree_serializer.hpp"
 
+template <typename Writer>
+void serialize(Writer &writer, c1_recognizer::syntax_tree::syntax_tree_node &tree)
+{
+    c1_recognizer::syntax_tree::syntax_tree_serializer<Writer> serializer(writer);
+    serializer.serialize(tree);
+}
+
 int main(int argc, char **argv)
 {
     /*
@@ -20,19 +36,125 @@ int main(int argc, char **argv)
 
     std::ifstream input(argv[1]);
     */
-    c1_recognizer::recognizer rcg(std::cin);
+    using namespace std::literals::string_literals;
+
+    auto lexer = c1_recognizer::lexer_engine::antlr;
+    auto engine = c1_recognizer::parser_engine::antlr;
+    bool two_stage = false, streaming = false, compact = false, from_json = false;
+    std::string load_snapshot, save_snapshot, input, output;
+    for (int i = 1; i < argc; ++i)
+        if ("-lexer=antlr"s == argv[i])
+            lexer = c1_recognizer::lexer_engine::antlr;
+        else if ("-lexer=fast"s == argv[i])
+            lexer = c1_recognizer::lexer_engine::fast;
+        else if ("-parser=antlr"s == argv[i])
+            engine = c1_recognizer::parser_engine::antlr;
+        else if ("-parser=rd"s == argv[i])
+            engine = c1_recognizer::parser_engine::recursive_descent;
+        else if ("-two-stage"s == argv[i])
+            two_stage = true;
+        else if ("-streaming"s == argv[i])
+            streaming = true;
+        else if ("-compact"s == argv[i])
+            compact = true;
+        else if ("-from-json"s == argv[i])
+            from_json = true;
+        else if (std::string(argv[i]).compare(0, 7, "-input=") == 0)
+            input = argv[i] + 7;
+        else if (std::string(argv[i]).compare(0, 8, "-output=") == 0)
+            output = argv[i] + 8;
+        else if (std::string(argv[i]).compare(0, 15, "-load-snapshot=") == 0)
+            load_snapshot = argv[i] + 15;
+        else if (std::string(argv[i]).compare(0, 15, "-save-snapshot=") == 0)
+            save_snapshot = argv[i] + 15;
+        else
+        {
+            std::cerr << "Usage: c1r_test [-lexer=antlr|fast] [-parser=antlr|rd] [-two-stage] [-streaming]"
+                      << " [-load-snapshot=<file>] [-save-snapshot=<file>] [-from-json] [-compact] [-output=<file>]"
+                      << " (-input=<file> | < <input>)." << std::endl;
+            return -1;
+        }
+
+    if (!load_snapshot.empty() && !c1_recognizer::load_parser_snapshot(load_snapshot))
+        std::cerr << "Cannot load parser snapshot '" << load_snapshot << "'." << std::endl;
+
+    // A named input file is mapped into memory rather than read.
+    auto rcg = input.empty() ? std::unique_ptr<c1_recognizer::recognizer>(new c1_recognizer::recognizer(std::cin))
+                             : c1_recognizer::recognizer::from_file(input);
     c1_recognizer::error_reporter reporter(std::cerr);
+    rcg->set_lexer_engine(lexer);
+    rcg->set_parser_engine(engine);
+    rcg->set_two_stage_parsing(two_stage);
+    rcg->set_streaming(streaming);
 
-    if (!rcg.execute(reporter))
+    std::FILE *out = output.empty() ? stdout : std::fopen(output.c_str(), "wb");
+    if (!out)
+    {
+        std::cerr << "Cannot open '" << output << "' for writing." << std::endl;
         return 1;
+    }
 
-    std::shared_ptr<c1_recognizer::syntax_tree::syntax_tree_node> ast = rcg.get_syntax_tree();
+    // Parsing and serializing recurse as deep as the source nests; the size of standard input isn't known up front.
+    struct stat info;
+    size_t input_size = !input.empty() && stat(input.c_str(), &info) == 0 ? info.st_size : SIZE_MAX;
+    bool succeeded;
+    c1_recognizer::run_with_stack(c1_recognizer::stack_size_for(input_size), [&] {
+        std::shared_ptr<c1_recognizer::syntax_tree::syntax_tree_node> ast;
+        if (from_json)
+        {
+            c1_recognizer::syntax_tree::syntax_tree_deserializer deserializer;
+            std::ifstream in;
+            if (!input.empty())
+                in.open(input);
+            ast = deserializer.deserialize(input.empty() ? std::cin : in);
+            if (!ast)
+                std::cerr << deserializer.get_error() << std::endl;
+        }
+        else if (rcg->execute(reporter))
+            ast = rcg->get_syntax_tree();
+        succeeded = ast != nullptr;
+        if (!succeeded)
+            return;
 
-    rapidjson::StringBuffer s;
-    rapidjson::PrettyWriter<decltype(s)> writer(s);
-    c1_recognizer::syntax_tree::syntax_tree_serializer<decltype(writer)> serializer(writer);
-    serializer.serialize(*ast);
+        // Written as it is serialized, rather than held as a whole document first.
+        char buffer[1 << 16];
+        rapidjson::FileWriteStream stream(out, buffer, sizeof(buffer));
+        try
+        {
+            if (compact)
+            {
+                rapidjson::Writer<rapidjson::FileWriteStream> writer(stream);
+                serialize(writer, *ast);
+            }
+            else
+            {
+                rapidjson::PrettyWriter<rapidjson::FileWriteStream> writer(stream);
+                serialize(writer, *ast);
+            }
+        }
+        catch (c1_recognizer::stack_exhausted &e)
+        {
+            std::cerr << e.what() << " to serialize the syntax tree." << std::endl;
+            succeeded = false;
+            return;
+        }
+        stream.Put('\n');
+        stream.Flush();
+    });
+    if (out != stdout && std::fclose(out) != 0)
+    {
+        std::cerr << "Cannot write '" << output << "'." << std::endl;
+        return 1;
+    }
 
-    std::cout << s.GetString() << std::endl;
+    if (two_stage)
+    {
+        auto counters = c1_recognizer::recognizer::get_two_stage_counters();
+        std::cerr << "SLL parses: " << counters.sll_parses << ", LL fallbacks: " << counters.ll_fallbacks << std::endl;
+    }
+    if (!save_snapshot.empty() && !c1_recognizer::save_parser_snapshot(save_snapshot))
+        std::cerr << "Cannot save parser snapshot '" << save_snapshot << "'." << std::endl;
+    if (!succeeded)
+        return 1;
     return 0;
 }
@@ -51,7 +51,7 @@ class syntax_tree_serializer : public syntax_tree_visitor
         writer.Key("pos");
         writer.Int(tree.pos);
         writer.Key("name");
-        writer.String(tree.name.c_str());
+        writer.String(spelling(tree.name).c_str());
         writer.Key("body");
         tree.body->accept(*this);
         writer.EndObject();
@@ -119,7 +119,7 @@ class syntax_tree_serializer : public syntax_tree_visitor
         writer.Key("pos");
         writer.Int(tree.pos);
         writer.Key("name");
-        writer.String(tree.name.c_str());
+        writer.String(spelling(tree.name).c_str());
         if (tree.array_index)
         {
             writer.Key("array_index");
@@ -161,13 +161,15 @@ class syntax_tree_serializer : public syntax_tree_visitor
         writer.Key("is_int");
         writer.Bool(tree.is_int);
         writer.Key("name");
-        writer.String(tree.name.c_str());
+        writer.String(spelling(tree.name).c_str());
         if (tree.array_length)
         {
             writer.Key("array_length");
             tree.array_length->accept(*this);
             writer.Key("array_initializers");
             writer.StartArray();
+            for (size_t i = 0; i < tree.literal_initializers.size(); ++i)
+                tree.literal_initializers.at(i).accept(*this);
             for (auto init : tree.initializers)
                 init->accept(*this);
             writer.EndArray();
@@ -206,7 +208,7 @@ class syntax_tree_serializer : public syntax_tree_visitor
         writer.Key("pos");
         writer.Int(tree.pos);
         writer.Key("name");
-        writer.String(tree.name.c_str());
+        writer.String(spelling(tree.name).c_str());
         writer.EndObject();
     }
 